@@ -9,7 +9,24 @@ This file will contain the game code of the AI Agent who plays the game and the
 #pragma once
 #include "State.h"
 #include "Game.h"
-#include <map>
+#include "TranspositionTable.h"
+#include "Brain.h"
+#include "CompressedBrain.h"
+#include "SolvedStateStore.h"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <limits>
+#include <array>
 
 /// @brief Used to compare two bitsets of ENCODINGSIZE bits. This function is used to create a set of encodings.
 struct EncodingCompare
@@ -22,10 +39,68 @@ struct EncodingCompare
 
 class AgentTrainer
 {
+public:
+    /// @brief The ply that minimax with several threads stops splitting the search into tasks at, when no other is given.
+    static const int DefaultSplitPly = 3;
+
+    /// @brief The number of states a worker solves before it hands them to solvedStates_.
+    static const size_t WorkerSolvedStates = 4096;
+
 private:
+    /// @brief A state whose subtree is searched as one task by minimax with several threads.
+    struct trainerTask
+    {
+        Ultimate3TState state;
+
+        /// @brief How many moves the state is below the state minimax was called on.
+        int ply;
+
+        /// @brief The evaluation of the state, once done is set.
+        evaluationValue value;
+
+        std::atomic<bool> done;
+
+        trainerTask(const Ultimate3TState& taskState, int taskPly) : state(taskState), ply(taskPly), done(false) {}
+    };
+
+    /// @brief What each thread of a search keeps to itself. Threads only share the transposition table and their task queues.
+    struct trainerWorker
+    {
+        /// @brief The position of this worker in workers_.
+        size_t index;
+
+        /// @brief Guards tasks, which other workers steal from.
+        std::mutex lock;
+
+        /// @brief Tasks waiting to be searched. The owner takes the deepest from the back, and thieves take the largest from the front.
+        std::deque<trainerTask*> tasks;
 
-    /// @brief Transposition table that holds states that have already been searched. The value mapped to is a pair, the best move in the state and the evaluation of the best move. This is because to create the encoding for a state we already need to know the best move which defeats the purpose of the transposition table and the depth is not encoded at all. In order to preserve depth values, evaluation values are needed.
-    std::map<std::bitset<ENCODINGSIZE>, std::pair<evaluationValue, move>, EncodingCompare> transpositionTable_;
+        unsigned int statesExpanded;
+
+        /// @brief States solved since the worker last handed them to solvedStates_, at most WorkerSolvedStates.
+        std::vector<trainerEntry> solvedStates;
+    };
+
+    /// @brief Transposition table that holds states that have already been searched, keyed by the state's canonical hash so that a lookup does not need to encode the state and symmetric states share an entry. It has a fixed size, so a solve cannot use more memory for it than it was given. Every thread of a search probes and stores into it without locking.
+    TranspositionTable transpositionTable_;
+
+    /// @brief The result of every state solved by solveWinDrawLoss(), keyed by the state's canonical hash like transpositionTable_. Kept apart from it, since its results have no depths. It only takes its share of the table budget once a result only solve starts, see allocateWinDrawLossTable().
+    WinDrawLossTable winDrawLossTable_;
+
+    /// @brief The memory budget of transpositionTable_ and winDrawLossTable_ together.
+    size_t tableMegabytes_;
+
+    /// @brief Whether transpositionTable_ is backed with huge pages where that is supported.
+    bool useHugePages_;
+
+    /// @brief Whether winDrawLossTable_ has been given its share of the table budget.
+    bool winDrawLossTableAllocated_;
+
+    /// @brief Every state solved by a search. This is what writeToOutput() writes, so states pushed out of the transposition table are not lost from the output. It holds a fixed number of states in memory and keeps the rest on disk.
+    SolvedStateStore solvedStates_;
+
+    /// @brief Guards solvedStates_ while workers hand their solved states to it.
+    std::mutex solvedStatesLock_;
 
     /// @brief The Stream that the transposition table will be written to when writeToOutput() is called.
     std::ostream* outputStream_;
@@ -33,7 +108,75 @@ private:
     /// @brief Keeps track of the number of times generateMoves() is called during minimax. 
     unsigned int statesExpanded_;
 
-    void init(std::ostream& outputStream);
+    /// @brief The workers of the running search, one for each thread. Their counts are merged into statesExpanded_ when the search ends.
+    std::vector<std::unique_ptr<trainerWorker>> workers_;
+
+    /// @brief Whether more than one thread is searching, so states near the root are split into tasks.
+    bool shared_;
+
+    /// @brief States less than this many moves below the root of the running search are split into tasks.
+    int splitPly_;
+
+    /// @brief Set when the root of the running search has been solved, so idle workers stop looking for tasks.
+    std::atomic<bool> searchFinished_;
+
+    /// @brief Counts the tasks pushed and finished, and the end of the search. A worker with nothing to do sleeps until it changes. Only changed while holding workLock_, so that a worker going to sleep can not miss a change.
+    std::atomic<uint64_t> workCount_;
+
+    std::mutex workLock_;
+
+    /// @brief Wakes the workers sleeping in waitForWork() when workCount_ changes.
+    std::condition_variable workChanged_;
+
+    void init(std::ostream& outputStream, size_t tableMegabytes, bool useHugePages);
+
+    /// @brief Searches a state and every state below it, recording each one that is solved.
+    /// @param state The state to search. It is the same when this returns as when it was called.
+    /// @param worker The worker of the calling thread.
+    /// @param ply How many moves the state is below the root of the search.
+    evaluationValue search(Ultimate3TState& state, trainerWorker& worker, int ply);
+
+    /// @brief Takes a task from the worker's own queue, or steals one from another worker, and searches it.
+    /// @param worker The worker of the calling thread.
+    /// @param minimumPly Only tasks deeper than this are taken. A worker waiting on its own tasks only helps with smaller ones, so that helping can not nest deeper than the split ply.
+    /// @return true if a task was searched.
+    bool runTask(trainerWorker& worker, int minimumPly);
+
+    /// @brief Searches tasks until the search is finished. Run by every thread but the one that called minimax.
+    void runWorker(trainerWorker& worker);
+
+    /// @brief Wakes every sleeping worker, after tasks are pushed or a task is finished or the search ends.
+    void announceWork();
+
+    /// @brief Sleeps until workCount_ is no longer the count read before looking for a task, so that a worker with nothing to do does not hold a core.
+    void waitForWork(uint64_t seenWork);
+
+    /// @brief Stores a solved state in the transposition table and the worker's solved states.
+    /// @param symmetry The canonical symmetry of the state.
+    /// @param canonicalMove The best move in the canonical variant of the state.
+    void recordSolvedState(Ultimate3TState& state, int symmetry, evaluationValue value, move canonicalMove, trainerWorker& worker);
+
+    /// @brief Splits the table budget between transpositionTable_ and winDrawLossTable_, half each, the first time a result only solve needs them. The transposition table is emptied. Until then the whole budget is the transposition table's, so a minimax solve gets all of it.
+    void allocateWinDrawLossTable();
+
+    /// @brief Finds the result of a state and every state below it that it needs, recording each one that is solved. Stops searching a state's moves as soon as one wins for the player to move.
+    /// @param state The state to search. It is the same when this returns as when it was called.
+    player searchWinDrawLoss(Ultimate3TState& state);
+
+    /// @brief Finds the exact evaluation of a state that is won by either player, searching only the moves that keep the winner winning.
+    /// @param state A state solved by searchWinDrawLoss(). It is the same when this returns as when it was called.
+    /// @param result The result of the state.
+    /// @param worker Collects the states solved.
+    evaluationValue searchDepthToWin(Ultimate3TState& state, player result, trainerWorker& worker);
+
+    /// @brief Hands the states a worker has solved to solvedStates_.
+    void flushSolvedStates(trainerWorker& worker);
+
+    /// @brief Calls visit on a brain record for every solved state, sorted by key. A state that was pushed out of the transposition table and solved again, or solved again with a depth by refineDepthToWin(), is only visited as it was solved last.
+    void forEachBrainRecord(const Brain::brainRecordVisitor& visit);
+
+    /// @brief Creates a brain record for every solved state, sorted by key. Unlike forEachBrainRecord(), this holds them all in memory.
+    std::vector<brainRecord> createBrainRecords();
 
 public:
     /// @brief Creates a default AgentTrainer. Default values are the starting U3T state and std::cout.
@@ -43,6 +186,12 @@ public:
     /// @param outputStream The ostream to output to.
     AgentTrainer(std::ostream& outputStream);
 
+    /// @brief Creates an AgentTrainer with a transposition table of the given size.
+    /// @param outputStream The ostream to output to.
+    /// @param tableMegabytes The memory budget of the transposition table.
+    /// @param useHugePages If true, back the transposition table with huge pages where that is supported.
+    AgentTrainer(std::ostream& outputStream, size_t tableMegabytes, bool useHugePages = false);
+
     /// @brief Deconstructor
     ~AgentTrainer();
 
@@ -51,10 +200,42 @@ public:
     /// @return The evaluation of the state.
     evaluationValue minimax(Ultimate3TState& state);
 
-    /// @brief Write the output of the transposition table to outputStream_. 
+    /// @brief Run the minimax algorithm on the given state with several threads. States near the given state have their moves split into tasks, which idle threads steal from each other. The states solved, and so the output, are the same as minimax with one thread.
+    /// @param state The state to Start the search from.
+    /// @param threadCount The number of threads to search with, including the calling thread.
+    /// @param splitPly States fewer than this many moves below the given state are split into tasks. Deeper states are searched by whichever thread reached them.
+    /// @return The evaluation of the state.
+    evaluationValue minimax(Ultimate3TState& state, unsigned int threadCount, int splitPly = DefaultSplitPly);
+
+    /// @brief Solves the given state for its result only: who wins, or a draw. A state's moves are only searched until one wins for the player to move, which skips most of the tree minimax searches. Every state solved is recorded for output with a depth of 0, since depths are not tracked, and its best move is a move that keeps its result. Following best moves from a won state always wins. The first time this or refineDepthToWin() is called, half of the table budget is taken from the transposition table for the results, and the transposition table is emptied.
+    /// @param state The state to start the search from.
+    /// @return The result of the state.
+    player solveWinDrawLoss(Ultimate3TState& state);
+
+    /// @brief Finds the exact evaluation of a state and of every state on its winning lines, after solveWinDrawLoss(). In a state won by the player to move only the moves that keep the win are searched, for the fastest. In a state lost by the player to move every move is, for the slowest loss. Drawn states are left with a depth of 0. The evaluations and best moves recorded are those minimax finds for the same states, and replace the ones solveWinDrawLoss() recorded.
+    /// @param state The state to start the search from. It is solved with solveWinDrawLoss() first if it has not been.
+    /// @return The evaluation of the state, with a depth of 0 if it is a draw.
+    evaluationValue refineDepthToWin(Ultimate3TState& state);
+
+    /// @brief Write every solved state to outputStream_, ordered by position. Each state is written as its canonical variant, so a state must be transformed by its canonicalSymmetry() before it is looked up, and the best move found transformed back by the inverse symmetry.
     void writeToOutput();
 
-    /// @brief Resets the transposition table for a new state. This is so that running minimax multiple times does not cross contaminate runs.
+    /// @brief Write every solved state to the given stream as a binary brain file, see Brain. This is much smaller than writeToOutput() and can be looked up without being parsed.
+    /// @param output The stream to write to. It should be opened in binary mode.
+    void writeBrain(std::ostream& output);
+
+    /// @brief Write every solved state to the given stream as a compressed brain file, see CompressedBrain. This is the smallest output, but keeps no depths. Unlike the other outputs, it is built in memory.
+    /// @param output The stream to write to. It should be opened in binary mode.
+    void writeCompressedBrain(std::ostream& output);
+
+    /// @brief Creates a BrainTable holding every solved state, for serving lookups without writing a brain file first.
+    BrainTable createBrainTable();
+
+    /// @brief Sets how much memory the solved states kept for output may use. The rest are written to temporary files and merged back when the output is written.
+    /// @param megabytes The memory budget of the solved states.
+    void setSolvedStateMegabytes(size_t megabytes);
+
+    /// @brief Resets the transposition table and the results of solveWinDrawLoss() for a new state. This is so that running minimax multiple times does not cross contaminate runs.
     void resetTranspositionTable();
 
     /// @brief Gets the number of states expanded during the minimax algorithm.
@@ -63,21 +244,1048 @@ public:
     /// @brief Resets the number of states expanded during the minimax algorithm to 0. 
     void resetStatesExpanded();
 };
+
+/// @brief How long TIM may think about each move. Either a fixed time for every move, or a share of the time left on a game clock. TIM searches one more move ahead at a time until the time is up, and plays the best move of the deepest search it finished.
+struct timeControl
+{
+    /// @brief The time to spend on each move in milliseconds, or 0 to share out the clock instead.
+    long long moveTimeMs;
+
+    /// @brief The time left on the player's clock in milliseconds, or 0 if there is no clock.
+    long long remainingMs;
+
+    /// @brief The time added to the clock after each move in milliseconds.
+    long long incrementMs;
+
+    /// @brief The deepest search to run, in moves, or 0 for no limit.
+    int maxDepth;
+
+    /// @brief The number of moves the time left on a clock is shared between.
+    static const int MovesToGo = 20;
+
+    /// @brief Time never spent from a clock, to leave room for returning the move.
+    static const long long SafetyMarginMs = 10;
+
+    timeControl();
+
+    /// @brief No time limit, so the state is searched to the end of the game.
+    static timeControl unlimited();
+
+    /// @brief Spend the same time on every move.
+    static timeControl fixedMoveTime(long long moveTimeMs);
+
+    /// @brief Share the time left on a clock between the moves still to play.
+    static timeControl clock(long long remainingMs, long long incrementMs = 0);
+
+    /// @brief No time limit, but search no more than the given number of moves ahead.
+    static timeControl depth(int maxDepth);
+
+    /// @brief Whether the search has a deadline.
+    bool hasBudget() const;
+
+    /// @brief The time to spend on the next move in milliseconds. Only meaningful if hasBudget().
+    long long budgetMs() const;
+};
+
+/// @brief Which heuristics TIM orders moves by before searching them. Alpha beta skips more of the moves after one that causes a cutoff, so trying the moves most likely to cause one first shrinks the search. Each heuristic only breaks ties left by the ones above it.
+struct moveOrdering
+{
+    /// @brief Try the best move stored in the transposition table first.
+    bool tableMove;
+
+    /// @brief Then moves that win their sub-board for the player to move.
+    bool boardWins;
+
+    /// @brief Then moves that stop the other player winning a sub-board.
+    bool boardBlocks;
+
+    /// @brief Then moves that do not let the other player choose any board.
+    bool avoidFreeChoice;
+
+    /// @brief Then the last two moves that caused a cutoff this many moves into the search.
+    bool killerMoves;
+
+    /// @brief Then moves by how often they have caused cutoffs, weighted by how much each cutoff saved.
+    bool history;
+
+    /// @brief Creates an ordering using every heuristic.
+    moveOrdering();
+
+    /// @brief Every heuristic.
+    static moveOrdering all();
+
+    /// @brief No heuristic, so moves are searched in the order they are generated.
+    static moveOrdering none();
+};
+
+/// @brief How TIM searches a state to a given depth.
+enum searchAlgorithm : uint8_t
+{
+    /// @brief Alpha beta with the whole window at every state.
+    alphaBetaSearch,
+
+    /// @brief Principal variation search. The first move of each state is searched with the whole window, and the rest with a null window that only asks whether they are better. A move that is gets searched again with the whole window. With good move ordering few moves are, and null windows cut off far more.
+    principalVariationSearch,
+
+    /// @brief MTD(f). The root is only ever searched with null windows, each one moving a bound on its score towards a guess, until the bounds meet. The transposition table keeps the work of each search for the next. Game results have few scores, so few searches are needed.
+    mtdfSearch
+};
+
+/// @brief The results of the deepest search TIM::iterativeDeepening() finished.
+struct timSearchResult
+{
+    move bestMove;
+
+    /// @brief The evaluation of the state. Wins are always exact, but if solved is false a draw only means that neither player could force a win within depth moves.
+    evaluationValue evaluation;
+
+    /// @brief The score the search gave the state, positive when it favours x. When no win was found this is the heuristic score of the position the search expects, see Ultimate3TState::heuristicScore().
+    int score;
+
+    /// @brief How many moves ahead the search looked, or 0 if no search finished.
+    int depth;
+
+    /// @brief Whether the search reached the end of the game on every line, so the evaluation is exact.
+    bool solved;
+
+    /// @brief The time from the start of the search to the end of this one.
+    long long elapsedMs;
+};
+
 template <typename StateType>
 class TIM : public controller
 {
 private:
-    /// @brief Transposition table for holding states already evaluated.
-    std::map<std::bitset<ENCODINGSIZE>, std::pair<move, evaluationValue>, EncodingCompare> transpositionTable_;
+    /// @brief Transposition table for holding states already evaluated, keyed by the state's hash. Entries record whether their evaluation is exact or a bound, so they can be reused by searches with any window.
+    TranspositionTable transpositionTable_;
 
     unsigned int statesExpanded_;
 
-    void init();
+    /// @brief The number of threads search uses, including the calling thread.
+    unsigned int threadCount_;
+
+    /// @brief How long playMove may think. DefaultMoveTimeMs for each move unless another is set.
+    timeControl timeControl_;
+
+    /// @brief Set when the calling thread has finished a search, so the helper threads stop.
+    std::atomic<bool> stopHelpers_;
+
+    /// @brief Set when the deadline has passed or stop() is called, so every thread stops.
+    std::atomic<bool> stopSearch_;
+
+    /// @brief The steady clock time the running search must stop at, or NoDeadline. Atomic so that ponderHit() can set it while the search runs.
+    std::atomic<long long> deadlineTicks_;
+
+    /// @brief The steady clock time the running search's time budget started at.
+    std::atomic<long long> budgetStartTicks_;
+
+    /// @brief The steady clock time the running search started at.
+    long long searchStartTicks_;
+
+    /// @brief The thread running a search started by startSearch() or startPonder().
+    std::thread backgroundSearch_;
+
+    /// @brief Set while backgroundSearch_ is searching.
+    std::atomic<bool> searching_;
+
+    /// @brief Called with the results of each search iterative deepening finishes.
+    std::function<void(const timSearchResult&)> progressCallback_;
+
+    /// @brief What each thread of a search keeps to itself.
+    struct searchThread
+    {
+        /// @brief 0 for the calling thread, whose result is reported, and 1 and up for the helpers.
+        unsigned int index;
+
+        unsigned int statesExpanded;
+
+        /// @brief The number of times the search stopped short of the end of the game, by reaching its depth limit or by using a table entry that did. A state whose search leaves this unchanged is solved.
+        unsigned int horizonHits;
+
+        /// @brief The number of states whose search was cut off, and how many of those by the first move tried.
+        unsigned int cutoffs;
+        unsigned int firstMoveCutoffs;
+
+        /// @brief The last two moves that caused a cutoff at each ply, as made by move::toBinary(), or NoKiller. Kept between the searches of one iterative deepening, since cutoffs found by one are likely to happen again in the next.
+        std::array<std::array<uint8_t, 2>, moveList::MaxMoves + 1> killers;
+
+        /// @brief How much each move, indexed by board * 9 + space, has caused cutoffs.
+        std::array<uint32_t, moveList::MaxMoves> history;
+    };
+
+    /// @brief The threads of the running search. Kept between searches so that their killer moves and history carry over.
+    std::vector<searchThread> threads_;
+
+    /// @brief The helper threads, one for each thread but the calling one. Started by setThreadCount() and kept until the thread count changes, sleeping between root searches, so that a search does not pay to start and join threads.
+    std::vector<std::thread> helpers_;
+
+    /// @brief Guards the root search handed to the helpers, and the fields below it.
+    std::mutex helperLock_;
+
+    /// @brief Wakes the helpers when there is a new root search to help with, or when they should exit.
+    std::condition_variable helperWake_;
+
+    /// @brief Wakes the calling thread when the last helper has finished the root search.
+    std::condition_variable helpersDone_;
+
+    /// @brief The state, window and draft of the root search the helpers are helping with.
+    StateType helperRoot_;
+    int helperAlpha_;
+    int helperBeta_;
+    int helperDraft_;
+
+    /// @brief Counts the root searches handed to the helpers, so each helper knows when there is a new one.
+    uint64_t helperSearches_;
+
+    /// @brief The number of helpers still searching the current root search.
+    unsigned int helpersRunning_;
+
+    /// @brief Set to make the helpers exit.
+    bool helpersExit_;
+
+    /// @brief Which heuristics moves are ordered by.
+    moveOrdering moveOrdering_;
+
+    searchAlgorithm searchAlgorithm_;
+
+    /// @brief The number of times the root was searched, which is more than once per search with MTD(f).
+    unsigned int rootSearches_;
+
+    /// @brief The number of states searched with a cutoff, and of those cut off by the first move tried, by every thread.
+    unsigned int cutoffs_;
+    unsigned int firstMoveCutoffs_;
+
+    /// @brief A killer slot with no move in it. No move packs to this.
+    static constexpr uint8_t NoKiller = 0xFF;
+
+    /// @brief The deepest draft that adds to the history of a move. Searches to the end of the game have very large drafts, which would swamp the history of the rest.
+    static constexpr int MaxHistoryDraft = 16;
+
+    /// @brief The score of a win for x at depth 0. Wins further away score one less for every move.
+    static const int WinScore = 1000;
+
+    /// @brief Every score further from 0 than this is a win. It leaves room for a win at any depth, and is further from 0 than any heuristic score.
+    static const int WinThreshold = WinScore - 128;
+    static_assert(StateType::MaxHeuristicScore < WinThreshold, "Heuristic scores must lie between the wins and the losses");
+
+    /// @brief Larger than any score, used as an open window.
+    static const int InfiniteScore = 2 * WinScore;
+
+    /// @brief The draft of a search that always reaches the end of the game. Transposition table entries for solved states are stored with a depth of SolvedDraft plus their depth to the end of the game, so that they are usable by a search of any draft and are kept over unsolved entries, while entries from depth limited searches are stored with their draft, which is always less.
+    static const int SolvedDraft = 128;
+
+    /// @brief The number of states the calling thread expands between looks at the clock.
+    static const unsigned int NodesPerTimeCheck = 1024;
+
+    /// @brief The deadline of a search with no time limit.
+    static const long long NoDeadline = std::numeric_limits<long long>::max();
+
+    static long long nowTicks();
+
+    /// @brief Starts the clock for a search, with its deadline given by the time control. Also clears the killer moves and ages the history of the last search, since they are about another state.
+    void startClock(const timeControl& control);
+
+    /// @brief Sorts moves so that the ones most likely to cause a cutoff come first, using the heuristics of moveOrdering_.
+    /// @param tableMove The best move stored for the state, or nullptr if there is none.
+    /// @param ply How many moves the state is below the root of the search.
+    void orderMoves(StateType& state, moveList& actions, const move* tableMove, int ply, const searchThread& thread) const;
+
+    /// @brief Records a move that caused a cutoff in the killer moves and history of a thread.
+    void recordCutoff(move action, int draft, int ply, searchThread& thread) const;
+
+    /// @brief Iterative deepening on the clock already started.
+    /// @param maxDepth The deepest search to run, or 0 for no limit.
+    timSearchResult deepen(StateType& state, int maxDepth);
+
+    /// @brief Runs deepen() on backgroundSearch_, and returns a future for its result. Throws std::logic_error if a search is already running.
+    std::future<timSearchResult> startBackgroundSearch(const StateType& state, int maxDepth);
+
+    void init(size_t tableMegabytes, bool useHugePages, unsigned int threadCount);
+
+    /// @brief Starts a helper thread for every thread but the calling one.
+    void startHelpers();
+
+    /// @brief Makes every helper thread exit, and waits for them.
+    void stopHelperThreads();
+
+    /// @brief Run by each helper thread: waits for a root search, searches its own copy of the state, and waits again.
+    /// @param index The helper's position in threads_.
+    /// @param seenSearches The value of helperSearches_ when the helper was started.
+    void runHelper(unsigned int index, uint64_t seenSearches);
+
+    /// @brief Whether a thread should give up its search. Every thread stops once the deadline has passed, and helpers also stop once the calling thread has its result.
+    bool shouldStop(const searchThread& thread) const;
+
+    /// @brief Runs one search with every thread.
+    /// @param draft How many moves ahead to search. Helpers search one further every other thread.
+    /// @param bestMove Set to the best move found in the state.
+    /// @param solved Set to whether the search reached the end of the game on every line.
+    /// @return The score of the state. Meaningless if stopSearch_ is set.
+    int runSearch(StateType& state, int alpha, int beta, int draft, move& bestMove, bool& solved);
+
+    /// @brief Searches the state with searchAlgorithm_.
+    /// @param guess The score the state is expected to have. Only MTD(f) uses it, and the closer it is the fewer searches it runs.
+    /// @return The score of the state if it is between alpha and beta, otherwise a bound on the score on the side of the window it fell. Meaningless if stopSearch_ is set.
+    int searchRoot(StateType& state, int alpha, int beta, int draft, int guess, move& bestMove, bool& solved);
+
+    /// @brief MTD(f): null window searches of the root, each moving the lower or upper bound on its score, until they meet or leave the window.
+    int mtdf(StateType& state, int alpha, int beta, int draft, int guess, move& bestMove, bool& solved);
+
+    ///// Scores /////
+    // The search works on integer scores, where x winning at depth d is WinScore - d, o winning at depth d is -WinScore + d, and a draw is 0. This keeps the order of evaluationValues while letting window bounds be moved between depths. States at the depth limit score their StateType::heuristicScore(), which always lies between the wins and losses.
+
+    static int toScore(evaluationValue value);
+
+    /// @brief Converts a score back to an evaluation. Scores that are not wins come back as draws.
+    static evaluationValue fromScore(int score);
+
+    static bool isWinScore(int score);
+
+    /// @brief The score of a state given the score of its best child, which is one move further from the end of the game.
+    static int parentScore(int childScore);
+
+    /// @brief Converts a bound on a state's score into the bound on its children's scores that gives the same cutoff.
+    static int childBound(int bound);
+
+    /// @brief The alpha beta search itself.
+    /// @param state The state to search from. It is left unchanged.
+    /// @param alpha The score player x is assured of so far.
+    /// @param beta The score player o is assured of so far.
+    /// @param draft How many more moves to search. States at the limit that are not over score their heuristic score.
+    /// @param ply How many moves the state is below the root of the search.
+    /// @param bestMove Set to the best move found in the state.
+    /// @param thread The thread doing the search.
+    /// @return The score of the state if it is between alpha and beta, otherwise a bound on the score on the side of the window it fell. Meaningless if the thread was stopped.
+    int alphaBeta(StateType& state, int alpha, int beta, int draft, int ply, move& bestMove, searchThread& thread);
+
 public:
+    /// @brief The time playMove spends on each move when no other time control is set. Searching an early state to the end of the game would never finish, so TIM always has a budget unless it is asked not to.
+    static constexpr long long DefaultMoveTimeMs = 1000;
+
     TIM();
+
+    /// @brief Creates a TIM with a transposition table of the given size.
+    /// @param tableMegabytes The memory budget of the transposition table.
+    /// @param useHugePages If true, back the transposition table with huge pages where that is supported.
+    /// @param threadCount The number of threads to search with, see setThreadCount().
+    TIM(size_t tableMegabytes, bool useHugePages = false, unsigned int threadCount = 1);
+
+    /// @brief Stops any search running in the background and waits for it, and stops the helper threads.
     ~TIM();
 
+    /// @brief Chooses a move with iterativeDeepening(), so it returns within the time control. Must not be called while a background search runs.
     move playMove(StateType state);
 
-    std::pair<move, evaluationValue> search(StateType& state, evaluationValue alpha, evaluationValue beta);
-};
\ No newline at end of file
+    /// @brief Alpha beta search from the given state to the end of the game, with no time limit. Moves are made and taken back on state in place, so state is unchanged when this returns.
+    /// @param state The state to search from.
+    /// @param alpha The best value player x is assured of so far.
+    /// @param beta The best value player o is assured of so far.
+    /// @return The best move in the state and its evaluation. If the evaluation is not between alpha and beta it is only a bound.
+    /// @throws std::invalid_argument if beta is not better for x than alpha.
+    std::pair<move, evaluationValue> search(StateType& state, evaluationValue alpha = evaluationValue(player::o, 0), evaluationValue beta = evaluationValue(player::x, 0));
+
+    /// @brief Searches to the end of the game with a null window, which only answers whether the state is worth at least bound to x. This is much cheaper than finding its exact value, and is what principal variation search and MTD(f) are built on.
+    /// @param state The state to search from. It is left unchanged.
+    /// @param bound The evaluation to test against.
+    /// @param bestMove Set to the best move found. If the state is worth at least bound to the player to move, which is x at least bound or o less than it, the move achieves that.
+    /// @return true if the state is worth at least bound to x.
+    bool nullWindowSearch(StateType& state, evaluationValue bound, move& bestMove);
+
+    /// @brief Searches the state one move deeper at a time until the time control runs out, the state is solved, or a win is found. Each search starts from the transposition table left by the one before, so it tries the best moves found so far first. A search that runs out of time is thrown away, and the results of the last one to finish are returned.
+    /// @param state The state to search from. It is left unchanged.
+    /// @return The results of the deepest finished search. If none finished, the first legal move with a depth of 0.
+    timSearchResult iterativeDeepening(StateType& state);
+
+    /// @brief Starts iterative deepening on a background thread and returns at once, so the caller can do other work or call stop() while it searches.
+    /// @param state The state to search from. It is copied.
+    /// @param limits How long the search may think.
+    /// @return A future for the results of the search. Throws std::logic_error if a search is already running.
+    std::future<timSearchResult> startSearch(const StateType& state, const timeControl& limits);
+
+    /// @brief Searches during the opponent's turn. The opponent's most likely move is taken from the transposition table, and the state after it is searched in the background with no time limit. If the opponent plays that move call ponderHit(), and the search carries on as a normal search with everything it has found so far. Otherwise call stop(), wait for the future, and start a new search, which still gains from the states pondering left in the table.
+    /// @param state The state with the opponent to move. It is copied.
+    /// @param expectedReply Set to the move the search assumes the opponent will play.
+    /// @return A future for the results of the search. Throws std::invalid_argument if the opponent has no moves, and std::logic_error if a search is already running.
+    std::future<timSearchResult> startPonder(const StateType& state, move& expectedReply);
+
+    /// @brief Turns a ponder search into a normal search with the given time limit, counted from now. The depth limit of the time control is not used.
+    void ponderHit(const timeControl& limits);
+
+    /// @brief Stops the running search. Its future is given the results of the deepest search it finished. Safe to call from any thread, and does nothing if no search is running.
+    void stop();
+
+    /// @brief Whether a search started by startSearch() or startPonder() is still running.
+    bool isSearching() const;
+
+    /// @brief Sets a function called with the results of every search iterative deepening finishes, so a caller can follow a search as it deepens. Called on the thread doing the search.
+    void setProgressCallback(std::function<void(const timSearchResult&)> callback);
+
+    /// @brief Sets how long playMove and iterativeDeepening may think. DefaultMoveTimeMs for each move by default. With timeControl::unlimited() an early state is searched to the end of the game, which does not finish.
+    void setTimeControl(const timeControl& control);
+
+    const timeControl& getTimeControl() const;
+
+    /// @brief Sets the number of threads search and playMove use. With more than one, helper threads search the same state alongside the calling thread, each trying moves in a different order, and fill the shared transposition table with results the calling thread can reuse (Lazy SMP). The calling thread's result is the one returned.
+    /// @param threadCount The number of threads, including the calling thread. The helper threads are started here and kept for every search after. Throws std::invalid_argument if 0. Must not be called while a search runs.
+    void setThreadCount(unsigned int threadCount);
+
+    unsigned int getThreadCount() const;
+
+    /// @brief Sets which heuristics moves are ordered by. Every heuristic is used by default.
+    void setMoveOrdering(const moveOrdering& ordering);
+
+    const moveOrdering& getMoveOrdering() const;
+
+    /// @brief Sets how search and iterative deepening search each state. Alpha beta by default.
+    void setSearchAlgorithm(searchAlgorithm algorithm);
+
+    searchAlgorithm getSearchAlgorithm() const;
+
+    /// @brief Gets the number of times search has searched the root, which for MTD(f) is the number of null window searches it took.
+    unsigned int getRootSearches();
+
+    /// @brief Gets the number of states expanded by search, by every thread. Only meaningful while no background search runs.
+    unsigned int getStatesExpanded();
+
+    /// @brief Gets the number of states whose search was cut off before every move was tried.
+    unsigned int getCutoffs();
+
+    /// @brief Gets the share of cutoffs that came from the first move tried, which is how often move ordering put a move good enough to cut off first. 0 if there were no cutoffs.
+    double getFirstMoveCutoffRate();
+
+    /// @brief Resets the number of states expanded by search, the cutoff counts and the number of root searches to 0.
+    void resetStatesExpanded();
+};
+
+///// TIM definitions /////
+
+template <typename StateType>
+void TIM<StateType>::init(size_t tableMegabytes, bool useHugePages, unsigned int threadCount)
+{
+    statesExpanded_ = 0;
+    cutoffs_ = 0;
+    firstMoveCutoffs_ = 0;
+    rootSearches_ = 0;
+    transpositionTable_.resize(tableMegabytes, useHugePages);
+    helperSearches_ = 0;
+    helpersRunning_ = 0;
+    helpersExit_ = false;
+    setThreadCount(threadCount);
+    timeControl_ = timeControl::fixedMoveTime(DefaultMoveTimeMs);
+    moveOrdering_ = moveOrdering::all();
+    searchAlgorithm_ = alphaBetaSearch;
+    stopHelpers_.store(false);
+    stopSearch_.store(false);
+    deadlineTicks_.store(NoDeadline);
+    budgetStartTicks_.store(0);
+    searchStartTicks_ = 0;
+    searching_.store(false);
+}
+
+template <typename StateType>
+TIM<StateType>::TIM()
+{
+    init(TranspositionTable::DefaultMegabytes, false, 1);
+}
+
+template <typename StateType>
+TIM<StateType>::TIM(size_t tableMegabytes, bool useHugePages, unsigned int threadCount)
+{
+    init(tableMegabytes, useHugePages, threadCount);
+}
+
+template <typename StateType>
+TIM<StateType>::~TIM()
+{
+    stop();
+    if (backgroundSearch_.joinable()) { backgroundSearch_.join(); }
+    stopHelperThreads();
+}
+
+template <typename StateType>
+move TIM<StateType>::playMove(StateType state)
+{
+    transpositionTable_.newSearch();
+    return iterativeDeepening(state).bestMove;
+}
+
+template <typename StateType>
+std::future<timSearchResult> TIM<StateType>::startSearch(const StateType& state, const timeControl& limits)
+{
+    if (searching_.load()) { throw std::logic_error("TIM is already searching"); }
+    stopSearch_.store(false);
+    startClock(limits);
+    return startBackgroundSearch(state, limits.maxDepth);
+}
+
+template <typename StateType>
+std::future<timSearchResult> TIM<StateType>::startPonder(const StateType& state, move& expectedReply)
+{
+    if (searching_.load()) { throw std::logic_error("TIM is already searching"); }
+    StateType ponderState = state;
+    moveList actions;
+    ponderState.generateMoves(actions);
+    if (actions.size() == 0) { throw std::invalid_argument("Passed a state where the opponent has no moves to ponder on"); }
+
+    // the last search stored the reply it expected, unless the entry has since been replaced.
+    expectedReply = actions[0];
+    transpositionData transpositionTableEntry;
+    if (transpositionTable_.probe(ponderState.hash(), transpositionTableEntry))
+    {
+        auto stored = std::find_if(actions.begin(), actions.end(), [&transpositionTableEntry](const move& action) { return action.toBinary() == transpositionTableEntry.bestMove.toBinary(); });
+        if (stored != actions.end()) { expectedReply = *stored; }
+    }
+    ponderState.makeMove(expectedReply);
+
+    stopSearch_.store(false);
+    startClock(timeControl::unlimited());
+    return startBackgroundSearch(ponderState, 0);
+}
+
+template <typename StateType>
+std::future<timSearchResult> TIM<StateType>::startBackgroundSearch(const StateType& state, int maxDepth)
+{
+    if (backgroundSearch_.joinable()) { backgroundSearch_.join(); }
+    transpositionTable_.newSearch();
+    searching_.store(true);
+    std::promise<timSearchResult> promise;
+    std::future<timSearchResult> result = promise.get_future();
+    backgroundSearch_ = std::thread([this, searchState = state, maxDepth](std::promise<timSearchResult> searchPromise) mutable
+    {
+        timSearchResult found = deepen(searchState, maxDepth);
+        searching_.store(false);
+        searchPromise.set_value(found);
+    }, std::move(promise));
+    return result;
+}
+
+template <typename StateType>
+void TIM<StateType>::ponderHit(const timeControl& limits)
+{
+    long long now = nowTicks();
+    long long deadline = NoDeadline;
+    if (limits.hasBudget()) { deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::milliseconds(limits.budgetMs())).count(); }
+    // the start has to be moved first, so that the search never sees the new deadline with the old start.
+    budgetStartTicks_.store(now);
+    deadlineTicks_.store(deadline);
+}
+
+template <typename StateType>
+void TIM<StateType>::stop() { stopSearch_.store(true); }
+
+template <typename StateType>
+bool TIM<StateType>::isSearching() const { return searching_.load(); }
+
+template <typename StateType>
+void TIM<StateType>::setProgressCallback(std::function<void(const timSearchResult&)> callback) { progressCallback_ = callback; }
+
+template <typename StateType>
+void TIM<StateType>::setTimeControl(const timeControl& control) { timeControl_ = control; }
+
+template <typename StateType>
+const timeControl& TIM<StateType>::getTimeControl() const { return timeControl_; }
+
+template <typename StateType>
+void TIM<StateType>::setThreadCount(unsigned int threadCount)
+{
+    if (threadCount == 0) { throw std::invalid_argument("TIM needs at least one thread"); }
+    stopHelperThreads();
+    threadCount_ = threadCount;
+    size_t existingThreads = threads_.size();
+    threads_.resize(threadCount_);
+    for (size_t i = existingThreads; i < threads_.size(); i++)
+    {
+        for (std::array<uint8_t, 2>& plyKillers : threads_[i].killers) { plyKillers.fill(NoKiller); }
+        threads_[i].history.fill(0);
+    }
+    startHelpers();
+}
+
+template <typename StateType>
+void TIM<StateType>::startHelpers()
+{
+    for (unsigned int i = 1; i < threadCount_; i++)
+    {
+        helpers_.push_back(std::thread(&TIM::runHelper, this, i, helperSearches_));
+    }
+}
+
+template <typename StateType>
+void TIM<StateType>::stopHelperThreads()
+{
+    {
+        std::lock_guard<std::mutex> guard(helperLock_);
+        helpersExit_ = true;
+    }
+    helperWake_.notify_all();
+    for (std::thread& helper : helpers_) { helper.join(); }
+    helpers_.clear();
+    helpersExit_ = false;
+}
+
+template <typename StateType>
+void TIM<StateType>::runHelper(unsigned int index, uint64_t seenSearches)
+{
+    // helpers search their own copies of the state, and only matter through what they leave in the transposition table.
+    StateType helperState;
+    while (true)
+    {
+        int alpha, beta, draft;
+        {
+            std::unique_lock<std::mutex> lock(helperLock_);
+            helperWake_.wait(lock, [this, seenSearches]() { return helpersExit_ or helperSearches_ != seenSearches; });
+            if (helpersExit_) { return; }
+            seenSearches = helperSearches_;
+            helperState = helperRoot_;
+            alpha = helperAlpha_;
+            beta = helperBeta_;
+            draft = helperDraft_;
+        }
+        // every other helper looks one move further ahead, so that the calling thread finds deeper results waiting in the table.
+        int helperDraft = draft < SolvedDraft ? draft + int(index % 2) : draft;
+        move helperMove;
+        alphaBeta(helperState, alpha, beta, helperDraft, 0, helperMove, threads_[index]);
+        bool lastHelper;
+        {
+            std::lock_guard<std::mutex> guard(helperLock_);
+            lastHelper = --helpersRunning_ == 0;
+        }
+        if (lastHelper) { helpersDone_.notify_one(); }
+    }
+}
+
+template <typename StateType>
+unsigned int TIM<StateType>::getThreadCount() const { return threadCount_; }
+
+template <typename StateType>
+void TIM<StateType>::setMoveOrdering(const moveOrdering& ordering) { moveOrdering_ = ordering; }
+
+template <typename StateType>
+const moveOrdering& TIM<StateType>::getMoveOrdering() const { return moveOrdering_; }
+
+template <typename StateType>
+void TIM<StateType>::setSearchAlgorithm(searchAlgorithm algorithm) { searchAlgorithm_ = algorithm; }
+
+template <typename StateType>
+searchAlgorithm TIM<StateType>::getSearchAlgorithm() const { return searchAlgorithm_; }
+
+template <typename StateType>
+unsigned int TIM<StateType>::getRootSearches() { return rootSearches_; }
+
+template <typename StateType>
+unsigned int TIM<StateType>::getStatesExpanded() { return statesExpanded_; }
+
+template <typename StateType>
+unsigned int TIM<StateType>::getCutoffs() { return cutoffs_; }
+
+template <typename StateType>
+double TIM<StateType>::getFirstMoveCutoffRate() { return cutoffs_ == 0 ? 0.0 : double(firstMoveCutoffs_) / double(cutoffs_); }
+
+template <typename StateType>
+bool TIM<StateType>::shouldStop(const searchThread& thread) const
+{
+    return stopSearch_.load(std::memory_order_relaxed) or (thread.index != 0 and stopHelpers_.load(std::memory_order_relaxed));
+}
+
+template <typename StateType>
+void TIM<StateType>::resetStatesExpanded()
+{
+    statesExpanded_ = 0;
+    cutoffs_ = 0;
+    firstMoveCutoffs_ = 0;
+    rootSearches_ = 0;
+}
+
+template <typename StateType>
+int TIM<StateType>::toScore(evaluationValue value)
+{
+    switch (value.getPlayerToWin())
+    {
+    case player::x:
+        return WinScore - value.getDepth();
+    case player::o:
+        return -WinScore + value.getDepth();
+    default:
+        return 0;
+    }
+}
+
+template <typename StateType>
+evaluationValue TIM<StateType>::fromScore(int score)
+{
+    if (score > WinThreshold) { return evaluationValue(player::x, WinScore - score); }
+    if (score < -WinThreshold) { return evaluationValue(player::o, score + WinScore); }
+    return evaluationValue(player::draw, 0);
+}
+
+template <typename StateType>
+bool TIM<StateType>::isWinScore(int score) { return score > WinThreshold or score < -WinThreshold; }
+
+template <typename StateType>
+int TIM<StateType>::parentScore(int childScore)
+{
+    // a win one move further away is worth one less to the winner, and a draw or a heuristic score is worth the same at any depth.
+    if (childScore > WinThreshold) { return childScore - 1; }
+    if (childScore < -WinThreshold) { return childScore + 1; }
+    return childScore;
+}
+
+template <typename StateType>
+int TIM<StateType>::childBound(int bound)
+{
+    // the inverse of parentScore, so that parentScore(child) >= bound exactly when child >= childBound(bound). No score lies near WinThreshold, so it does not matter which way a bound there is moved.
+    if (bound > WinThreshold) { return bound + 1; }
+    if (bound < -WinThreshold) { return bound - 1; }
+    return bound;
+}
+
+template <typename StateType>
+std::pair<move, evaluationValue> TIM<StateType>::search(StateType& state, evaluationValue alpha, evaluationValue beta)
+{
+    // with no room between alpha and beta a returned score could not say which side of the window it fell on.
+    if (!(beta > alpha))
+    {
+        throw std::invalid_argument("Passed a search window where beta is not better than alpha");
+    }
+    stopSearch_.store(false);
+    startClock(timeControl::unlimited());
+    move bestMove;
+    bool solved;
+    // most states are draws, so it is the best guess with nothing else to go on.
+    int score = searchRoot(state, toScore(alpha), toScore(beta), SolvedDraft, 0, bestMove, solved);
+    return std::pair<move, evaluationValue>(bestMove, fromScore(score));
+}
+
+template <typename StateType>
+bool TIM<StateType>::nullWindowSearch(StateType& state, evaluationValue bound, move& bestMove)
+{
+    stopSearch_.store(false);
+    startClock(timeControl::unlimited());
+    int boundScore = toScore(bound);
+    bool solved;
+    rootSearches_++;
+    int score = runSearch(state, boundScore - 1, boundScore, SolvedDraft, bestMove, solved);
+    return score >= boundScore;
+}
+
+template <typename StateType>
+timSearchResult TIM<StateType>::iterativeDeepening(StateType& state)
+{
+    stopSearch_.store(false);
+    startClock(timeControl_);
+    return deepen(state, timeControl_.maxDepth);
+}
+
+template <typename StateType>
+long long TIM<StateType>::nowTicks() { return std::chrono::steady_clock::now().time_since_epoch().count(); }
+
+template <typename StateType>
+void TIM<StateType>::startClock(const timeControl& control)
+{
+    searchStartTicks_ = nowTicks();
+    budgetStartTicks_.store(searchStartTicks_);
+    long long deadline = NoDeadline;
+    if (control.hasBudget()) { deadline = searchStartTicks_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::milliseconds(control.budgetMs())).count(); }
+    deadlineTicks_.store(deadline);
+    // killer moves are about particular states, which the new search may not reach, while the history is about moves in general, so it only fades.
+    for (searchThread& thread : threads_)
+    {
+        for (std::array<uint8_t, 2>& plyKillers : thread.killers) { plyKillers.fill(NoKiller); }
+        for (uint32_t& count : thread.history) { count /= 2; }
+    }
+}
+
+template <typename StateType>
+void TIM<StateType>::orderMoves(StateType& state, moveList& actions, const move* tableMove, int ply, const searchThread& thread) const
+{
+    // each heuristic gets a bit above those after it, so that the ones after it only break its ties. The history is kept below all of them.
+    const int TableMoveScore = 1 << 28;
+    const int BoardWinScore = 1 << 27;
+    const int BoardBlockScore = 1 << 26;
+    const int NoFreeChoiceScore = 1 << 25;
+    const int FirstKillerScore = 1 << 24;
+    const int SecondKillerScore = 1 << 23;
+    const uint32_t MaxHistoryScore = (1 << 23) - 1;
+
+    player mover = state.getActivePlayer();
+    player opponent = mover == player::x ? player::o : player::x;
+    int scores[moveList::MaxMoves];
+    for (int i = 0; i < actions.size(); i++)
+    {
+        move action = actions[i];
+        uint8_t code = action.toBinary();
+        int score = 0;
+        if (moveOrdering_.tableMove and tableMove != nullptr and code == tableMove->toBinary()) { score += TableMoveScore; }
+        if (moveOrdering_.boardWins and state.winsBoard(action, mover)) { score += BoardWinScore; }
+        if (moveOrdering_.boardBlocks and state.winsBoard(action, opponent)) { score += BoardBlockScore; }
+        if (moveOrdering_.avoidFreeChoice and !state.givesFreeChoice(action)) { score += NoFreeChoiceScore; }
+        if (moveOrdering_.killerMoves)
+        {
+            if (code == thread.killers[ply][0]) { score += FirstKillerScore; }
+            else if (code == thread.killers[ply][1]) { score += SecondKillerScore; }
+        }
+        if (moveOrdering_.history) { score += int(std::min(thread.history[action.board * 9 + action.space], MaxHistoryScore)); }
+        scores[i] = score;
+    }
+
+    // an insertion sort, which is quick for so few moves and keeps equally scored moves in the order they were generated.
+    for (int i = 1; i < actions.size(); i++)
+    {
+        move action = actions[i];
+        int score = scores[i];
+        int j = i;
+        for (; j > 0 and scores[j - 1] < score; j--)
+        {
+            actions[j] = actions[j - 1];
+            scores[j] = scores[j - 1];
+        }
+        actions[j] = action;
+        scores[j] = score;
+    }
+}
+
+template <typename StateType>
+void TIM<StateType>::recordCutoff(move action, int draft, int ply, searchThread& thread) const
+{
+    uint8_t code = action.toBinary();
+    if (thread.killers[ply][0] != code)
+    {
+        thread.killers[ply][1] = thread.killers[ply][0];
+        thread.killers[ply][0] = code;
+    }
+    // a cutoff deep in the tree saves little, so it adds little to the history.
+    int historyDraft = std::min(draft, MaxHistoryDraft);
+    thread.history[action.board * 9 + action.space] += uint32_t(historyDraft * historyDraft);
+}
+
+template <typename StateType>
+timSearchResult TIM<StateType>::deepen(StateType& state, int maxDepth)
+{
+    // if not even the first search finishes, any legal move is better than none.
+    moveList actions;
+    state.generateMoves(actions);
+    timSearchResult result{actions.size() > 0 ? actions[0] : move(), evaluationValue(player::draw, 0), 0, 0, false, 0};
+
+    int lastDepth = SolvedDraft - 1;
+    if (maxDepth > 0) { lastDepth = std::min(lastDepth, maxDepth); }
+    for (int depth = 1; depth <= lastDepth; depth++)
+    {
+        move bestMove;
+        bool solved;
+        // the last search's score is the best guess for this one, since one move deeper rarely changes it much.
+        int score = searchRoot(state, -InfiniteScore, InfiniteScore, depth, result.score, bestMove, solved);
+        if (stopSearch_.load()) { break; }
+        long long now = nowTicks();
+        long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::duration(now - searchStartTicks_)).count();
+        result = timSearchResult{bestMove, fromScore(score), score, depth, solved, elapsedMs};
+        if (progressCallback_) { progressCallback_(result); }
+        // searching deeper can not change a solved state, or a win, since a faster win would have been found by this search.
+        if (solved or isWinScore(score)) { break; }
+        // the next search takes several times as long as this one, so it would most likely be thrown away.
+        long long deadline = deadlineTicks_.load();
+        long long budgetStart = budgetStartTicks_.load();
+        if (deadline != NoDeadline and now - budgetStart > (deadline - budgetStart) / 2) { break; }
+    }
+    return result;
+}
+
+template <typename StateType>
+int TIM<StateType>::runSearch(StateType& state, int alpha, int beta, int draft, move& bestMove, bool& solved)
+{
+    stopHelpers_.store(false);
+    for (unsigned int i = 0; i < threadCount_; i++)
+    {
+        searchThread& thread = threads_[i];
+        thread.index = i;
+        thread.statesExpanded = 0;
+        thread.horizonHits = 0;
+        thread.cutoffs = 0;
+        thread.firstMoveCutoffs = 0;
+    }
+    // the helpers are already running, and only need waking with the search to help with.
+    if (!helpers_.empty())
+    {
+        {
+            std::lock_guard<std::mutex> guard(helperLock_);
+            helperRoot_ = state;
+            helperAlpha_ = alpha;
+            helperBeta_ = beta;
+            helperDraft_ = draft;
+            helpersRunning_ = (unsigned int)helpers_.size();
+            helperSearches_++;
+        }
+        helperWake_.notify_all();
+    }
+
+    int score = alphaBeta(state, alpha, beta, draft, 0, bestMove, threads_[0]);
+    stopHelpers_.store(true);
+    {
+        std::unique_lock<std::mutex> lock(helperLock_);
+        helpersDone_.wait(lock, [this]() { return helpersRunning_ == 0; });
+    }
+    for (const searchThread& thread : threads_)
+    {
+        statesExpanded_ += thread.statesExpanded;
+        cutoffs_ += thread.cutoffs;
+        firstMoveCutoffs_ += thread.firstMoveCutoffs;
+    }
+    solved = threads_[0].horizonHits == 0;
+    return score;
+}
+
+template <typename StateType>
+int TIM<StateType>::searchRoot(StateType& state, int alpha, int beta, int draft, int guess, move& bestMove, bool& solved)
+{
+    if (searchAlgorithm_ == mtdfSearch) { return mtdf(state, alpha, beta, draft, guess, bestMove, solved); }
+    rootSearches_++;
+    return runSearch(state, alpha, beta, draft, bestMove, solved);
+}
+
+template <typename StateType>
+int TIM<StateType>::mtdf(StateType& state, int alpha, int beta, int draft, int guess, move& bestMove, bool& solved)
+{
+    bool maximizing = state.isMaxNode();
+    int lower = alpha;
+    int upper = beta;
+    int score = guess;
+    bool foundMove = false;
+    solved = true;
+    while (lower < upper)
+    {
+        // test just above the lower bound if the last search raised it, otherwise at the upper bound, keeping the test inside the bounds.
+        int testBound = score == lower ? score + 1 : score;
+        testBound = std::max(lower + 1, std::min(testBound, upper));
+        move passMove;
+        bool passSolved;
+        rootSearches_++;
+        score = runSearch(state, testBound - 1, testBound, draft, passMove, passSolved);
+        if (stopSearch_.load()) { return score; }
+        solved = solved and passSolved;
+        bool failedHigh = score >= testBound;
+        if (failedHigh) { lower = score; }
+        else { upper = score; }
+        // only a search that proved a bound for the player to move proved its move achieves it, a search that failed the other way only shows that every move is worse.
+        if (failedHigh == maximizing or !foundMove)
+        {
+            bestMove = passMove;
+            foundMove = failedHigh == maximizing;
+        }
+    }
+    return score;
+}
+
+template <typename StateType>
+int TIM<StateType>::alphaBeta(StateType& state, int alpha, int beta, int draft, int ply, move& bestMove, searchThread& thread)
+{
+    if (shouldStop(thread)) { return 0; }
+    int originalAlpha = alpha;
+    int originalBeta = beta;
+    unsigned int originalHorizonHits = thread.horizonHits;
+
+    // check if the state is in the transposition table. An entry searched at least as deep either answers the search or narrows the window, and any entry's best move is a good first move to try.
+    transpositionData transpositionTableEntry;
+    bool foundEntry = transpositionTable_.probe(state.hash(), transpositionTableEntry);
+    if (foundEntry and transpositionTableEntry.depth >= draft)
+    {
+        int storedScore = transpositionTableEntry.score;
+        bestMove = transpositionTableEntry.bestMove;
+        if (transpositionTableEntry.depth < SolvedDraft) { thread.horizonHits++; }
+        if (transpositionTableEntry.bound == exactBound) { return storedScore; }
+        if (transpositionTableEntry.bound == lowerBound) { alpha = std::max(alpha, storedScore); }
+        if (transpositionTableEntry.bound == upperBound) { beta = std::min(beta, storedScore); }
+        if (alpha >= beta) { return storedScore; }
+    }
+
+    if (state.isTerminalState())
+    {
+        int score = toScore(evaluationValue(state.utility(), 0));
+        bestMove = move();
+        // put state into the transposition table
+        transpositionTable_.store(state.hash(), transpositionData{fromScore(score), bestMove, uint8_t(SolvedDraft), exactBound, int16_t(score)});
+        return score;
+    }
+    if (draft == 0)
+    {
+        thread.horizonHits++;
+        bestMove = move();
+        return state.heuristicScore();
+    }
+
+    moveList actions;
+    state.generateMoves(actions);
+    thread.statesExpanded++;
+    // looking at the clock is slow next to expanding a state, so only the calling thread does it, and only every so often.
+    if (thread.index == 0 and thread.statesExpanded % NodesPerTimeCheck == 0 and nowTicks() >= deadlineTicks_.load(std::memory_order_relaxed))
+    {
+        stopSearch_.store(true, std::memory_order_relaxed);
+    }
+    orderMoves(state, actions, foundEntry ? &transpositionTableEntry.bestMove : nullptr, ply, thread);
+    // each helper tries the rest of the moves starting from a different one, so that the threads spread out over the tree instead of all searching the same states.
+    if (thread.index != 0 and actions.size() > 2)
+    {
+        std::rotate(actions.begin() + 1, actions.begin() + 1 + thread.index % (actions.size() - 1), actions.end());
+    }
+
+    bool maximizing = state.isMaxNode();
+    int childAlpha = childBound(alpha);
+    int childBeta = childBound(beta);
+    int value = maximizing ? -InfiniteScore : InfiniteScore;
+    move childBestMove;
+    bestMove = actions[0];
+    for (move* action = actions.begin(); action != actions.end(); action++)
+    {
+        auto undo = state.makeMove(*action);
+        int nextStateValue;
+        if (searchAlgorithm_ == principalVariationSearch and action != actions.begin() and childBeta - childAlpha > 1)
+        {
+            // ask only whether this move beats the best so far, and search it properly only if it does.
+            int scoutAlpha = maximizing ? childAlpha : childBeta - 1;
+            nextStateValue = alphaBeta(state, scoutAlpha, scoutAlpha + 1, draft - 1, ply + 1, childBestMove, thread);
+            if (!shouldStop(thread) and nextStateValue > childAlpha and nextStateValue < childBeta)
+            {
+                nextStateValue = alphaBeta(state, childAlpha, childBeta, draft - 1, ply + 1, childBestMove, thread);
+            }
+        }
+        else { nextStateValue = alphaBeta(state, childAlpha, childBeta, draft - 1, ply + 1, childBestMove, thread); }
+        state.unmakeMove(undo);
+        // a stopped search's scores are meaningless, so leave without storing anything.
+        if (shouldStop(thread)) { return 0; }
+        if (maximizing ? nextStateValue > value : nextStateValue < value)
+        {
+            bestMove = *action;
+            value = nextStateValue;
+        }
+        // Update alpha or beta and check if we can prune
+        bool cutoff;
+        if (maximizing)
+        {
+            childAlpha = std::max(childAlpha, value);
+            cutoff = value >= childBeta;
+        }
+        else
+        {
+            childBeta = std::min(childBeta, value);
+            cutoff = value <= childAlpha;
+        }
+        if (cutoff)
+        {
+            thread.cutoffs++;
+            if (action == actions.begin()) { thread.firstMoveCutoffs++; }
+            recordCutoff(bestMove, draft, ply, thread);
+            break;
+        }
+    }
+    // because there was a move to get to this state, we must increase the depth by one here.
+    value = parentScore(value);
+
+    // a value outside the original window is only a bound, because the search stopped looking once it knew the value would not be used.
+    boundType bound = exactBound;
+    if (value <= originalAlpha) { bound = upperBound; }
+    else if (value >= originalBeta) { bound = lowerBound; }
+    evaluationValue evaluation = fromScore(value);
+    // a state whose search never stopped short of the end of the game is solved, and its entry is good for a search of any draft.
+    bool solved = thread.horizonHits == originalHorizonHits;
+    int storedDepth = solved ? SolvedDraft + evaluation.getDepth() : draft;
+    transpositionTable_.store(state.hash(), transpositionData{evaluation, bestMove, uint8_t(storedDepth), bound, int16_t(value)});
+    return value;
+}
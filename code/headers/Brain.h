@@ -0,0 +1,257 @@
+/* Brain.h
+Ultimate Tic Tac Toe AI project
+Andrew Bergman
+12/9/23
+
+This file defines the binary brain file that AgentTrainer writes, and the reader that the AI uses to look up moves in it.
+
+A brain file is:
+    a brainHeader
+    recordCount brainRecords, sorted by key
+    an optional index holding the key of every indexStride-th record
+
+Including:
+    MappedFile class
+    brainHeader struct
+    brainRecord struct
+    Brain class
+    brainLookup struct
+    BrainTable class
+*/
+#pragma once
+#include "State.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <ostream>
+
+/// @brief A file mapped read only into memory. Nothing is read up front, and processes that map the same file share its pages through the OS page cache. Where files can not be mapped, the file is read into memory instead.
+class MappedFile
+{
+private:
+    /// @brief The start of the file in memory.
+    const unsigned char* data_;
+
+    /// @brief The size of the file in bytes.
+    size_t size_;
+
+    /// @brief Whether data_ was mapped with mmap, and so must be freed with munmap.
+    bool mapped_;
+
+    /// @brief Holds the file when it can not be mapped.
+    std::vector<unsigned char> buffer_;
+
+    void init(const std::string& path);
+
+public:
+    /// @brief Maps a file. Throws std::runtime_error if the file can not be opened or mapped.
+    /// @param path The path of the file.
+    MappedFile(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const;
+    size_t size() const;
+};
+
+/// @brief The start of a brain file. Offsets are in bytes from the start of the file. Numbers are stored in the machine's byte order, which is little endian on every platform this project targets.
+struct brainHeader
+{
+    /// @brief Always BrainMagic, so that other files are not mistaken for a brain.
+    char magic[8];
+
+    /// @brief The version of the format. A reader refuses versions it does not know.
+    uint32_t version;
+
+    /// @brief The size of one brainRecord, so a reader can tell that the file was written with the same layout.
+    uint32_t recordSize;
+
+    uint64_t recordCount;
+    uint64_t recordsOffset;
+
+    /// @brief Where the index starts, or 0 if the file has no index.
+    uint64_t indexOffset;
+
+    /// @brief The number of records between two keys of the index.
+    uint64_t indexStride;
+
+    /// @brief The number of keys in the index.
+    uint64_t indexCount;
+
+    uint64_t reserved;
+};
+
+/// @brief One solved state. States are stored as their canonical variant, see Ultimate3TState::canonicalSymmetry().
+struct brainRecord
+{
+    /// @brief The packed canonical position, which the records are sorted by.
+    packedPosition key;
+
+    /// @brief The evaluation, with the player to win in the low 2 bits and the depth above them.
+    uint16_t evaluation;
+
+    /// @brief The best move in the canonical position, as made by move::toBinary().
+    uint8_t bestMove;
+
+    uint8_t reserved[5];
+
+    /// @brief Creates a record from the results of a search.
+    static brainRecord create(packedPosition key, evaluationValue evaluation, move bestMove);
+
+    evaluationValue getEvaluation() const;
+    move getBestMove() const;
+};
+
+/// @brief Reads a brain file by mapping it into memory. Nothing is read up front, so opening a brain is instant, and processes that open the same brain share its pages through the OS page cache.
+class Brain
+{
+public:
+    /// @brief The first 8 bytes of every brain file.
+    static const char BrainMagic[8];
+
+    /// @brief The version written by write(). Version 1 keyed each state by its variant with the lowest hash, which changed with the Zobrist keys, so it is no longer read.
+    static const uint32_t BrainVersion = 2;
+
+    /// @brief The number of records between two keys of the index written by write().
+    static const uint64_t DefaultIndexStride = 64;
+
+private:
+    MappedFile file_;
+
+    const brainHeader* header_;
+    const brainRecord* records_;
+
+    /// @brief The index, or nullptr if the file has none.
+    const packedPosition* index_;
+
+    void init();
+
+    /// @brief Checks that the header describes a brain this reader can use. Throws an error if it does not.
+    void validate() const;
+
+    /// @brief Finds the record of a packed canonical position.
+    /// @return The record, or nullptr if the position is not in the brain.
+    const brainRecord* find(const packedPosition& key) const;
+
+public:
+    /// @brief Opens a brain file. Throws std::runtime_error if the file can not be opened or is not a brain this reader can use.
+    /// @param path The path of the brain file.
+    Brain(const std::string& path);
+
+    /// @brief Writes a brain file. Throws an error if the records are not sorted by key.
+    /// @param output The stream to write to. It should be opened in binary mode.
+    /// @param records The records to write, sorted by key with no key repeated.
+    /// @param indexStride The number of records between two keys of the index, or 0 to write no index.
+    static void write(std::ostream& output, const std::vector<brainRecord>& records, uint64_t indexStride = DefaultIndexStride);
+
+    /// @brief Called on each record of a brain as it is written.
+    typedef std::function<void(const brainRecord&)> brainRecordVisitor;
+
+    /// @brief Writes a brain file from records that are given one at a time, so that they never all need to be in memory. Throws an error if the records are not sorted by key.
+    /// @param output The stream to write to. It should be opened in binary mode.
+    /// @param forEachRecord Calls the visitor it is given on every record, sorted by key with no key repeated. It is called up to three times, and must give the same records each time.
+    /// @param indexStride The number of records between two keys of the index, or 0 to write no index.
+    static void write(std::ostream& output, const std::function<void(const brainRecordVisitor&)>& forEachRecord, uint64_t indexStride = DefaultIndexStride);
+
+    /// @brief Looks up a state. The state does not need to be canonical, the best move is given for the state as it is.
+    /// @param state The state to look up.
+    /// @param evaluation Filled in with the evaluation of the state if it is found.
+    /// @param bestMove Filled in with the best move in the state if it is found.
+    /// @return true if the state was found.
+    bool lookup(const Ultimate3TState& state, evaluationValue& evaluation, move& bestMove) const;
+
+    /// @brief Gets the best move in a state. Throws std::out_of_range if the state is not in the brain.
+    move bestMove(const Ultimate3TState& state) const;
+
+    /// @brief Gets the number of states in the brain.
+    size_t size() const;
+
+    /// @brief Copies every record out of the brain, sorted by key.
+    std::vector<brainRecord> getRecords() const;
+};
+
+/// @brief The result of looking up one state with BrainTable::lookupBatch().
+struct brainLookup
+{
+    /// @brief Whether the state was in the table. The other members are only set if it was.
+    bool found;
+
+    evaluationValue evaluation;
+
+    /// @brief The best move in the state as it was given, not in its canonical variant.
+    move bestMove;
+};
+
+/// @brief A read only table of solved states kept in memory, for serving best moves as fast as possible. It takes a load to build, unlike Brain, but answers each lookup with one cache friendly search.
+/// The keys are stored in Eytzinger order: the root of a binary search tree first, then its two children, then their four children and so on. A search walks down this array without branching on its comparisons, and the four grandchildren of a key share one cache line, so the next lines a search needs can be prefetched while it is still comparing.
+class BrainTable
+{
+public:
+    /// @brief Number of keys in one cache line.
+    static const int LineSize = 4;
+
+    /// @brief Number of searches lookupBatch() runs side by side, so that their memory loads overlap.
+    static const int BatchSize = 16;
+
+private:
+    struct alignas(64) keyLine
+    {
+        packedPosition keys[LineSize];
+    };
+
+    /// @brief The keys in Eytzinger order, starting at position 1. Position 0 is unused, so the children of position k are 2k and 2k + 1, and its grandchildren fill line k.
+    std::vector<keyLine> lines_;
+
+    /// @brief The evaluation and best move of each key in the same order, packed as brainRecord::evaluation | brainRecord::bestMove << 16.
+    std::vector<uint32_t> values_;
+
+    /// @brief The number of keys.
+    size_t size_;
+
+    /// @brief The most steps a search takes, one more than the depth of the deepest key.
+    int levels_;
+
+    void init(const std::vector<brainRecord>& records);
+
+    /// @brief Puts the sorted records into Eytzinger order, starting at the given position.
+    void place(const std::vector<brainRecord>& records, size_t position, size_t& next);
+
+    const packedPosition& keyAt(size_t position) const;
+    void prefetchChildren(size_t position) const;
+
+    /// @brief Turns the position a search ended on into the position of its key, or 0 if the key is not in the table.
+    size_t finishSearch(size_t position, const packedPosition& key) const;
+
+    /// @brief Fills in the results of a lookup from the value at the given position.
+    void readValue(size_t position, int symmetry, evaluationValue& evaluation, move& bestMove) const;
+
+public:
+    /// @brief Creates a table from records sorted by key, as written to a brain file. Throws std::invalid_argument if the records are not sorted.
+    BrainTable(const std::vector<brainRecord>& records);
+
+    /// @brief Creates a table holding every state in a brain file.
+    BrainTable(const Brain& brain);
+
+    /// @brief Looks up a state. The state does not need to be canonical, the best move is given for the state as it is.
+    /// @param state The state to look up.
+    /// @param evaluation Filled in with the evaluation of the state if it is found.
+    /// @param bestMove Filled in with the best move in the state if it is found.
+    /// @return true if the state was found.
+    bool lookup(const Ultimate3TState& state, evaluationValue& evaluation, move& bestMove) const;
+
+    /// @brief Looks up many states at once. This is faster than calling lookup() on each, since up to BatchSize searches wait on memory at the same time.
+    /// @param states The states to look up.
+    /// @param results Filled with one result for each state, in the same order.
+    void lookupBatch(const std::vector<Ultimate3TState>& states, std::vector<brainLookup>& results) const;
+
+    /// @brief Gets the best move in a state. Throws std::out_of_range if the state is not in the table.
+    move bestMove(const Ultimate3TState& state) const;
+
+    /// @brief Gets the number of states in the table.
+    size_t size() const;
+};
@@ -0,0 +1,115 @@
+/* CompressedBrain.h
+Ultimate Tic Tac Toe AI project
+Andrew Bergman
+12/10/23
+
+This file defines a compressed brain file, for shipping a brain where its size matters more than the speed of each lookup.
+
+A compressed brain file is:
+    a compressedBrainHeader
+    one blockSample for each block
+    the blocks, each holding up to blockSize records sorted by key
+
+A block starts with the value of each of its records, packed into ValueBits bits each, followed by the gap from each key to the next as a varint. The first key of a block is in its sample, so a lookup only decodes the one block its key could be in.
+
+Including:
+    compressedBrainHeader struct
+    blockSample struct
+    CompressedBrain class
+*/
+#pragma once
+#include "Brain.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+/// @brief The start of a compressed brain file. Offsets are in bytes from the start of the file. Numbers are stored in the machine's byte order.
+struct compressedBrainHeader
+{
+    /// @brief Always CompressedBrainMagic.
+    char magic[8];
+
+    /// @brief The version of the format. A reader refuses versions it does not know.
+    uint32_t version;
+
+    /// @brief The number of records in every block but the last.
+    uint32_t blockSize;
+
+    uint64_t recordCount;
+    uint64_t blockCount;
+    uint64_t samplesOffset;
+    uint64_t blocksOffset;
+
+    /// @brief The size of all the blocks together.
+    uint64_t blocksBytes;
+
+    uint64_t reserved;
+};
+
+/// @brief Where one block starts, and the key of its first record.
+struct blockSample
+{
+    packedPosition firstKey;
+
+    /// @brief Where the block starts, in bytes from the start of the first block.
+    uint64_t offset;
+};
+
+/// @brief Reads a compressed brain file, mapping it into memory like Brain does. Only the results of each state are kept, not how deep its win is, so the evaluations it gives all have a depth of 0.
+class CompressedBrain
+{
+public:
+    /// @brief The first 8 bytes of every compressed brain file.
+    static const char CompressedBrainMagic[8];
+
+    /// @brief The version written by write(). Version 1 keyed each state by its variant with the lowest hash, which changed with the Zobrist keys, so it is no longer read.
+    static const uint32_t CompressedBrainVersion = 2;
+
+    /// @brief The number of records in each block written by write(), unless another is given.
+    static const uint32_t DefaultBlockSize = 64;
+
+    /// @brief The bits of one value: 2 for the player to win and 7 for the best move as board * 9 + space.
+    static const int ValueBits = 9;
+
+private:
+    MappedFile file_;
+
+    const compressedBrainHeader* header_;
+    const blockSample* samples_;
+    const unsigned char* blocks_;
+
+    void init();
+
+    /// @brief Checks that the header describes a compressed brain this reader can use. Throws an error if it does not.
+    void validate() const;
+
+    /// @brief Finds the value of a packed canonical position, decoding only the block it could be in.
+    /// @return true if the position is in the brain.
+    bool find(const packedPosition& key, uint16_t& value) const;
+
+public:
+    /// @brief Opens a compressed brain file. Throws std::runtime_error if the file can not be opened or is not a compressed brain this reader can use.
+    /// @param path The path of the file.
+    CompressedBrain(const std::string& path);
+
+    /// @brief Writes a compressed brain file. Throws std::invalid_argument if the records are not sorted by key or the block size is 0.
+    /// @param output The stream to write to. It should be opened in binary mode.
+    /// @param records The records to write, sorted by key with no key repeated.
+    /// @param blockSize The number of records in each block. Larger blocks compress better and take longer to search.
+    static void write(std::ostream& output, const std::vector<brainRecord>& records, uint32_t blockSize = DefaultBlockSize);
+
+    /// @brief Looks up a state. The state does not need to be canonical, the best move is given for the state as it is.
+    /// @param state The state to look up.
+    /// @param evaluation Filled in with the player to win the state, with a depth of 0, if it is found.
+    /// @param bestMove Filled in with the best move in the state if it is found.
+    /// @return true if the state was found.
+    bool lookup(const Ultimate3TState& state, evaluationValue& evaluation, move& bestMove) const;
+
+    /// @brief Gets the best move in a state. Throws std::out_of_range if the state is not in the brain.
+    move bestMove(const Ultimate3TState& state) const;
+
+    /// @brief Gets the number of states in the brain.
+    size_t size() const;
+};
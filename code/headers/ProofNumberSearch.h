@@ -0,0 +1,407 @@
+/* ProofNumberSearch.h
+Ultimate Tic Tac Toe AI project
+Andrew Bergman
+12/14/23
+
+This file defines a depth first proof number search (df-pn) solver, which proves the result of a state without searching its whole tree.
+
+Proof number search answers yes or no questions, here whether x can get at least a given result. Every state has a proof number, the fewest states below it that would have to be solved to prove the answer is yes, and a disproof number for no. States where x moves only need one move to work, so their proof number is the smallest of their children's and their disproof number is the sum. States where o moves are the other way round. The search always expands the state that is cheapest to prove or disprove, following the smallest numbers down from the root. df-pn does this depth first: it stays below a state until its numbers pass thresholds given by its parent, and keeps the numbers of every state it has seen in a table instead of in a tree.
+
+Including:
+    proofNumbers struct
+    ProofNumberTable class
+    ProofNumberSolver class
+*/
+#pragma once
+#include "State.h"
+#include "Brain.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+/// @brief The proof and disproof numbers of a state.
+struct proofNumbers
+{
+    /// @brief The smallest number of states that would have to be solved to prove the state, 0 once it is proven, or Infinite once it is disproven.
+    uint32_t proof;
+
+    /// @brief The same for disproving the state.
+    uint32_t disproof;
+
+    /// @brief The number of a state that can never be proven or disproven, because it already has been the other way.
+    static constexpr uint32_t Infinite = 0xFFFFFFFF;
+
+    /// @brief The largest number that is not Infinite. Sums stop here, so that a state with many children is never taken for solved.
+    static constexpr uint32_t MaxFinite = Infinite - 1;
+
+    bool isProven() const;
+    bool isDisproven() const;
+
+    /// @brief Whether the state is proven or disproven.
+    bool isSolved() const;
+
+    /// @brief The numbers of a state that has not been searched.
+    static proofNumbers unknown();
+
+    static proofNumbers proven();
+    static proofNumbers disproven();
+};
+
+/// @brief A hash table of proof and disproof numbers with a fixed memory size. When it fills past GarbageThreshold, the half of its entries that took the least work to find are thrown away, since they are the cheapest to find again. Solved entries are kept over unsolved entries that took as much work. For one thread only.
+class ProofNumberTable
+{
+public:
+    /// @brief Number of entries a state can be stored in.
+    static const int BucketSize = 4;
+
+    /// @brief Table size used when none is given.
+    static const size_t DefaultMegabytes = 64;
+
+    /// @brief The share of entries, in percent, that can be filled before garbage is collected.
+    static const int GarbageThreshold = 75;
+
+private:
+    struct tableEntry
+    {
+        uint64_t key;
+        uint32_t proof;
+        uint32_t disproof;
+
+        /// @brief The number of states expanded to find the numbers, or 0 for an empty entry.
+        uint32_t work;
+    };
+
+    std::vector<tableEntry> entries_;
+
+    /// @brief The number of buckets, always a power of two so that a hash can be masked into an index.
+    size_t bucketCount_;
+
+    /// @brief The number of entries in use.
+    size_t size_;
+
+    unsigned int collections_;
+
+    /// @brief The group an entry falls in when collecting garbage: the log2 of its work, doubled, plus 1 if it is solved. Entries in lower groups are thrown away first.
+    static int garbageGroup(const tableEntry& entry);
+
+public:
+    /// @brief Creates a table using DefaultMegabytes of memory.
+    ProofNumberTable();
+
+    /// @brief Creates a table using at most the given amount of memory.
+    /// @param megabytes The memory budget of the table. The table is rounded down to a power of two number of buckets.
+    ProofNumberTable(size_t megabytes);
+
+    /// @brief Replaces the table with one of a new size. All entries are lost.
+    void resize(size_t megabytes);
+
+    /// @brief Removes every entry from the table.
+    void clear();
+
+    /// @brief Looks up the numbers of a state.
+    /// @param key The hash of the state.
+    /// @param numbers Filled in with the stored numbers if the state is found.
+    /// @param work Filled in with the work stored with them.
+    /// @return true if the state was found.
+    bool probe(uint64_t key, proofNumbers& numbers, uint32_t& work) const;
+
+    /// @brief Stores the numbers of a state. If the state is already in the table it is overwritten, otherwise it takes an empty entry of its bucket or the entry of least value. Collects garbage first if the table is too full.
+    /// @param key The hash of the state.
+    /// @param numbers The numbers to store.
+    /// @param work The number of states expanded to find them, at least 1.
+    void store(uint64_t key, const proofNumbers& numbers, uint32_t work);
+
+    /// @brief Throws away at least half of the entries, those that took the least work first.
+    void collectGarbage();
+
+    /// @brief Gets the number of entries the table can hold.
+    size_t getCapacity() const;
+
+    /// @brief Gets the number of entries in use.
+    size_t size() const;
+
+    /// @brief Gets the number of times garbage has been collected.
+    unsigned int getCollections() const;
+};
+
+/// @brief Proves the result of a state with depth first proof number search. A result takes two searches: one for whether x wins, and if not one for whether x at least draws. Both share one ProofNumberTable, which keeps the states each has solved for the next solve.
+template <typename StateType>
+class ProofNumberSolver
+{
+private:
+    ProofNumberTable table_;
+
+    unsigned int statesExpanded_;
+
+    /// @brief Mixed into the key of a state in the search for whether x at least draws, so that the two searches keep apart entries in the table.
+    static const uint64_t DrawTargetKey = 0x9E3779B97F4A7C15ull;
+
+    /// @brief The key of a state in the table for the search for a target.
+    static uint64_t tableKey(const StateType& state, player target);
+
+    /// @brief Whether a finished game gets x at least the target.
+    static bool reachesTarget(player result, player target);
+
+    /// @brief Searches a state until its proof number reaches proofThreshold or its disproof number reaches disproofThreshold, and stores its numbers in the table.
+    /// @param state The state to search. It is the same when this returns as when it was called.
+    /// @param target x or draw, the result x must get at least.
+    /// @return The numbers of the state.
+    proofNumbers searchState(StateType& state, uint32_t proofThreshold, uint32_t disproofThreshold, player target);
+
+    /// @brief Searches a state until it is proven or disproven.
+    /// @return true if x gets at least target.
+    bool prove(StateType& state, player target);
+
+    /// @brief Finds a move that keeps the result of a state, which must already be solved.
+    move findBestMove(StateType& state, player result);
+
+    /// @brief Adds the records of a state and the states below it that its proof needs.
+    /// @param lower Whether the proof has to show x gets at least the result, so every move of o must be covered and one move of x.
+    /// @param upper Whether it has to show x gets at most the result, the other way round.
+    /// @param covered The bounds already covered for each state, by canonical hash.
+    void collectProof(StateType& state, bool lower, bool upper, std::unordered_map<uint64_t, uint8_t>& covered, std::vector<brainRecord>& records);
+
+public:
+    /// @brief Creates a solver with a table of the given size.
+    /// @param tableMegabytes The memory budget of the table of proof numbers.
+    ProofNumberSolver(size_t tableMegabytes = ProofNumberTable::DefaultMegabytes);
+
+    /// @brief Proves the result of a state.
+    /// @param state The state to solve. It is left unchanged.
+    /// @return x or o if that player wins with best play, otherwise draw.
+    player solve(StateType& state);
+
+    /// @brief Creates the proof tree of a state's result as brain records, sorted by key and ready for Brain::write(), CompressedBrain::write() or a BrainTable. A win is proven by one move of the winner in each state and every move of the loser, and a draw by the union of a proof that x does not lose and one that o does not lose. Every state in the proof gets a record with its own result and a move that keeps it. Depths are not known to proof number search, so every evaluation has a depth of 0.
+    /// @param state The state to prove. It is left unchanged.
+    std::vector<brainRecord> createProofTree(StateType& state);
+
+    /// @brief Writes the proof tree of a state's result as a binary brain file, see Brain.
+    /// @param output The stream to write to. It should be opened in binary mode.
+    /// @param state The state to prove. It is left unchanged.
+    void writeBrain(std::ostream& output, StateType& state);
+
+    /// @brief Gets the number of states expanded by every search.
+    unsigned int getStatesExpanded() const;
+
+    void resetStatesExpanded();
+
+    const ProofNumberTable& getTable() const;
+};
+
+///// ProofNumberSolver definitions /////
+
+template <typename StateType>
+ProofNumberSolver<StateType>::ProofNumberSolver(size_t tableMegabytes) : table_(tableMegabytes)
+{
+    statesExpanded_ = 0;
+}
+
+template <typename StateType>
+uint64_t ProofNumberSolver<StateType>::tableKey(const StateType& state, player target)
+{
+    // symmetric states have the same result, so they share an entry.
+    return target == player::draw ? state.canonicalHash() ^ DrawTargetKey : state.canonicalHash();
+}
+
+template <typename StateType>
+bool ProofNumberSolver<StateType>::reachesTarget(player result, player target)
+{
+    return result == player::x or (target == player::draw and result == player::draw);
+}
+
+template <typename StateType>
+player ProofNumberSolver<StateType>::solve(StateType& state)
+{
+    if (prove(state, player::x)) { return player::x; }
+    if (prove(state, player::draw)) { return player::draw; }
+    return player::o;
+}
+
+template <typename StateType>
+bool ProofNumberSolver<StateType>::prove(StateType& state, player target)
+{
+    // with infinite thresholds the search only returns once the state is solved.
+    proofNumbers numbers = searchState(state, proofNumbers::Infinite, proofNumbers::Infinite, target);
+    return numbers.isProven();
+}
+
+// Moves are made and taken back on state in place, so state is the same when this returns as when it was called.
+template <typename StateType>
+proofNumbers ProofNumberSolver<StateType>::searchState(StateType& state, uint32_t proofThreshold, uint32_t disproofThreshold, player target)
+{
+    uint64_t key = tableKey(state, target);
+    proofNumbers numbers;
+    uint32_t work = 0;
+    if (table_.probe(key, numbers, work) and (numbers.proof >= proofThreshold or numbers.disproof >= disproofThreshold)) { return numbers; }
+
+    if (state.isTerminalState())
+    {
+        numbers = reachesTarget(state.utility(), target) ? proofNumbers::proven() : proofNumbers::disproven();
+        table_.store(key, numbers, 1);
+        return numbers;
+    }
+
+    moveList actions;
+    state.generateMoves(actions);
+    statesExpanded_++;
+    unsigned int startExpanded = statesExpanded_;
+    bool xToMove = state.getActivePlayer() == player::x;
+
+    // the numbers of the children are read once and then kept up to date from the searches made here, so a child whose entry is pushed out of the table can not make this loop forever.
+    proofNumbers children[moveList::MaxMoves];
+    for (int i = 0; i < actions.size(); i++)
+    {
+        undoRecord undo = state.makeMove(actions[i]);
+        uint32_t childWork;
+        if (state.isTerminalState()) { children[i] = reachesTarget(state.utility(), target) ? proofNumbers::proven() : proofNumbers::disproven(); }
+        else if (!table_.probe(tableKey(state, target), children[i], childWork)) { children[i] = proofNumbers::unknown(); }
+        state.unmakeMove(undo);
+    }
+
+    while (true)
+    {
+        // x needs one child proven and all disproven to fail, and o the other way round. The player to move picks the child that is cheapest for them, and needs the second cheapest to set how long to stay below it.
+        uint64_t sum = 0;
+        uint32_t best = proofNumbers::Infinite;
+        uint32_t secondBest = proofNumbers::Infinite;
+        int bestChild = 0;
+        for (int i = 0; i < actions.size(); i++)
+        {
+            uint32_t picked = xToMove ? children[i].proof : children[i].disproof;
+            uint32_t summed = xToMove ? children[i].disproof : children[i].proof;
+            if (summed == proofNumbers::Infinite or sum == proofNumbers::Infinite) { sum = proofNumbers::Infinite; }
+            else { sum = std::min<uint64_t>(sum + summed, proofNumbers::MaxFinite); }
+            if (picked < best)
+            {
+                secondBest = best;
+                best = picked;
+                bestChild = i;
+            }
+            else if (picked < secondBest) { secondBest = picked; }
+        }
+        if (xToMove) { numbers = proofNumbers{best, uint32_t(sum)}; }
+        else { numbers = proofNumbers{uint32_t(sum), best}; }
+        if (numbers.proof >= proofThreshold or numbers.disproof >= disproofThreshold) { break; }
+
+        // the best child is searched until it is no longer the best, or until this state passes its own thresholds.
+        uint32_t pickedThreshold = xToMove ? proofThreshold : disproofThreshold;
+        uint32_t summedThreshold = xToMove ? disproofThreshold : proofThreshold;
+        uint32_t summedChild = xToMove ? children[bestChild].disproof : children[bestChild].proof;
+        uint32_t childPicked = std::min<uint64_t>(pickedThreshold, uint64_t(secondBest) + 1);
+        uint32_t childSummed = summedThreshold == proofNumbers::Infinite ? proofNumbers::Infinite : uint32_t(std::min<uint64_t>(uint64_t(summedThreshold) - sum + summedChild, proofNumbers::Infinite));
+        undoRecord undo = state.makeMove(actions[bestChild]);
+        if (xToMove) { children[bestChild] = searchState(state, childPicked, childSummed, target); }
+        else { children[bestChild] = searchState(state, childSummed, childPicked, target); }
+        state.unmakeMove(undo);
+    }
+
+    work = uint32_t(std::min<uint64_t>(uint64_t(work) + (statesExpanded_ - startExpanded) + 1, proofNumbers::MaxFinite));
+    table_.store(key, numbers, work);
+    return numbers;
+}
+
+template <typename StateType>
+move ProofNumberSolver<StateType>::findBestMove(StateType& state, player result)
+{
+    moveList actions;
+    state.generateMoves(actions);
+    player toMove = state.getActivePlayer();
+    // a player who loses keeps their loss with any move.
+    if (result != player::draw and result != toMove) { return actions[0]; }
+    // x keeps a result with a move proven to reach it, and o keeps one with a move disproven to reach anything better for x.
+    player target = result;
+    if (toMove == player::o) { target = result == player::draw ? player::x : player::draw; }
+    bool wantProven = toMove == player::x;
+
+    // the table usually knows a child that keeps the result. Only if it has been pushed out is one solved again.
+    for (int i = 0; i < actions.size(); i++)
+    {
+        undoRecord undo = state.makeMove(actions[i]);
+        proofNumbers numbers;
+        uint32_t work;
+        bool keeps = false;
+        if (state.isTerminalState()) { keeps = reachesTarget(state.utility(), target) == wantProven; }
+        else if (table_.probe(tableKey(state, target), numbers, work)) { keeps = wantProven ? numbers.isProven() : numbers.isDisproven(); }
+        state.unmakeMove(undo);
+        if (keeps) { return actions[i]; }
+    }
+    for (int i = 0; i < actions.size(); i++)
+    {
+        undoRecord undo = state.makeMove(actions[i]);
+        bool keeps = prove(state, target) == wantProven;
+        state.unmakeMove(undo);
+        if (keeps) { return actions[i]; }
+    }
+    throw std::logic_error("Found no move that keeps the result of a solved state");
+}
+
+// Moves are made and taken back on state in place, so state is the same when this returns as when it was called.
+template <typename StateType>
+void ProofNumberSolver<StateType>::collectProof(StateType& state, bool lower, bool upper, std::unordered_map<uint64_t, uint8_t>& covered, std::vector<brainRecord>& records)
+{
+    player result = solve(state);
+    // no proof is needed that x gets at least a loss, or at most a win.
+    if (result == player::o) { lower = false; }
+    if (result == player::x) { upper = false; }
+    uint8_t needed = uint8_t(lower) | uint8_t(upper) << 1;
+    auto found = covered.find(state.canonicalHash());
+    bool recorded = found != covered.end();
+    if (recorded and (found->second & needed) == needed) { return; }
+    covered[state.canonicalHash()] |= needed;
+
+    int symmetry = state.canonicalSymmetry();
+    if (state.isTerminalState())
+    {
+        if (!recorded) { records.push_back(brainRecord::create(state.toPackedPosition(symmetry), evaluationValue(result, 0), move())); }
+        return;
+    }
+    move bestMove = findBestMove(state, result);
+    if (!recorded) { records.push_back(brainRecord::create(state.toPackedPosition(symmetry), evaluationValue(result, 0), StateType::transformMove(bestMove, symmetry))); }
+
+    // the player to move only needs their best move covered for the bound that favours them, and the other player's bound needs every move covered.
+    bool xToMove = state.getActivePlayer() == player::x;
+    bool bestMoveBound = xToMove ? lower : upper;
+    bool everyMoveBound = xToMove ? upper : lower;
+    moveList actions;
+    state.generateMoves(actions);
+    for (int i = 0; i < actions.size(); i++)
+    {
+        bool isBest = actions[i].toBinary() == bestMove.toBinary();
+        bool childBestMoveBound = bestMoveBound and isBest;
+        if (!childBestMoveBound and !everyMoveBound) { continue; }
+        bool childLower = xToMove ? childBestMoveBound : everyMoveBound;
+        bool childUpper = xToMove ? everyMoveBound : childBestMoveBound;
+        undoRecord undo = state.makeMove(actions[i]);
+        collectProof(state, childLower, childUpper, covered, records);
+        state.unmakeMove(undo);
+    }
+}
+
+template <typename StateType>
+std::vector<brainRecord> ProofNumberSolver<StateType>::createProofTree(StateType& state)
+{
+    std::unordered_map<uint64_t, uint8_t> covered;
+    std::vector<brainRecord> records;
+    collectProof(state, true, true, covered, records);
+    std::sort(records.begin(), records.end(), [](const brainRecord& a, const brainRecord& b) { return a.key < b.key; });
+    return records;
+}
+
+template <typename StateType>
+void ProofNumberSolver<StateType>::writeBrain(std::ostream& output, StateType& state)
+{
+    Brain::write(output, createProofTree(state));
+}
+
+template <typename StateType>
+unsigned int ProofNumberSolver<StateType>::getStatesExpanded() const { return statesExpanded_; }
+
+template <typename StateType>
+void ProofNumberSolver<StateType>::resetStatesExpanded() { statesExpanded_ = 0; }
+
+template <typename StateType>
+const ProofNumberTable& ProofNumberSolver<StateType>::getTable() const { return table_; }
@@ -0,0 +1,101 @@
+/* SolvedStateStore.h
+Ultimate Tic Tac Toe AI project
+Andrew Bergman
+12/15/23
+
+This file defines the list of states AgentTrainer has solved, which is what it writes to its output. A full solve finds far more states than fit in memory, so the list keeps a fixed size buffer in memory and writes it to a temporary file as a sorted run whenever it fills. The runs are merged back together, in order, when the list is read.
+
+Including:
+    trainerEntry struct
+    SolvedStateStore class
+*/
+#pragma once
+#include "State.h"
+#include <stddef.h>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+/// @brief A state that AgentTrainer has solved, along with the results of the search. The evaluation and best move are only stored here, never in the position, so a state's annotations cannot change which entry it finds.
+struct trainerEntry
+{
+    /// @brief The packed canonical variant of the solved state, as given by Ultimate3TState::canonicalSymmetry(). Only built once, when the state is solved, so that it can be written to output.
+    packedPosition position;
+
+    /// @brief The evaluation of the state. This is needed because the depth is not encoded at all.
+    evaluationValue evaluation;
+
+    /// @brief The best move in the canonical variant of the state.
+    move bestMove;
+};
+
+/// @brief The states solved by a search, held in a fixed amount of memory. A state that is solved more than once, because it was pushed out of the transposition table or solved again with a depth, is kept as it was solved last.
+class SolvedStateStore
+{
+public:
+    /// @brief The memory budget of the buffer when no other is given.
+    static constexpr size_t DefaultMegabytes = 64;
+
+    /// @brief The fewest entries the buffer holds, whatever its budget.
+    static constexpr size_t MinimumBufferEntries = 1024;
+
+    /// @brief The most runs kept on disk. When there are more, they are merged into one, so that reading them back never needs more than this many read buffers.
+    static constexpr size_t MaxRuns = 32;
+
+    /// @brief The number of entries read from a run at a time.
+    static constexpr size_t ReadEntries = 4096;
+
+private:
+    /// @brief The states solved since the last run was written, in the order they were solved.
+    std::vector<trainerEntry> buffer_;
+
+    /// @brief The number of entries the buffer holds before it is written as a run.
+    size_t bufferCapacity_;
+
+    /// @brief Temporary files holding runs sorted by position with no position repeated, from the oldest to the newest.
+    std::vector<std::FILE*> runs_;
+
+    /// @brief Sorts the buffer by position, keeping only the last entry of each position.
+    void sortBuffer();
+
+    /// @brief Writes the buffer to a new run and empties it.
+    void writeRun();
+
+    /// @brief Merges every run into one.
+    void mergeRuns();
+
+    /// @brief Merges runs, and the buffer if it is asked for, calling visit on the newest entry of each position in order.
+    void merge(bool includeBuffer, const std::function<void(const trainerEntry&)>& visit);
+
+    void closeRuns();
+
+public:
+    /// @brief Creates a store whose buffer fits in the given number of megabytes.
+    SolvedStateStore(size_t megabytes = DefaultMegabytes);
+
+    ~SolvedStateStore();
+
+    SolvedStateStore(const SolvedStateStore&) = delete;
+    SolvedStateStore& operator=(const SolvedStateStore&) = delete;
+
+    /// @brief Sets the number of entries the buffer holds before it is written as a run. Does not remove any entries.
+    void setBufferCapacity(size_t entries);
+
+    /// @brief Sets the memory budget of the buffer. Does not remove any entries.
+    void resize(size_t megabytes);
+
+    /// @brief Adds a solved state. Throws std::runtime_error if a run can not be written.
+    void add(const trainerEntry& entry);
+
+    /// @brief Calls visit on every solved state, sorted by position with no position repeated. Throws std::runtime_error if a run can not be read.
+    void forEach(const std::function<void(const trainerEntry&)>& visit);
+
+    /// @brief Removes every entry.
+    void clear();
+
+    /// @brief Gets the number of entries the buffer holds before it is written as a run.
+    size_t getBufferCapacity() const;
+
+    /// @brief Gets the number of runs on disk.
+    size_t getRunCount() const;
+};
@@ -10,10 +10,13 @@ Including:
     player enum
     move struct
     evaluationValue struct
+    bitBoard struct
+    undoRecord struct
     Ultimate3TState class
 */
 #pragma once
 #include <stdint.h>
+#include <array>
 #include <vector>
 #include <stdexcept>
 #include <bitset>
@@ -64,8 +67,8 @@ public:
     activeBoard board;
     uint8_t space;
 
-    /// @brief default constructor
-    move();
+    /// @brief default constructor. Defined here so that filling a moveList does not call into another translation unit for every slot.
+    move() : board(activeBoard::board0), space(0) {}
 
     /// @brief Argumented constructor
     /// @param moveBoard The board of this move, Note this cannot be activeBoard::anyBoard which will throw an error if passed.
@@ -82,28 +85,180 @@ public:
 };
 
 /// @brief In order to ensure more intelligent behavior, our evaluation must include more information than just the game's value. The depth is also stored and attached to the value of the game. A greater depth is always worse than a lesser depth.
+/// The value is stored as one small integer whose high bits order values the same way the values are ordered, so every comparison is a single integer comparison with no branches.
 struct evaluationValue
 {
 private:
-    void init(player toWin, int depthToWin);
+    /// @brief The number of low bits of code_ holding the depth.
+    static const int DepthBits = 7;
+    static const int DepthMask = (1 << DepthBits) - 1;
+
+    /// @brief The depth stored for an indeterminate value, which keeps no depth of its own. It is deeper than any game, so it can not be mistaken for a draw.
+    static const int NeitherDepth = DepthMask;
+
+    /// @brief The score of a win at depth 0.
+    static const int WinScore = 100;
+
+    /// @brief The greatest depth a value can have, one move for every space.
+    static const int MaxDepth = 81;
+
+    /// @brief The score of the value shifted above its depth. x winning at depth d scores WinScore - d, o winning at depth d scores -WinScore + d, and a draw scores 0 at any depth, so draws of different depths are worth the same but still compare unequal.
+    int16_t code_;
+
+    static constexpr int scoreOf(player toWin, int depthToWin)
+    {
+        return toWin == player::x ? WinScore - depthToWin : (toWin == player::o ? -WinScore + depthToWin : 0);
+    }
+
+    static constexpr int16_t encode(player toWin, int depthToWin)
+    {
+        return toWin == player::neither ? int16_t(NeitherDepth) : int16_t(scoreOf(toWin, depthToWin) * (1 << DepthBits) + (depthToWin & DepthMask));
+    }
+
+    /// @brief Throws std::invalid_argument if the value can not be compared, because it is indeterminate or its depth is out of range. Only called in debug builds, so that comparisons in the searches stay a single instruction.
+    constexpr void validate() const
+    {
+        if ((code_ & DepthMask) > MaxDepth) { throw std::invalid_argument("Passed an indeterminate evaluationValue, or one with an invalid depth, into a comparison"); }
+    }
+
 public:
+    constexpr evaluationValue() : code_(encode(player::neither, 0)) {}
+    constexpr evaluationValue(player toWin, int depthToWin) : code_(encode(toWin, depthToWin)) {}
+
     /// @brief What the outcome of the game will be, assuming that both players play optimaly
-    player playerToWin;
+    constexpr player getPlayerToWin() const
+    {
+        return score() > 0 ? player::x : (score() < 0 ? player::o : ((code_ & DepthMask) == NeitherDepth ? player::neither : player::draw));
+    }
+
+    /// @brief By giving the evaluationValue a depth, we can ensure Tim player for as long as possible when losing and as short as possible when winning. An indeterminate value has a depth of 0.
+    constexpr int getDepth() const { return (code_ & DepthMask) == NeitherDepth ? 0 : code_ & DepthMask; }
 
-    /// @brief By giving the evaluationValue a depth, we can ensure Tim player for as long as possible when losing and as short as possible when winning.
-    int depth;
+    /// @brief The value of the game on a single scale, higher being better for x. Values are ordered by their scores.
+    constexpr int score() const { return code_ >> DepthBits; }
 
-    evaluationValue();
-    evaluationValue(player toWin, int depthToWin);
+    /// @brief The same outcome one move further away, which is the value of a state whose best move leads to a state with this value.
+    constexpr evaluationValue deeper() const
+    {
+        // a win one move further away scores one less for the winner, and a draw scores the same.
+        return getPlayerToWin() == player::neither ? *this : fromCode(int16_t(code_ + 1 + (score() < 0 ? (1 << DepthBits) : 0) - (score() > 0 ? (1 << DepthBits) : 0)));
+    }
+
+    /// @brief Gets the 16 bits the value is stored in, for packing it into a table entry.
+    constexpr uint16_t pack() const { return uint16_t(code_); }
+
+    /// @brief Unpacks a value packed with pack().
+    static constexpr evaluationValue unpack(uint16_t packed) { return fromCode(int16_t(packed)); }
 
     ///// Comparison methods /////
-    // Used in the minimax algorithm to compare moves.
-    bool operator==(const evaluationValue& other) const;
-    bool operator!=(const evaluationValue& other) const;
-    bool operator>(const evaluationValue& other) const;
-    bool operator>=(const evaluationValue& other) const;
-    bool operator<(const evaluationValue& other) const;
-    bool operator<=(const evaluationValue& other) const;
+    // Used in the minimax algorithm to compare moves. == and != compare the depth of draws, while the ordering ones only compare scores, so two draws of different depths are neither greater nor less than each other.
+    constexpr bool operator==(const evaluationValue& other) const { return code_ == other.code_; }
+    constexpr bool operator!=(const evaluationValue& other) const { return code_ != other.code_; }
+    constexpr bool operator>(const evaluationValue& other) const { checkComparable(other); return score() > other.score(); }
+    constexpr bool operator>=(const evaluationValue& other) const { checkComparable(other); return score() >= other.score(); }
+    constexpr bool operator<(const evaluationValue& other) const { checkComparable(other); return score() < other.score(); }
+    constexpr bool operator<=(const evaluationValue& other) const { checkComparable(other); return score() <= other.score(); }
+
+private:
+    static constexpr evaluationValue fromCode(int16_t code)
+    {
+        evaluationValue value;
+        value.code_ = code;
+        return value;
+    }
+
+    constexpr void checkComparable(const evaluationValue& other) const
+    {
+#ifndef NDEBUG
+        validate();
+        other.validate();
+#else
+        (void)other;
+#endif
+    }
+};
+
+/// @brief A 3x3 tic tac toe grid stored as bitmasks, where bit i of each mask is space i of the grid. Used for both the sub-boards and the super board.
+struct bitBoard
+{
+    /// @brief Spaces that player x has played in.
+    uint16_t x;
+
+    /// @brief Spaces that player o has played in.
+    uint16_t o;
+
+    /// @brief Spaces that are marked as a draw. In the super board these are the sub-boards that ended in a draw.
+    uint16_t draw;
+
+    /// @brief Creates an empty grid.
+    bitBoard();
+
+    /// @brief Gets who has played in a space.
+    /// @param space The space to check, between 0 and 8 inclusive.
+    /// @return The player in the space, draw, or neither if the space is empty.
+    player get(int space) const;
+
+    /// @brief Sets who has played in a space, replacing whatever was there before.
+    /// @param space The space to set, between 0 and 8 inclusive.
+    /// @param who The player to put in the space. neither clears the space.
+    void set(int space, player who);
+
+    /// @brief Gets a mask of all spaces that are not empty.
+    uint16_t filled() const;
+};
+
+/// @brief Everything needed to take back a move made with Ultimate3TState::makeMove.
+struct undoRecord
+{
+    /// @brief The move that was made.
+    move playedMove;
+
+    /// @brief The active board before the move was made.
+    activeBoard previousActiveBoard;
+
+    /// @brief The result of the played on sub-board before the move was made.
+    player previousBoardResult;
+};
+
+/// @brief A list of moves with room for every move that can be legal in a state, so generating moves needs no heap allocation.
+struct moveList
+{
+    /// @brief The most moves a state can have, one for every space of every board.
+    static const int MaxMoves = 81;
+
+    move moves[MaxMoves];
+
+    /// @brief The number of moves in the list.
+    int count;
+
+    moveList() : count(0) {}
+
+    /// @brief Appends a move without range checking it. The board and space must be between 0 and 8 inclusive, and the list must not be full.
+    void add(activeBoard board, uint8_t space)
+    {
+        moves[count].board = board;
+        moves[count].space = space;
+        count++;
+    }
+
+    int size() const { return count; }
+    move* begin() { return moves; }
+    move* end() { return moves + count; }
+    const move* begin() const { return moves; }
+    const move* end() const { return moves + count; }
+    move& operator[](int index) { return moves[index]; }
+    const move& operator[](int index) const { return moves[index]; }
+};
+
+/// @brief A position packed into two 64 bit words. Each board is numbered by its contents, and the numbers are packed together in a mixed radix, so a whole position fits in 128 bits. The evaluation and best move are not part of it.
+struct packedPosition
+{
+    uint64_t low;
+    uint64_t high;
+
+    bool operator==(const packedPosition& other) const { return low == other.low and high == other.high; }
+    bool operator!=(const packedPosition& other) const { return !(*this == other); }
+    bool operator<(const packedPosition& other) const { return high != other.high ? high < other.high : low < other.low; }
 };
 
 // A number used to define the size needed to encode an Ultimate3TState into Binary.
@@ -117,17 +272,29 @@ private:
     /// @brief The number of Spaces in a normal Tic Tac Toe grid. This is used throughout to check bounds and to prevent magic numbers.
     static const int TicTacToeNumberOfSpaces = 9;
 
+public:
+    /// @brief The number of rotations and reflections of a square, including leaving it as it is. Symmetry 0 is the identity.
+    static const int SymmetryCount = 8;
+
+    /// @brief The largest heuristicScore() can be for either player.
+    static const int MaxHeuristicScore = 500;
+
+private:
+
     /// @brief The evaluation of this position. -1 is a win for player O, 1 is a win for player X, and 0 is a draw.
     evaluationValue evaluation_;
 
     /// @brief The evaluated best move in this state.
     move bestMove_;
 
-    /// @brief The board associated with this state. Keeps track of which player has played in a space.
-    std::vector<std::vector<player>> board_;
+    /// @brief A mask with all nine spaces of a grid set.
+    static const uint16_t FullBoardMask = 0b111111111;
+
+    /// @brief The board associated with this state. Keeps track of which player has played in a space of each sub-board.
+    std::array<bitBoard, TicTacToeNumberOfSpaces> board_;
 
-    /// @brief Stores the ongoing state of who has won subgames. 
-    std::vector<player> superBoardResults_;
+    /// @brief Stores the ongoing state of who has won subgames. Space i of the super board holds the result of sub-board i.
+    bitBoard superBoard_;
 
     /// @brief The active board which can be played on this turn.
     /// @note -1 means that any board may be played on, and may be a result of the game just starting.
@@ -136,33 +303,92 @@ private:
     /// @brief Who the active player is, true is player X and false is player O.
     player activePlayer_;
 
+    /// @brief Zobrist hashes of the board, superBoard, active board and active player. hashes_[s] is the hash of this state transformed by symmetry s, so hashes_[0] is the hash of the state itself. Kept up to date as the state changes so they never need to be rebuilt.
+    std::array<uint64_t, SymmetryCount> hashes_;
+
+    /// @brief The heuristic score of each sub-board that is still being played, and 0 for decided boards. Kept up to date as the state changes, see heuristicScore().
+    std::array<int16_t, TicTacToeNumberOfSpaces> boardScores_;
+
+    /// @brief The heuristic score of the super board.
+    int16_t superBoardScore_;
+
+    /// @brief The sum of boardScores_ and superBoardScore_, which is the part of heuristicScore() that does not depend on whose turn it is.
+    int positionalScore_;
+
     /// @brief initializes variables so they can be filled in with the correct values.
+    /// @note Every space of every board is cleared.
     void init
     (
         evaluationValue eval, 
-        std::vector<std::vector<player>> board,
-        std::vector<player> superBoardResults,
         move bestMove, 
         activeBoard aBoard, 
         player activePlayer
     );
 
     /// @brief Gets the result of the board.
-    /// @param board The board number to check.
+    /// @param board The board to check.
     /// @return The winner of the board, draw if it is a draw, or neither if the game is still ongoing. 
-    player boardResults(std::vector<player> board) const;
+    player boardResults(const bitBoard& board) const;
+
+    /// @brief Sets a space of a sub-board and updates the hashes to match.
+    void setSpace(int boardNumber, int spaceNumber, player whoPlayed);
+
+    /// @brief Sets the result of a sub-board on the superBoard and updates the hashes to match.
+    void setBoardResult(int boardNumber, player result);
+
+    /// @brief Gets what a space is hashed and packed as. Once a board is decided the x's and o's in it can no longer change the game, only which spaces are empty can, so every filled space of a decided board is folded into the same draw marker.
+    /// @param boardNumber The board the space is on.
+    /// @param who Who has played in the space.
+    player foldedSpace(int boardNumber, player who) const;
+
+    /// @brief Swaps the keys of a space in every symmetric hash. XORing the same change again takes it back.
+    void updateSpaceHashes(int boardNumber, int spaceNumber, player before, player after);
+
+    /// @brief Swaps the keys of a sub-board result in every symmetric hash.
+    void updateBoardResultHashes(int boardNumber, player before, player after);
+
+    /// @brief Swaps the keys of the active board in every symmetric hash.
+    void updateActiveBoardHashes(activeBoard before, activeBoard after);
+
+    /// @brief Swaps the keys of the active player in every symmetric hash.
+    void updateActivePlayerHashes(player before, player after);
+
+    /// @brief Builds the Zobrist hashes of this state and all of its symmetric variants from scratch.
+    std::array<uint64_t, SymmetryCount> computeHashes() const;
+
+    /// @brief Rescores a sub-board after it changes, and updates positionalScore_ to match.
+    void updateBoardScore(int boardNumber);
+
+    /// @brief Rescores the super board after a sub-board is decided or undecided, and updates positionalScore_ to match.
+    void updateSuperBoardScore();
+
+    /// @brief Builds the heuristic scores of every board from scratch.
+    void computeScores();
 
     /// @brief Used for encoding a number into a binary string. The number will be appended to the beggining of the bitset
     /// @param number The number to be encoded
     /// @param size the number will take in the binary string
     /// @param binary The binary string, the number will be appended to the end.
-    void numberBinaryInsertion(int number, int size, std::bitset<ENCODINGSIZE>& binary) const;
+    template <size_t BinarySize>
+    void numberBinaryInsertion(int number, int size, std::bitset<BinarySize>& binary) const;
 
     /// @brief Used to extract numbers from a bitset. Will remove read bits from the bitset.
     /// @param size Number of bits to read from.
     /// @param binary The bitset to extract from.
     /// @return The number extracted.
-    int numberBinaryExtraction(int size, std::bitset<ENCODINGSIZE>& binary) const;
+    template <size_t BinarySize>
+    int numberBinaryExtraction(int size, std::bitset<BinarySize>& binary) const;
+
+    /// @brief Fills in the packing code of each board, untransformed. Throws an error if an undecided board holds a space marked as a draw.
+    void packBoards(uint32_t codes[TicTacToeNumberOfSpaces]) const;
+
+    /// @brief Appends the position, which is the board, superBoard, active board and active player, to a binary string.
+    template <size_t BinarySize>
+    void positionBinaryInsertion(std::bitset<BinarySize>& binary) const;
+
+    /// @brief Reads the position written by positionBinaryInsertion from a binary string, removing the read bits.
+    template <size_t BinarySize>
+    void positionBinaryExtraction(std::bitset<BinarySize>& binary);
 
 public:
 
@@ -174,15 +400,22 @@ public:
     Ultimate3TState();
 
     /// @brief Destructor.
-    ~Ultimate3TState();
+    ~Ultimate3TState() = default;
 
-    /// @brief Creates a state from a given hex value.
+    /// @brief Creates a state from the legacy 196 bit encoding made by toBinary.
     /// @param binaryEncoding A binary encoding of the State which is transformed into a State object. 
-    // warning, not yet implemented.
-    Ultimate3TState(std::bitset<ENCODINGSIZE>);
+    explicit Ultimate3TState(std::bitset<ENCODINGSIZE>);
 
-    /// @brief Copy constructor.
-    Ultimate3TState(Ultimate3TState& source);
+    /// @brief Creates a state from a packed position, as made by toPackedPosition. The evaluation and best move are left at their defaults. Throws an error if the words are not a packed position.
+    /// @param position The position to transform into a State object.
+    /// @note The filled spaces of decided boards come back as draws, see toPackedPosition.
+    explicit Ultimate3TState(packedPosition position);
+
+    /// @brief Copy constructor. The state holds no heap memory, so this is a flat copy.
+    Ultimate3TState(const Ultimate3TState& source) = default;
+
+    /// @brief Copy assignment.
+    Ultimate3TState& operator=(const Ultimate3TState& source) = default;
 
     ///// Get and set /////
 
@@ -201,7 +434,37 @@ public:
     player getActivePlayer() const;
     void setActivePlayer(player newActivePlayer);
 
+    /// @brief Gets the Zobrist hash of this state, which is suitable for keying a transposition table.
+    /// @note The evaluation and best move are not part of the hash.
+    uint64_t hash() const;
+
+    ///// Symmetry /////
+    // Rotating or reflecting the super board and every sub-board the same way, along with the active board, gives a position that plays exactly the same.
+
+    /// @brief Gets a hash that is the same for all 8 rotations and reflections of this state: the lowest of their hashes. It depends on the Zobrist keys, so it only keys tables kept in memory, never anything written to disk.
+    uint64_t canonicalHash() const;
+
+    /// @brief Gets the symmetry that transforms this state into the canonical variant shared by all of its rotations and reflections, the one with the lowest packed position. This is what brain files are keyed by, so it only depends on the packing. Throws an error if the state can not be packed, see toPackedPosition().
+    int canonicalSymmetry() const;
+
+    /// @brief Creates a copy of this state rotated or reflected by a symmetry. The best move is transformed with it and the evaluation is kept.
+    /// @param symmetry The symmetry to apply, between 0 and SymmetryCount - 1. Throws an error if outside this range.
+    Ultimate3TState transformed(int symmetry) const;
+
+    /// @brief Transforms a move in this state into the same move in the state transformed by symmetry.
+    /// @param symmetry The symmetry to apply, between 0 and SymmetryCount - 1. Throws an error if outside this range.
+    static move transformMove(move original, int symmetry);
+
+    /// @brief Gets the symmetry that undoes the given one, so a move found in a canonical state can be transformed back.
+    static int inverseSymmetry(int symmetry);
+
     player getSpacePlayed(int boardNumber, int spaceNumber) const;
+
+    /// @brief Gets the result of a sub-board as recorded on the superBoard. Throws an error if the board is outside of the possible board values.
+    /// @param boardNumber The board to check.
+    /// @return The winner of the board, draw if it is a draw, or neither if the board is still being played.
+    player getBoardResult(int boardNumber) const;
+
     /// @brief Sets a space state, as if a player played their during their turn. Throws an error if the indecies are outside of the possible board values.
     /// @param boardNumber The board to play on.
     /// @param spaceNumber The space to play on.
@@ -214,11 +477,28 @@ public:
     /// @return A vector of legal moves
     std::vector<move> generateMoves();
 
+    /// @brief Fills a list with the legal moves in this state, in the same order as generateMoves(). This does no heap allocation, so it is what the searches use.
+    /// @param legalMoves The list to fill. Any moves already in it are removed.
+    void generateMoves(moveList& legalMoves);
+
+    /// @brief Counts the legal moves in this state without generating them.
+    /// @return The number of legal moves.
+    int countMoves();
+
     /// @brief Generates a state where the given move was played in this state.
     /// @param playedMove the move to be played. Throws an error if playedMove is not legal
     /// @return A State where the game has progressed after the given move was played.
     Ultimate3TState generateSuccessorState(move playedMove);
 
+    /// @brief Plays a move on this state in place, so that a search does not need to copy the state for every child.
+    /// @param playedMove The move to be played. Throws an error if playedMove is not legal.
+    /// @return A record that unmakeMove uses to restore this state.
+    undoRecord makeMove(move playedMove);
+
+    /// @brief Takes back a move made with makeMove. Moves must be taken back in the reverse order they were made.
+    /// @param record The record returned by makeMove.
+    void unmakeMove(const undoRecord& record);
+
     /// @brief Checks if this state is a terminal state. This can be because a player won, or there are no remaining legal moves.
     /// @return true if the state is terminal, false otherwise.
     bool isTerminalState();
@@ -228,11 +508,30 @@ public:
     /// @return The result of the game. Can be x, o, a draw, or niether. If neither, the game is still being played.
     player utility();
 
-    /// @brief Transforms this state into a binary string. 
+    /// @brief Transforms this state into the legacy 196 bit binary string, which spells out every space. 
     /// @return A binary version of this State.
-    // Warning, not yet implemented.
     /// @warning The depth value of the evaluation_ is not saved and so this function is lossy.
     std::bitset<ENCODINGSIZE> toBinary() const;
 
+    /// @brief Packs the position of this state into two words. Two states in the same position always pack the same, whatever their evaluation and best move. Like the hash, the filled spaces of decided boards are all packed as draws, so positions that only differ inside decided boards share a packing.
+    /// Throws an error if an undecided board holds a space marked as a draw, since those can not come up in a game and have no packing.
+    /// @param symmetry If given, pack the state as transformed(symmetry) would, without building the transformed state.
+    /// @return The packed position.
+    packedPosition toPackedPosition(int symmetry = 0) const;
+
     bool isMaxNode();
+
+    /// @brief Whether playing a move would win its sub-board for a player. Used to order moves, so it does no range checking.
+    /// @param playedMove A legal move in this state.
+    /// @param who The player to check for, x or o. Checking for the player not to move tells whether the move blocks them.
+    bool winsBoard(move playedMove, player who) const;
+
+    /// @brief Whether playing a move would let the next player choose any board, because it sends them to a full board. Used to order moves, so it does no range checking.
+    /// @param playedMove A legal move in this state.
+    bool givesFreeChoice(move playedMove) const;
+
+    /// @brief Gets a static estimate of how good this state is, for searches that stop before the end of the game. Positive scores favour player x and negative scores favour player o, and the score is always within MaxHeuristicScore of 0.
+    /// It counts won sub-boards, two in a rows that are still open on the sub-boards and on the super board, the centers and corners each player holds, and how good the board the player to move was sent to is for them. All but the last are kept up to date as moves are made and taken back, so this costs a handful of operations.
+    /// @note The score of a terminal state is not meaningful. Check isTerminalState() first.
+    int heuristicScore() const;
 };
\ No newline at end of file
@@ -0,0 +1,207 @@
+/* TranspositionTable.h
+Ultimate Tic Tac Toe AI project
+Andrew Bergman
+12/2/23
+
+This file defines a fixed size hash table that the search agents use to remember states they have already searched.
+
+Including:
+    boundType enum
+    transpositionData struct
+    transpositionEntry struct
+    TranspositionTable class
+    WinDrawLossTable class
+*/
+#pragma once
+#include "State.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/// @brief How a stored evaluation relates to the true evaluation of a state. An alpha beta search that prunes only learns a bound on the evaluation.
+enum boundType : uint8_t
+{
+    exactBound = 0, // The evaluation is the true evaluation.
+    lowerBound = 1, // The true evaluation is at least the stored evaluation.
+    upperBound = 2  // The true evaluation is at most the stored evaluation.
+};
+
+/// @brief The results stored for a searched state.
+struct transpositionData
+{
+    /// @brief The evaluation of the state.
+    evaluationValue evaluation;
+
+    /// @brief The best move found in the state.
+    move bestMove;
+
+    /// @brief How much work went into the entry. Entries with a greater depth are kept over entries with a lesser depth when the table is full.
+    uint8_t depth;
+
+    /// @brief Whether the evaluation is exact or only a bound.
+    boundType bound;
+
+    /// @brief The score of the state, for searches that score states they could not solve as well as ones they could. AgentTrainer only solves states, so it leaves this at 0.
+    int16_t score;
+
+    /// @brief Packs this data into the 64 bits stored in a table entry.
+    uint64_t pack() const;
+
+    /// @brief Unpacks data that was packed with pack().
+    static transpositionData unpack(uint64_t packed);
+};
+
+/// @brief One slot of the table. Threads read and write the two words of a slot without locking, so a slot can be caught half written by a racing store. The key word therefore holds the hash XORed with the data: a probe XORs the two words it read back together, and only finds the state if that gives its hash, which a torn slot almost never does.
+struct transpositionEntry
+{
+    /// @brief The hash of the state XORed with data.
+    std::atomic<uint64_t> check;
+
+    std::atomic<uint64_t> data;
+};
+
+/// @brief An open addressed hash table of a fixed memory size, which any number of threads can probe and store into at once without locks. Racing stores can overwrite each other, which only loses work, never gives a wrong result. Entries are grouped into buckets the size of a cache line, and a state can be stored in any entry of the bucket its hash maps to. When a bucket is full the least valuable entry is replaced, so the table never grows past the memory it was given.
+class TranspositionTable
+{
+public:
+    /// @brief Number of entries in each bucket. 4 entries of 16 bytes fill one 64 byte cache line.
+    static const int BucketSize = 4;
+
+    /// @brief Table size used when none is given.
+    static const size_t DefaultMegabytes = 64;
+
+private:
+    struct alignas(64) bucket
+    {
+        transpositionEntry entries[BucketSize];
+    };
+
+    bucket* buckets_;
+
+    /// @brief The number of buckets, always a power of two so that a hash can be masked into an index.
+    size_t bucketCount_;
+
+    /// @brief Size of the allocation holding the buckets in bytes.
+    size_t allocatedBytes_;
+
+    /// @brief Whether the buckets were allocated with mmap, and so must be freed with munmap.
+    bool mapped_;
+
+    /// @brief Whether to ask the OS to back the table with huge pages.
+    bool useHugePages_;
+
+    /// @brief Incremented for each new search, so that entries left over from old searches are replaced first. Only changed between searches, so it does not need to be atomic.
+    uint8_t generation_;
+
+    void init(size_t megabytes, bool useHugePages);
+    void allocate(size_t megabytes);
+    void release();
+
+    /// @brief The bucket a hash maps to.
+    bucket& bucketFor(uint64_t key) const;
+
+public:
+    /// @brief Creates a table using DefaultMegabytes of memory.
+    TranspositionTable();
+
+    /// @brief Creates a table using at most the given amount of memory.
+    /// @param megabytes The memory budget of the table. The table is rounded down to a power of two number of buckets.
+    /// @param useHugePages If true, ask the OS to back the table with huge pages where that is supported.
+    TranspositionTable(size_t megabytes, bool useHugePages = false);
+
+    ~TranspositionTable();
+
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    /// @brief Replaces the table with one of a new size. All entries are lost.
+    /// @param megabytes The new memory budget of the table.
+    /// @param useHugePages If true, ask the OS to back the table with huge pages where that is supported.
+    void resize(size_t megabytes, bool useHugePages = false);
+
+    /// @brief Removes every entry from the table. Must not be called while other threads use the table.
+    void clear();
+
+    /// @brief Marks the start of a new search. Entries from older searches are replaced before entries from this one. Must not be called while other threads use the table.
+    void newSearch();
+
+    /// @brief Looks up a state in the table. Safe to call from several threads at once, and alongside store().
+    /// @param key The hash of the state.
+    /// @param data Filled in with the stored data if the state is found.
+    /// @return true if the state was found.
+    bool probe(uint64_t key, transpositionData& data) const;
+
+    /// @brief Stores a state in the table. If the state is already in the table it is overwritten, unless the stored entry is deeper and from this search and the new data is only a bound. Otherwise it takes the least valuable entry of its bucket. Safe to call from several threads at once, and alongside probe().
+    /// @param key The hash of the state.
+    /// @param data The data to store.
+    void store(uint64_t key, const transpositionData& data);
+
+    /// @brief Gets the number of entries the table can hold.
+    size_t getCapacity() const;
+};
+
+/// @brief A hash table of a fixed memory size holding only the result of each state: who wins, or a draw. A result takes 2 bits, so each entry is 8 bytes, the rest holding the hash itself, and twice as many states fit in a given budget as in a TranspositionTable. The whole hash is checked, as in a TranspositionTable, because a wrong result found here would be written to the brain. Unlike TranspositionTable it is for one thread only.
+class WinDrawLossTable
+{
+public:
+    /// @brief Number of entries in each bucket. 8 entries of 8 bytes fill one 64 byte cache line.
+    static const int BucketSize = 8;
+
+private:
+    struct alignas(64) bucket
+    {
+        /// @brief The hash with its lowest 2 bits replaced by the result, or 0 for an empty entry. Those bits also pick the bucket, so they are checked anyway in a table of at least 4 buckets. Every result is nonzero, so no stored entry is 0.
+        uint64_t entries[BucketSize];
+    };
+
+    bucket* buckets_;
+
+    /// @brief The number of buckets, always a power of two so that a hash can be masked into an index.
+    size_t bucketCount_;
+
+    /// @brief Size of the allocation holding the buckets in bytes.
+    size_t allocatedBytes_;
+
+    /// @brief Whether the buckets were allocated with mmap, and so must be freed with munmap.
+    bool mapped_;
+
+    void allocate(size_t megabytes);
+    void release();
+
+    /// @brief The bucket a hash maps to, picked by the low bits of the hash.
+    bucket& bucketFor(uint64_t key);
+    const bucket& bucketFor(uint64_t key) const;
+
+public:
+    /// @brief Creates a table using TranspositionTable::DefaultMegabytes of memory.
+    WinDrawLossTable();
+
+    /// @brief Creates a table using at most the given amount of memory.
+    /// @param megabytes The memory budget of the table. The table is rounded down to a power of two number of buckets.
+    WinDrawLossTable(size_t megabytes);
+
+    ~WinDrawLossTable();
+
+    WinDrawLossTable(const WinDrawLossTable&) = delete;
+    WinDrawLossTable& operator=(const WinDrawLossTable&) = delete;
+
+    /// @brief Replaces the table with one of a new size. All entries are lost.
+    void resize(size_t megabytes);
+
+    /// @brief Removes every entry from the table.
+    void clear();
+
+    /// @brief Looks up the result of a state.
+    /// @param key The hash of the state.
+    /// @param result Filled in with the stored result if the state is found.
+    /// @return true if the state was found.
+    bool probe(uint64_t key, player& result) const;
+
+    /// @brief Stores the result of a state. If the state is already in the table it is overwritten, otherwise it takes an empty entry of its bucket, or an entry picked by the hash when there is none. Results carry no measure of the work behind them, so there is nothing better to replace by.
+    /// @param key The hash of the state.
+    /// @param result x, o or draw. Throws std::invalid_argument if neither.
+    void store(uint64_t key, player result);
+
+    /// @brief Gets the number of entries the table can hold.
+    size_t getCapacity() const;
+};
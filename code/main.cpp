@@ -2,23 +2,97 @@
 #include <bitset>
 #include <fstream>
 #include <set>
+#include <string>
 #include "State.h"
 #include "Agent.h"
 
-int main()
+int main(int argc, char* argv[])
 {
-    std::ofstream file("brain.txt");
+    // command line options
+    size_t tableMegabytes = TranspositionTable::DefaultMegabytes;
+    size_t solvedMegabytes = SolvedStateStore::DefaultMegabytes;
+    bool useHugePages = false;
+    bool writeText = false;
+    bool writeCompressed = false;
+    bool winDrawLoss = false;
+    bool refineDepths = false;
+    unsigned int threadCount = 1;
+    int splitPly = AgentTrainer::DefaultSplitPly;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "--tt-mb" && i + 1 < argc)
+        {
+            tableMegabytes = std::stoul(argv[++i]);
+        }
+        else if (option == "--solved-mb" && i + 1 < argc)
+        {
+            solvedMegabytes = std::stoul(argv[++i]);
+        }
+        else if (option == "--threads" && i + 1 < argc)
+        {
+            threadCount = std::stoul(argv[++i]);
+        }
+        else if (option == "--split-ply" && i + 1 < argc)
+        {
+            splitPly = std::stoi(argv[++i]);
+        }
+        else if (option == "--huge-pages")
+        {
+            useHugePages = true;
+        }
+        else if (option == "--text")
+        {
+            writeText = true;
+        }
+        else if (option == "--compressed")
+        {
+            writeCompressed = true;
+        }
+        else if (option == "--wdl")
+        {
+            winDrawLoss = true;
+        }
+        else if (option == "--dtw")
+        {
+            winDrawLoss = true;
+            refineDepths = true;
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--tt-mb megabytes] [--solved-mb megabytes] [--huge-pages] [--threads count] [--split-ply ply] [--text | --compressed] [--wdl | --dtw]\n";
+            return 1;
+        }
+    }
+
+    // the win draw loss solve only runs on one thread.
+    if (winDrawLoss and threadCount != 1)
+    {
+        std::cerr << "--threads can not be used with --wdl or --dtw, which only run on one thread\n";
+        return 1;
+    }
+
+    // the brain is written in the binary format unless the legacy text format or the compressed format is asked for.
+    std::ofstream file;
+    if (writeText) { file.open("brain.txt"); }
+    else if (writeCompressed) { file.open("brain.binz", std::ios::binary); }
+    else { file.open("brain.bin", std::ios::binary); }
     if (!file.is_open()) 
     {
         std::cerr << "file failed to open\n";
         return 1;
     }
 
-    AgentTrainer trainer(file);
+    AgentTrainer trainer(file, tableMegabytes, useHugePages);
+    trainer.setSolvedStateMegabytes(solvedMegabytes);
     Ultimate3TState state;
-    trainer.minimax(state);
-    trainer.writeToOutput();
+    if (winDrawLoss) { trainer.solveWinDrawLoss(state); }
+    else { trainer.minimax(state, threadCount, splitPly); }
+    if (refineDepths) { trainer.refineDepthToWin(state); }
+    if (writeText) { trainer.writeToOutput(); }
+    else if (writeCompressed) { trainer.writeCompressedBrain(file); }
+    else { trainer.writeBrain(file); }
 
     file.close();
     return 0;
-}
\ No newline at end of file
+}
@@ -1,23 +1,40 @@
 #include <Agent.h>
 #include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
 
 ///// AgentTrainer definitions /////
 
-void AgentTrainer::init(std::ostream& outputStream)
+void AgentTrainer::init(std::ostream& outputStream, size_t tableMegabytes, bool useHugePages)
 {
     statesExpanded_ = 0;
     outputStream_ = &outputStream;
-    transpositionTable_ = std::map<std::bitset<ENCODINGSIZE>, std::pair<evaluationValue, move>, EncodingCompare>();
+    transpositionTable_.resize(tableMegabytes, useHugePages);
+    winDrawLossTable_.resize(0);
+    tableMegabytes_ = tableMegabytes;
+    useHugePages_ = useHugePages;
+    winDrawLossTableAllocated_ = false;
+    solvedStates_.clear();
+    shared_ = false;
+    splitPly_ = DefaultSplitPly;
+    searchFinished_.store(false);
+    workCount_.store(0);
 }
 
 AgentTrainer::AgentTrainer()
 {
-    init(std::cout);
+    init(std::cout, TranspositionTable::DefaultMegabytes, false);
 }
 
 AgentTrainer::AgentTrainer(std::ostream& outputStream)
 {
-    init(outputStream);
+    init(outputStream, TranspositionTable::DefaultMegabytes, false);
+}
+
+AgentTrainer::AgentTrainer(std::ostream& outputStream, size_t tableMegabytes, bool useHugePages)
+{
+    init(outputStream, tableMegabytes, useHugePages);
 }
 
 AgentTrainer::~AgentTrainer()
@@ -25,130 +42,480 @@ AgentTrainer::~AgentTrainer()
     outputStream_ = nullptr;
 }
 
-// Not allowed to change the evaluationValue or bestMove of state, so that we can find it in the transposition table later without first finding those values.
+namespace
+{
+    /// @brief Whether a move is better for the player to move than the best move found so far. Moves that are equally good, which includes draws of any depth, are ordered by the move they become in the canonical variant of the state. That way the evaluation and best move recorded for a state do not depend on which variant of it was searched, or on the order threads finish in.
+    bool isBetterMove(player toMove, int symmetry, evaluationValue value, move action, evaluationValue bestValue, move bestMove)
+    {
+        if (value > bestValue) { return toMove == player::x; }
+        if (bestValue > value) { return toMove == player::o; }
+        return Ultimate3TState::transformMove(action, symmetry).toBinary() < Ultimate3TState::transformMove(bestMove, symmetry).toBinary();
+    }
+}
+
 evaluationValue AgentTrainer::minimax(Ultimate3TState& state)
 {
-    // check if the state is in the transposition table
-    auto transpositionTableEntry = transpositionTable_.find(state.toBinary());
-    if (transpositionTableEntry != transpositionTable_.end())
+    return minimax(state, 1);
+}
+
+evaluationValue AgentTrainer::minimax(Ultimate3TState& state, unsigned int threadCount, int splitPly)
+{
+    if (threadCount == 0) { throw std::invalid_argument("minimax needs at least one thread"); }
+    workers_.clear();
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        workers_.push_back(std::unique_ptr<trainerWorker>(new trainerWorker()));
+        workers_.back()->index = i;
+        workers_.back()->statesExpanded = 0;
+    }
+    shared_ = threadCount > 1;
+    splitPly_ = splitPly;
+    searchFinished_.store(false);
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadCount; i++)
+    {
+        threads.push_back(std::thread(&AgentTrainer::runWorker, this, std::ref(*workers_[i])));
+    }
+    evaluationValue value = search(state, *workers_[0], 0);
+    searchFinished_.store(true);
+    announceWork();
+    for (std::thread& thread : threads) { thread.join(); }
+
+    for (auto& worker : workers_)
+    {
+        statesExpanded_ += worker->statesExpanded;
+        flushSolvedStates(*worker);
+    }
+    workers_.clear();
+    return value;
+}
+
+// Moves are made and taken back on state in place, so state is the same when this returns as when it was called.
+evaluationValue AgentTrainer::search(Ultimate3TState& state, trainerWorker& worker, int ply)
+{
+    // check if the state, or any rotation or reflection of it, is in the transposition table. They all have the same evaluation.
+    transpositionData transpositionTableEntry;
+    if (transpositionTable_.probe(state.canonicalHash(), transpositionTableEntry))
     {
-        return transpositionTableEntry->second.first; // Return the evaluationValue in the transposition table.
+        return transpositionTableEntry.evaluation; // Return the evaluationValue in the transposition table.
     }
 
     if (state.isTerminalState())
     {
         evaluationValue value(state.utility(), 0);
-        // put state into the transposition table
-        transpositionTable_.insert(std::pair<std::bitset<ENCODINGSIZE>, std::pair<evaluationValue, move>>(state.toBinary(), std::pair<evaluationValue, move>(value, move())));
+        // put state into the transposition table. There is no move to make, so the placeholder move is stored as it is rather than transformed, to be the same for every variant.
+        recordSolvedState(state, state.canonicalSymmetry(), value, move(), worker);
         return value;
     }
 
-    evaluationValue value = state.getActivePlayer() == player::x ? evaluationValue(player::o, 0) : evaluationValue(player::x, 0);
-    evaluationValue nextStateValue;
-    std::vector<move> actions = state.generateMoves();
-    statesExpanded_++;
+    moveList actions;
+    state.generateMoves(actions);
+    worker.statesExpanded++;
+    player toMove = state.getActivePlayer();
+    int symmetry = state.canonicalSymmetry();
+    evaluationValue value;
     move bestMove = actions[0];
-    for (std::vector<move>::iterator action = actions.begin(); action != actions.end(); action++)
+    if (shared_ and ply < splitPly_ and actions.size() > 1)
     {
-        Ultimate3TState nextState = state.generateSuccessorState(*action);
-        nextStateValue = minimax(nextState);
-        if (!(state.getActivePlayer() == player::x xor value > nextStateValue))
+        // every move but the first becomes a task that any worker can take, while this worker searches the first.
+        std::vector<std::unique_ptr<trainerTask>> children;
         {
-            bestMove = *action;
-            value = nextStateValue;
+            std::lock_guard<std::mutex> guard(worker.lock);
+            for (int i = 1; i < actions.size(); i++)
+            {
+                children.push_back(std::unique_ptr<trainerTask>(new trainerTask(state, ply + 1)));
+                children.back()->state.makeMove(actions[i]);
+                worker.tasks.push_back(children.back().get());
+            }
+        }
+        announceWork();
+        undoRecord undo = state.makeMove(actions[0]);
+        value = search(state, worker, ply + 1);
+        state.unmakeMove(undo);
+
+        // help with smaller tasks until every move has been searched.
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            // the count is read before done, so a task finished after done is read still wakes this worker.
+            for (uint64_t seenWork = workCount_.load(); !children[i]->done.load(std::memory_order_acquire); seenWork = workCount_.load())
+            {
+                if (!runTask(worker, ply)) { waitForWork(seenWork); }
+            }
+            if (isBetterMove(toMove, symmetry, children[i]->value, actions[i + 1], value, bestMove))
+            {
+                bestMove = actions[i + 1];
+                value = children[i]->value;
+            }
+        }
+    }
+    else
+    {
+        for (move* action = actions.begin(); action != actions.end(); action++)
+        {
+            undoRecord undo = state.makeMove(*action);
+            evaluationValue nextStateValue = search(state, worker, ply + 1);
+            state.unmakeMove(undo);
+            if (action == actions.begin() or isBetterMove(toMove, symmetry, nextStateValue, *action, value, bestMove))
+            {
+                bestMove = *action;
+                value = nextStateValue;
+            }
         }
     }
     // because there was a move to get to this state, we must increase the depth by one here.
-    value.depth += 1;
+    value = value.deeper();
     // insert into transposition table
-    transpositionTable_.insert(std::pair<std::bitset<ENCODINGSIZE>, std::pair<evaluationValue, move>>(state.toBinary(), std::pair<evaluationValue, move>(value, bestMove)));
+    recordSolvedState(state, symmetry, value, Ultimate3TState::transformMove(bestMove, symmetry), worker);
     return value;
 }
 
-void AgentTrainer::writeToOutput()
+void AgentTrainer::allocateWinDrawLossTable()
 {
-    for (auto state = transpositionTable_.begin(); state != transpositionTable_.end(); state++)
-    {
-        Ultimate3TState temp(state->first);
-        temp.setBestMove(state->second.second);
-        temp.setEvaluation(state->second.first);
-        *outputStream_ << temp.toBinary() << "\n";
-    }
+    if (winDrawLossTableAllocated_) { return; }
+    size_t winDrawLossMegabytes = tableMegabytes_ / 2;
+    transpositionTable_.resize(tableMegabytes_ - winDrawLossMegabytes, useHugePages_);
+    winDrawLossTable_.resize(winDrawLossMegabytes);
+    winDrawLossTableAllocated_ = true;
 }
 
-void AgentTrainer::resetTranspositionTable()
+player AgentTrainer::solveWinDrawLoss(Ultimate3TState& state)
 {
-    transpositionTable_ = std::map<std::bitset<ENCODINGSIZE>, std::pair<evaluationValue, move>, EncodingCompare>();
+    allocateWinDrawLossTable();
+    return searchWinDrawLoss(state);
 }
 
-unsigned int AgentTrainer::getStatesExpanded() { return statesExpanded_; }
-
-void AgentTrainer::resetStatesExpanded() { statesExpanded_ = 0; }
+// Moves are made and taken back on state in place, so state is the same when this returns as when it was called.
+player AgentTrainer::searchWinDrawLoss(Ultimate3TState& state)
+{
+    player result;
+    if (winDrawLossTable_.probe(state.canonicalHash(), result)) { return result; }
 
-///// EncodingCompare definitions /////
+    int symmetry = state.canonicalSymmetry();
+    if (state.isTerminalState())
+    {
+        result = state.utility();
+        winDrawLossTable_.store(state.canonicalHash(), result);
+        solvedStates_.add(trainerEntry{state.toPackedPosition(symmetry), evaluationValue(result, 0), move()});
+        return result;
+    }
 
-bool EncodingCompare::operator()(std::bitset<ENCODINGSIZE> a, std::bitset<ENCODINGSIZE> b) const
-{
-    for (int i = ENCODINGSIZE; i > 0; i--)
+    moveList actions;
+    state.generateMoves(actions);
+    statesExpanded_++;
+    player toMove = state.getActivePlayer();
+    // a move that wins a sub-board is the likeliest to win the game, and finding a win early skips the rest of the moves.
+    std::partition(actions.begin(), actions.end(), [&state, toMove](const move& action) { return state.winsBoard(action, toMove); });
+    result = toMove == player::x ? player::o : player::x;
+    move bestMove = actions[0];
+    for (move* action = actions.begin(); action != actions.end(); action++)
     {
-        if (a[i-1] xor b[i-1])
+        undoRecord undo = state.makeMove(*action);
+        player nextStateResult = searchWinDrawLoss(state);
+        state.unmakeMove(undo);
+        // nothing is better than a win, so the other moves do not need to be searched.
+        if (nextStateResult == toMove)
         {
-            return a[i-1] < b[i-1];
+            result = toMove;
+            bestMove = *action;
+            break;
+        }
+        if (nextStateResult == player::draw and result != player::draw)
+        {
+            result = player::draw;
+            bestMove = *action;
         }
     }
-    // If all the bits match, Then the
-    return false;
+    winDrawLossTable_.store(state.canonicalHash(), result);
+    solvedStates_.add(trainerEntry{state.toPackedPosition(symmetry), evaluationValue(result, 0), Ultimate3TState::transformMove(bestMove, symmetry)});
+    return result;
 }
 
-///// TIM definitions /////
-template <typename MoveType, typename ValueType, typename StateType, unsigned int BinaryLength>
-std::pair<MoveType, ValueType> TIM<StateType>::search(StateType& state, ValueType alpha = ValueType.createMin(), evaluationValue beta = evaluationValue(player::x, 0))
+evaluationValue AgentTrainer::refineDepthToWin(Ultimate3TState& state)
 {
-    // check if the state is in the transposition table
-    auto transpositionTableEntry = transpositionTable_.find(state.toBinary());
-    if (transpositionTableEntry != transpositionTable_.end())
+    allocateWinDrawLossTable();
+    player result = searchWinDrawLoss(state);
+    if (result == player::draw) { return evaluationValue(player::draw, 0); }
+
+    trainerWorker worker;
+    worker.index = 0;
+    worker.statesExpanded = 0;
+    evaluationValue value = searchDepthToWin(state, result, worker);
+    // the refined states go after the ones solveWinDrawLoss() recorded, so that they are the ones kept.
+    statesExpanded_ += worker.statesExpanded;
+    flushSolvedStates(worker);
+    return value;
+}
+
+// Moves are made and taken back on state in place, so state is the same when this returns as when it was called.
+evaluationValue AgentTrainer::searchDepthToWin(Ultimate3TState& state, player result, trainerWorker& worker)
+{
+    // the transposition table only holds exact evaluations, from minimax or from here.
+    transpositionData transpositionTableEntry;
+    if (transpositionTable_.probe(state.canonicalHash(), transpositionTableEntry))
     {
-        return transpositionTableEntry->second; // Return the move and evaluationValue in the transposition table.
+        return transpositionTableEntry.evaluation;
     }
 
     if (state.isTerminalState())
     {
-        std::pair<move, evaluationValue> value(move(), evaluationValue(state.utility(), 0));
-        // put state into the transposition table
-        transpositionTable_.insert( std::pair<std::bitset<ENCODINGSIZE>, std::pair<move, evaluationValue>> (state.toBinary(), value) );
+        evaluationValue value(state.utility(), 0);
+        recordSolvedState(state, state.canonicalSymmetry(), value, move(), worker);
         return value;
     }
 
-    evaluationValue value = state.getActivePlayer() == player::x ? evaluationValue(player::o, 0) : evaluationValue(player::x, 0);
-
-    std::pair<move, evaluationValue> nextStateValue;
-    std::vector<move> actions = state.generateMoves();
-    statesExpanded_++;
+    moveList actions;
+    state.generateMoves(actions);
+    worker.statesExpanded++;
+    player toMove = state.getActivePlayer();
+    int symmetry = state.canonicalSymmetry();
+    evaluationValue value;
     move bestMove = actions[0];
-    for (std::vector<move>::iterator action = actions.begin(); action != actions.end(); action++)
+    bool searchedMove = false;
+    for (move* action = actions.begin(); action != actions.end(); action++)
     {
-        Ultimate3TState nextState = state.generateSuccessorState(*action);
-        nextStateValue = search(nextState, alpha, beta);
-        if (!(state.getActivePlayer() == player::x xor value > nextStateValue.second))
+        undoRecord undo = state.makeMove(*action);
+        // the first pass stopped at the first winning move, so the results of the moves after it are found here.
+        player nextStateResult = searchWinDrawLoss(state);
+        // the winner only plays moves that keep the win, and every move of the loser keeps the loss, so no draw is ever searched.
+        if (result == toMove and nextStateResult != toMove)
+        {
+            state.unmakeMove(undo);
+            continue;
+        }
+        evaluationValue nextStateValue = searchDepthToWin(state, nextStateResult, worker);
+        state.unmakeMove(undo);
+        if (!searchedMove or isBetterMove(toMove, symmetry, nextStateValue, *action, value, bestMove))
         {
             bestMove = *action;
-            value = nextStateValue.second;
+            value = nextStateValue;
+            searchedMove = true;
+        }
+    }
+    // because there was a move to get to this state, we must increase the depth by one here.
+    value = value.deeper();
+    recordSolvedState(state, symmetry, value, Ultimate3TState::transformMove(bestMove, symmetry), worker);
+    return value;
+}
+
+bool AgentTrainer::runTask(trainerWorker& worker, int minimumPly)
+{
+    trainerTask* task = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(worker.lock);
+        if (!worker.tasks.empty() and worker.tasks.back()->ply > minimumPly)
+        {
+            task = worker.tasks.back();
+            worker.tasks.pop_back();
         }
-        // Update alpha or beta and check if we can prune
-        if (state.getActivePlayer() == player::x)
+    }
+    // steal from the other workers, starting with the next one so that thieves spread out. An idle worker takes the largest task, a waiting one the smallest.
+    for (size_t i = 1; task == nullptr and i < workers_.size(); i++)
+    {
+        trainerWorker& victim = *workers_[(worker.index + i) % workers_.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tasks.empty()) { continue; }
+        if (minimumPly < 0)
         {
-            alpha = std::max(alpha, value);
-            if ( value >=  beta) { break; }
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
         }
-        else
+        else if (victim.tasks.back()->ply > minimumPly)
         {
-            beta = std::min(beta, value);
-            if ( value <= alpha) { break; }
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
         }
     }
-    // because there was a move to get to this state, we must increase the depth by one here.
-    value.depth += 1;
-    // insert into transposition table
-    transpositionTable_.insert(std::pair<std::bitset<ENCODINGSIZE>, std::pair<move, evaluationValue>>(state.toBinary(), std::pair<move, evaluationValue>(bestMove, value)));
-    return std::pair<move, evaluationValue>(bestMove, value);
-}
\ No newline at end of file
+    if (task == nullptr) { return false; }
+
+    task->value = search(task->state, worker, task->ply);
+    task->done.store(true, std::memory_order_release);
+    announceWork();
+    return true;
+}
+
+void AgentTrainer::runWorker(trainerWorker& worker)
+{
+    for (uint64_t seenWork = workCount_.load(); !searchFinished_.load(); seenWork = workCount_.load())
+    {
+        if (!runTask(worker, -1)) { waitForWork(seenWork); }
+    }
+}
+
+void AgentTrainer::announceWork()
+{
+    {
+        std::lock_guard<std::mutex> guard(workLock_);
+        workCount_.fetch_add(1);
+    }
+    workChanged_.notify_all();
+}
+
+void AgentTrainer::waitForWork(uint64_t seenWork)
+{
+    std::unique_lock<std::mutex> lock(workLock_);
+    workChanged_.wait(lock, [this, seenWork]() { return workCount_.load() != seenWork; });
+}
+
+void AgentTrainer::recordSolvedState(Ultimate3TState& state, int symmetry, evaluationValue value, move canonicalMove, trainerWorker& worker)
+{
+    // states are stored as their canonical variant, so all 8 rotations and reflections of a state share one entry.
+    // the depth to the end of the game doubles as the size of the subtree that was searched, so deeper results are kept over shallower ones.
+    transpositionTable_.store(state.canonicalHash(), transpositionData{value, canonicalMove, uint8_t(value.getDepth()), exactBound, 0});
+    worker.solvedStates.push_back(trainerEntry{state.toPackedPosition(symmetry), value, canonicalMove});
+    if (worker.solvedStates.size() >= WorkerSolvedStates) { flushSolvedStates(worker); }
+}
+
+void AgentTrainer::flushSolvedStates(trainerWorker& worker)
+{
+    // states are handed over in batches, so workers rarely wait on each other for the lock.
+    std::lock_guard<std::mutex> guard(solvedStatesLock_);
+    for (const trainerEntry& entry : worker.solvedStates) { solvedStates_.add(entry); }
+    worker.solvedStates.clear();
+}
+
+void AgentTrainer::writeToOutput()
+{
+    // the solved states come back sorted by their packed position, which keeps the output deterministic.
+    solvedStates_.forEach([this](const trainerEntry& entry)
+    {
+        // unpack each state and write it in the 196 bit encoding.
+        Ultimate3TState temp(entry.position);
+        temp.setBestMove(entry.bestMove);
+        temp.setEvaluation(entry.evaluation);
+        *outputStream_ << temp.toBinary() << "\n";
+    });
+}
+
+void AgentTrainer::forEachBrainRecord(const Brain::brainRecordVisitor& visit)
+{
+    solvedStates_.forEach([&visit](const trainerEntry& entry)
+    {
+        visit(brainRecord::create(entry.position, entry.evaluation, entry.bestMove));
+    });
+}
+
+std::vector<brainRecord> AgentTrainer::createBrainRecords()
+{
+    std::vector<brainRecord> records;
+    forEachBrainRecord([&records](const brainRecord& record) { records.push_back(record); });
+    return records;
+}
+
+void AgentTrainer::writeBrain(std::ostream& output)
+{
+    // the records are streamed from the solved states, which are merged again for each pass of the writer.
+    Brain::write(output, [this](const Brain::brainRecordVisitor& visit) { forEachBrainRecord(visit); });
+}
+
+void AgentTrainer::writeCompressedBrain(std::ostream& output)
+{
+    CompressedBrain::write(output, createBrainRecords());
+}
+
+BrainTable AgentTrainer::createBrainTable()
+{
+    return BrainTable(createBrainRecords());
+}
+
+void AgentTrainer::resetTranspositionTable()
+{
+    transpositionTable_.clear();
+    winDrawLossTable_.clear();
+    solvedStates_.clear();
+}
+
+void AgentTrainer::setSolvedStateMegabytes(size_t megabytes)
+{
+    solvedStates_.resize(megabytes);
+}
+
+unsigned int AgentTrainer::getStatesExpanded() { return statesExpanded_; }
+
+void AgentTrainer::resetStatesExpanded() { statesExpanded_ = 0; }
+
+///// timeControl definitions /////
+
+timeControl::timeControl()
+{
+    moveTimeMs = 0;
+    remainingMs = 0;
+    incrementMs = 0;
+    maxDepth = 0;
+}
+
+timeControl timeControl::unlimited() { return timeControl(); }
+
+timeControl timeControl::fixedMoveTime(long long moveTimeMs)
+{
+    timeControl control;
+    control.moveTimeMs = moveTimeMs;
+    return control;
+}
+
+timeControl timeControl::clock(long long remainingMs, long long incrementMs)
+{
+    timeControl control;
+    control.remainingMs = remainingMs;
+    control.incrementMs = incrementMs;
+    return control;
+}
+
+timeControl timeControl::depth(int maxDepth)
+{
+    timeControl control;
+    control.maxDepth = maxDepth;
+    return control;
+}
+
+bool timeControl::hasBudget() const { return moveTimeMs > 0 or remainingMs > 0; }
+
+long long timeControl::budgetMs() const
+{
+    if (moveTimeMs > 0) { return moveTimeMs; }
+    // the increment comes back after every move, so it can all be spent, but never more than is on the clock.
+    long long budget = remainingMs / MovesToGo + incrementMs;
+    budget = std::min(budget, remainingMs - SafetyMarginMs);
+    return std::max(budget, 1ll);
+}
+
+///// moveOrdering definitions /////
+
+moveOrdering::moveOrdering()
+{
+    tableMove = true;
+    boardWins = true;
+    boardBlocks = true;
+    avoidFreeChoice = true;
+    killerMoves = true;
+    history = true;
+}
+
+moveOrdering moveOrdering::all() { return moveOrdering(); }
+
+moveOrdering moveOrdering::none()
+{
+    moveOrdering ordering;
+    ordering.tableMove = false;
+    ordering.boardWins = false;
+    ordering.boardBlocks = false;
+    ordering.avoidFreeChoice = false;
+    ordering.killerMoves = false;
+    ordering.history = false;
+    return ordering;
+}
+
+///// EncodingCompare definitions /////
+
+bool EncodingCompare::operator()(std::bitset<ENCODINGSIZE> a, std::bitset<ENCODINGSIZE> b) const
+{
+    for (int i = ENCODINGSIZE; i > 0; i--)
+    {
+        if (a[i-1] xor b[i-1])
+        {
+            return a[i-1] < b[i-1];
+        }
+    }
+    // If all the bits match, Then the bitsets are equal.
+    return false;
+}
@@ -0,0 +1,442 @@
+#include "Brain.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <xmmintrin.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Layout of a packed evaluation.
+    const int EvaluationDepthShift = 2;
+    const uint16_t EvaluationPlayerMask = 0b11;
+
+    /// @brief Rounds an offset up to a multiple of 8, so the blocks of the file stay aligned for the words in them.
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + 7) & ~uint64_t(7);
+    }
+
+    // Layout of a BrainTable value.
+    const int ValueMoveShift = 16;
+    const uint32_t ValueEvaluationMask = 0xFFFF;
+
+    /// @brief a < b, worked out with bitwise operations so that the compiler does not branch on it.
+    inline size_t keyLess(const packedPosition& a, const packedPosition& b)
+    {
+        return size_t((a.high < b.high) | ((a.high == b.high) & (a.low < b.low)));
+    }
+
+    /// @brief The number of trailing zero bits of a nonzero value.
+    inline int trailingZeros(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return int(index);
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    inline void prefetch(const void* address)
+    {
+#ifdef _MSC_VER
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+        __builtin_prefetch(address);
+#endif
+    }
+}
+
+///// MappedFile definitions /////
+
+void MappedFile::init(const std::string& path)
+{
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+
+#ifdef __linux__
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) { throw std::runtime_error("Could not open file " + path); }
+    struct stat fileStatus;
+    if (fstat(file, &fileStatus) != 0)
+    {
+        close(file);
+        throw std::runtime_error("Could not read file " + path);
+    }
+    size_ = size_t(fileStatus.st_size);
+    if (size_ > 0)
+    {
+        // a shared read only mapping lets every process using the file share the same pages.
+        void* memory = mmap(nullptr, size_, PROT_READ, MAP_SHARED, file, 0);
+        close(file);
+        if (memory == MAP_FAILED) { throw std::runtime_error("Could not map file " + path); }
+        data_ = static_cast<const unsigned char*>(memory);
+        mapped_ = true;
+    }
+    else
+    {
+        close(file);
+    }
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) { throw std::runtime_error("Could not open file " + path); }
+    buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+}
+
+MappedFile::MappedFile(const std::string& path)
+{
+    init(path);
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef __linux__
+    if (mapped_) { munmap(const_cast<unsigned char*>(data_), size_); }
+#endif
+}
+
+const unsigned char* MappedFile::data() const { return data_; }
+
+size_t MappedFile::size() const { return size_; }
+
+///// brainRecord definitions /////
+
+brainRecord brainRecord::create(packedPosition key, evaluationValue evaluation, move bestMove)
+{
+    brainRecord record{};
+    record.key = key;
+    record.evaluation = uint16_t(evaluation.getPlayerToWin() | (evaluation.getDepth() << EvaluationDepthShift));
+    record.bestMove = bestMove.toBinary();
+    return record;
+}
+
+evaluationValue brainRecord::getEvaluation() const
+{
+    return evaluationValue(player(evaluation & EvaluationPlayerMask), evaluation >> EvaluationDepthShift);
+}
+
+move brainRecord::getBestMove() const
+{
+    return move(bestMove);
+}
+
+///// Brain definitions /////
+
+const char Brain::BrainMagic[8] = {'U', '3', 'T', 'B', 'R', 'A', 'I', 'N'};
+
+void Brain::init()
+{
+    validate();
+    header_ = reinterpret_cast<const brainHeader*>(file_.data());
+    records_ = reinterpret_cast<const brainRecord*>(file_.data() + header_->recordsOffset);
+    index_ = nullptr;
+    if (header_->indexOffset != 0)
+    {
+        index_ = reinterpret_cast<const packedPosition*>(file_.data() + header_->indexOffset);
+    }
+}
+
+void Brain::validate() const
+{
+    size_t size = file_.size();
+    if (size < sizeof(brainHeader)) { throw std::runtime_error("Brain file is too small to hold a header"); }
+    const brainHeader& header = *reinterpret_cast<const brainHeader*>(file_.data());
+    if (memcmp(header.magic, BrainMagic, sizeof(BrainMagic)) != 0) { throw std::runtime_error("File is not a brain file"); }
+    if (header.version != BrainVersion) { throw std::runtime_error("Brain file version is not supported"); }
+    if (header.recordSize != sizeof(brainRecord)) { throw std::runtime_error("Brain file records are the wrong size"); }
+    // the records and the index are read in place, so they must be aligned for the words in them.
+    if (header.recordsOffset % alignof(brainRecord) != 0 or header.indexOffset % alignof(packedPosition) != 0)
+    {
+        throw std::runtime_error("Brain file blocks are not aligned");
+    }
+    // check every block fits in the file, dividing rather than multiplying so that huge counts can not overflow.
+    if (header.recordsOffset > size or header.recordCount > (size - header.recordsOffset) / sizeof(brainRecord))
+    {
+        throw std::runtime_error("Brain file records run past the end of the file");
+    }
+    if (header.indexOffset != 0)
+    {
+        if (header.indexStride == 0 or header.indexCount != (header.recordCount + header.indexStride - 1) / header.indexStride)
+        {
+            throw std::runtime_error("Brain file index does not match its records");
+        }
+        if (header.indexOffset > size or header.indexCount > (size - header.indexOffset) / sizeof(packedPosition))
+        {
+            throw std::runtime_error("Brain file index runs past the end of the file");
+        }
+    }
+}
+
+Brain::Brain(const std::string& path) : file_(path)
+{
+    init();
+}
+
+void Brain::write(std::ostream& output, const std::vector<brainRecord>& records, uint64_t indexStride)
+{
+    write(output, [&records](const brainRecordVisitor& visit)
+    {
+        for (const brainRecord& record : records) { visit(record); }
+    }, indexStride);
+}
+
+void Brain::write(std::ostream& output, const std::function<void(const brainRecordVisitor&)>& forEachRecord, uint64_t indexStride)
+{
+    // the first pass counts the records for the header, and checks their order before anything is written.
+    uint64_t recordCount = 0;
+    packedPosition lastKey{0, 0};
+    forEachRecord([&recordCount, &lastKey](const brainRecord& record)
+    {
+        if (recordCount > 0 and !(lastKey < record.key))
+        {
+            throw std::invalid_argument("Brain records must be sorted by key with no key repeated");
+        }
+        lastKey = record.key;
+        recordCount++;
+    });
+
+    brainHeader header{};
+    memcpy(header.magic, BrainMagic, sizeof(BrainMagic));
+    header.version = BrainVersion;
+    header.recordSize = sizeof(brainRecord);
+    header.recordCount = recordCount;
+    header.recordsOffset = alignOffset(sizeof(brainHeader));
+    uint64_t recordsEnd = header.recordsOffset + recordCount * sizeof(brainRecord);
+    if (indexStride > 0)
+    {
+        header.indexOffset = alignOffset(recordsEnd);
+        header.indexStride = indexStride;
+        header.indexCount = (recordCount + indexStride - 1) / indexStride;
+    }
+
+    const char padding[8] = {};
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(padding, header.recordsOffset - sizeof(header));
+    uint64_t written = 0;
+    forEachRecord([&output, &written](const brainRecord& record)
+    {
+        output.write(reinterpret_cast<const char*>(&record), sizeof(brainRecord));
+        written++;
+    });
+    if (written != recordCount) { throw std::invalid_argument("Brain records changed while they were written"); }
+    if (indexStride > 0)
+    {
+        // the index comes after the records, so its keys are taken in a third pass rather than kept from the second.
+        output.write(padding, header.indexOffset - recordsEnd);
+        uint64_t position = 0;
+        forEachRecord([&output, &position, indexStride](const brainRecord& record)
+        {
+            if (position % indexStride == 0) { output.write(reinterpret_cast<const char*>(&record.key), sizeof(packedPosition)); }
+            position++;
+        });
+    }
+    if (!output) { throw std::runtime_error("Could not write brain file"); }
+}
+
+const brainRecord* Brain::find(const packedPosition& key) const
+{
+    const brainRecord* first = records_;
+    const brainRecord* last = records_ + header_->recordCount;
+    // the index is small enough to stay in cache, so search it first to find the block of records that could hold the key.
+    if (index_ != nullptr and header_->indexCount > 0)
+    {
+        const packedPosition* indexEnd = index_ + header_->indexCount;
+        const packedPosition* block = std::upper_bound(index_, indexEnd, key);
+        if (block == index_) { return nullptr; }
+        size_t blockNumber = size_t(block - index_) - 1;
+        first = records_ + blockNumber * header_->indexStride;
+        last = std::min(last, first + header_->indexStride);
+    }
+    const brainRecord* found = std::lower_bound(first, last, key, [](const brainRecord& record, const packedPosition& target) { return record.key < target; });
+    if (found == last or found->key != key) { return nullptr; }
+    return found;
+}
+
+bool Brain::lookup(const Ultimate3TState& state, evaluationValue& evaluation, move& bestMove) const
+{
+    // the brain holds the canonical variant of each state, so look that up and turn its best move back into this state's.
+    int symmetry = state.canonicalSymmetry();
+    const brainRecord* record = find(state.toPackedPosition(symmetry));
+    if (record == nullptr) { return false; }
+    evaluation = record->getEvaluation();
+    bestMove = Ultimate3TState::transformMove(record->getBestMove(), Ultimate3TState::inverseSymmetry(symmetry));
+    return true;
+}
+
+move Brain::bestMove(const Ultimate3TState& state) const
+{
+    evaluationValue evaluation;
+    move found;
+    if (!lookup(state, evaluation, found))
+    {
+        throw std::out_of_range("State is not in the brain");
+    }
+    return found;
+}
+
+size_t Brain::size() const
+{
+    return size_t(header_->recordCount);
+}
+
+std::vector<brainRecord> Brain::getRecords() const
+{
+    return std::vector<brainRecord>(records_, records_ + header_->recordCount);
+}
+
+///// BrainTable definitions /////
+
+void BrainTable::init(const std::vector<brainRecord>& records)
+{
+    for (size_t i = 1; i < records.size(); i++)
+    {
+        if (!(records[i - 1].key < records[i].key))
+        {
+            throw std::invalid_argument("Brain records must be sorted by key with no key repeated");
+        }
+    }
+
+    size_ = records.size();
+    levels_ = 0;
+    while ((size_t(1) << levels_) <= size_) { levels_++; }
+    lines_ = std::vector<keyLine>(size_ / LineSize + 1);
+    values_ = std::vector<uint32_t>(size_ + 1);
+    size_t next = 0;
+    place(records, 1, next);
+}
+
+void BrainTable::place(const std::vector<brainRecord>& records, size_t position, size_t& next)
+{
+    // an in order walk of the tree visits the positions in the order of the sorted records.
+    if (position > size_) { return; }
+    place(records, 2 * position, next);
+    lines_[position / LineSize].keys[position % LineSize] = records[next].key;
+    values_[position] = uint32_t(records[next].evaluation) | (uint32_t(records[next].bestMove) << ValueMoveShift);
+    next++;
+    place(records, 2 * position + 1, next);
+}
+
+const packedPosition& BrainTable::keyAt(size_t position) const
+{
+    return lines_[position / LineSize].keys[position % LineSize];
+}
+
+void BrainTable::prefetchChildren(size_t position) const
+{
+    // the grandchildren of a position are the whole of the line with the same number.
+    if (position < lines_.size()) { prefetch(&lines_[position]); }
+}
+
+size_t BrainTable::finishSearch(size_t position, const packedPosition& key) const
+{
+    // the search went right past the key it was after and then left until it fell off the tree, so undo the left steps and the last right step. A position of 0 means every key was less than the one searched for.
+    position >>= trailingZeros(~uint64_t(position)) + 1;
+    if (position == 0 or keyAt(position) != key) { return 0; }
+    return position;
+}
+
+void BrainTable::readValue(size_t position, int symmetry, evaluationValue& evaluation, move& bestMove) const
+{
+    brainRecord record{};
+    record.evaluation = uint16_t(values_[position] & ValueEvaluationMask);
+    record.bestMove = uint8_t(values_[position] >> ValueMoveShift);
+    evaluation = record.getEvaluation();
+    bestMove = Ultimate3TState::transformMove(record.getBestMove(), Ultimate3TState::inverseSymmetry(symmetry));
+}
+
+BrainTable::BrainTable(const std::vector<brainRecord>& records)
+{
+    init(records);
+}
+
+BrainTable::BrainTable(const Brain& brain)
+{
+    init(brain.getRecords());
+}
+
+bool BrainTable::lookup(const Ultimate3TState& state, evaluationValue& evaluation, move& bestMove) const
+{
+    int symmetry = state.canonicalSymmetry();
+    packedPosition key = state.toPackedPosition(symmetry);
+    size_t position = 1;
+    while (position <= size_)
+    {
+        prefetchChildren(position);
+        position = 2 * position + keyLess(keyAt(position), key);
+    }
+    position = finishSearch(position, key);
+    if (position == 0) { return false; }
+    readValue(position, symmetry, evaluation, bestMove);
+    return true;
+}
+
+void BrainTable::lookupBatch(const std::vector<Ultimate3TState>& states, std::vector<brainLookup>& results) const
+{
+    results.resize(states.size());
+    for (size_t first = 0; first < states.size(); first += BatchSize)
+    {
+        size_t count = std::min(states.size() - first, size_t(BatchSize));
+        int symmetries[BatchSize];
+        packedPosition keys[BatchSize];
+        size_t positions[BatchSize];
+        for (size_t i = 0; i < count; i++)
+        {
+            symmetries[i] = states[first + i].canonicalSymmetry();
+            keys[i] = states[first + i].toPackedPosition(symmetries[i]);
+            positions[i] = 1;
+        }
+
+        // step every search down one level at a time, so that while one search waits on a cache miss the others are already loading theirs.
+        for (int level = 0; level < levels_; level++)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                size_t position = positions[i];
+                if (position <= size_)
+                {
+                    prefetchChildren(position);
+                    positions[i] = 2 * position + keyLess(keyAt(position), keys[i]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            brainLookup& result = results[first + i];
+            size_t position = finishSearch(positions[i], keys[i]);
+            result.found = position != 0;
+            if (result.found) { readValue(position, symmetries[i], result.evaluation, result.bestMove); }
+        }
+    }
+}
+
+move BrainTable::bestMove(const Ultimate3TState& state) const
+{
+    evaluationValue evaluation;
+    move found;
+    if (!lookup(state, evaluation, found))
+    {
+        throw std::out_of_range("State is not in the brain table");
+    }
+    return found;
+}
+
+size_t BrainTable::size() const
+{
+    return size_;
+}
@@ -0,0 +1,232 @@
+#include "CompressedBrain.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+namespace
+{
+    // Layout of a value.
+    const int ValueMoveShift = 2;
+    const uint16_t ValuePlayerMask = 0b11;
+    const uint16_t ValueMask = (1 << CompressedBrain::ValueBits) - 1;
+
+    // Layout of a varint byte. The low 7 bits hold data, and the top bit is set if more bytes follow.
+    const int VarintDataBits = 7;
+    const uint8_t VarintDataMask = 0x7F;
+    const uint8_t VarintMoreBit = 0x80;
+
+    uint16_t packValue(const brainRecord& record)
+    {
+        move bestMove = record.getBestMove();
+        uint16_t moveIndex = uint16_t(bestMove.board * 9 + bestMove.space);
+        return uint16_t((record.getEvaluation().getPlayerToWin() & ValuePlayerMask) | (moveIndex << ValueMoveShift));
+    }
+
+    size_t valueBytes(size_t valueCount)
+    {
+        return (valueCount * CompressedBrain::ValueBits + 7) / 8;
+    }
+
+    /// @brief b - a, for b greater than a, treating the keys as 128 bit numbers.
+    packedPosition keyGap(const packedPosition& a, const packedPosition& b)
+    {
+        packedPosition gap;
+        gap.low = b.low - a.low;
+        gap.high = b.high - a.high - uint64_t(b.low < a.low);
+        return gap;
+    }
+
+    /// @brief a + gap, treating the keys as 128 bit numbers.
+    packedPosition addGap(const packedPosition& a, const packedPosition& gap)
+    {
+        packedPosition sum;
+        sum.low = a.low + gap.low;
+        sum.high = a.high + gap.high + uint64_t(sum.low < a.low);
+        return sum;
+    }
+
+    void writeVarint(std::vector<unsigned char>& output, packedPosition value)
+    {
+        while (value.high != 0 or value.low > VarintDataMask)
+        {
+            output.push_back(uint8_t(value.low & VarintDataMask) | VarintMoreBit);
+            value.low = (value.low >> VarintDataBits) | (value.high << (64 - VarintDataBits));
+            value.high >>= VarintDataBits;
+        }
+        output.push_back(uint8_t(value.low));
+    }
+
+    /// @brief Reads a varint written by writeVarint. Throws std::runtime_error if it runs past the end of its block.
+    packedPosition readVarint(const unsigned char*& at, const unsigned char* end)
+    {
+        packedPosition value{0, 0};
+        for (int shift = 0; shift < 128; shift += VarintDataBits)
+        {
+            if (at == end) { break; }
+            uint64_t data = *at & VarintDataMask;
+            if (shift < 64)
+            {
+                value.low |= data << shift;
+                // the bits that did not fit in the low word.
+                if (shift > 64 - VarintDataBits) { value.high |= data >> (64 - shift); }
+            }
+            else
+            {
+                value.high |= data << (shift - 64);
+            }
+            if ((*at++ & VarintMoreBit) == 0) { return value; }
+        }
+        throw std::runtime_error("Compressed brain block is corrupt");
+    }
+}
+
+const char CompressedBrain::CompressedBrainMagic[8] = {'U', '3', 'T', 'B', 'R', 'A', 'I', 'Z'};
+
+void CompressedBrain::init()
+{
+    validate();
+    header_ = reinterpret_cast<const compressedBrainHeader*>(file_.data());
+    samples_ = reinterpret_cast<const blockSample*>(file_.data() + header_->samplesOffset);
+    blocks_ = file_.data() + header_->blocksOffset;
+}
+
+void CompressedBrain::validate() const
+{
+    size_t size = file_.size();
+    if (size < sizeof(compressedBrainHeader)) { throw std::runtime_error("Compressed brain file is too small to hold a header"); }
+    const compressedBrainHeader& header = *reinterpret_cast<const compressedBrainHeader*>(file_.data());
+    if (memcmp(header.magic, CompressedBrainMagic, sizeof(CompressedBrainMagic)) != 0) { throw std::runtime_error("File is not a compressed brain file"); }
+    if (header.version != CompressedBrainVersion) { throw std::runtime_error("Compressed brain file version is not supported"); }
+    if (header.blockSize == 0 or header.blockCount != (header.recordCount + header.blockSize - 1) / header.blockSize)
+    {
+        throw std::runtime_error("Compressed brain file blocks do not match its records");
+    }
+    // the samples are read in place, so they must be aligned for the words in them.
+    if (header.samplesOffset % alignof(blockSample) != 0) { throw std::runtime_error("Compressed brain file samples are not aligned"); }
+    // dividing rather than multiplying so that huge counts can not overflow.
+    if (header.samplesOffset > size or header.blockCount > (size - header.samplesOffset) / sizeof(blockSample))
+    {
+        throw std::runtime_error("Compressed brain file samples run past the end of the file");
+    }
+    if (header.blocksOffset > size or header.blocksBytes > size - header.blocksOffset)
+    {
+        throw std::runtime_error("Compressed brain file blocks run past the end of the file");
+    }
+}
+
+CompressedBrain::CompressedBrain(const std::string& path) : file_(path)
+{
+    init();
+}
+
+void CompressedBrain::write(std::ostream& output, const std::vector<brainRecord>& records, uint32_t blockSize)
+{
+    if (blockSize == 0) { throw std::invalid_argument("Compressed brain blocks must hold at least one record"); }
+    for (size_t i = 1; i < records.size(); i++)
+    {
+        if (!(records[i - 1].key < records[i].key))
+        {
+            throw std::invalid_argument("Brain records must be sorted by key with no key repeated");
+        }
+    }
+
+    std::vector<blockSample> samples;
+    std::vector<unsigned char> blocks;
+    for (size_t first = 0; first < records.size(); first += blockSize)
+    {
+        size_t count = std::min(records.size() - first, size_t(blockSize));
+        samples.push_back(blockSample{records[first].key, blocks.size()});
+
+        // the values, packed end to end starting from the lowest bit.
+        size_t valuesStart = blocks.size();
+        blocks.resize(valuesStart + valueBytes(count), 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint16_t value = packValue(records[first + i]);
+            size_t bit = i * ValueBits;
+            blocks[valuesStart + bit / 8] |= uint8_t(value << (bit % 8));
+            blocks[valuesStart + bit / 8 + 1] |= uint8_t(value >> (8 - bit % 8));
+        }
+
+        for (size_t i = 1; i < count; i++)
+        {
+            writeVarint(blocks, keyGap(records[first + i - 1].key, records[first + i].key));
+        }
+    }
+
+    compressedBrainHeader header{};
+    memcpy(header.magic, CompressedBrainMagic, sizeof(CompressedBrainMagic));
+    header.version = CompressedBrainVersion;
+    header.blockSize = blockSize;
+    header.recordCount = records.size();
+    header.blockCount = samples.size();
+    header.samplesOffset = sizeof(compressedBrainHeader);
+    header.blocksOffset = header.samplesOffset + samples.size() * sizeof(blockSample);
+    header.blocksBytes = blocks.size();
+
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(blockSample));
+    output.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+    if (!output) { throw std::runtime_error("Could not write compressed brain file"); }
+}
+
+bool CompressedBrain::find(const packedPosition& key, uint16_t& value) const
+{
+    const blockSample* samplesEnd = samples_ + header_->blockCount;
+    const blockSample* sample = std::upper_bound(samples_, samplesEnd, key, [](const packedPosition& target, const blockSample& block) { return target < block.firstKey; });
+    if (sample == samples_) { return false; }
+    sample--;
+
+    size_t blockNumber = size_t(sample - samples_);
+    size_t count = std::min(size_t(header_->recordCount - blockNumber * header_->blockSize), size_t(header_->blockSize));
+    uint64_t blockEnd = sample + 1 == samplesEnd ? header_->blocksBytes : (sample + 1)->offset;
+    if (sample->offset > blockEnd or blockEnd > header_->blocksBytes or valueBytes(count) > blockEnd - sample->offset)
+    {
+        throw std::runtime_error("Compressed brain block is corrupt");
+    }
+    const unsigned char* values = blocks_ + sample->offset;
+    const unsigned char* at = values + valueBytes(count);
+    const unsigned char* end = blocks_ + blockEnd;
+
+    // walk the keys of the block until reaching or passing the key.
+    size_t i = 0;
+    packedPosition current = sample->firstKey;
+    while (current < key)
+    {
+        if (++i == count) { return false; }
+        current = addGap(current, readVarint(at, end));
+    }
+    if (current != key) { return false; }
+
+    size_t bit = i * ValueBits;
+    value = ((values[bit / 8] | (values[bit / 8 + 1] << 8)) >> (bit % 8)) & ValueMask;
+    return true;
+}
+
+bool CompressedBrain::lookup(const Ultimate3TState& state, evaluationValue& evaluation, move& bestMove) const
+{
+    int symmetry = state.canonicalSymmetry();
+    uint16_t value;
+    if (!find(state.toPackedPosition(symmetry), value)) { return false; }
+    evaluation = evaluationValue(player(value & ValuePlayerMask), 0);
+    int moveIndex = value >> ValueMoveShift;
+    move canonicalMove(activeBoard(moveIndex / 9), uint8_t(moveIndex % 9));
+    bestMove = Ultimate3TState::transformMove(canonicalMove, Ultimate3TState::inverseSymmetry(symmetry));
+    return true;
+}
+
+move CompressedBrain::bestMove(const Ultimate3TState& state) const
+{
+    evaluationValue evaluation;
+    move found;
+    if (!lookup(state, evaluation, found))
+    {
+        throw std::out_of_range("State is not in the brain");
+    }
+    return found;
+}
+
+size_t CompressedBrain::size() const
+{
+    return size_t(header_->recordCount);
+}
@@ -0,0 +1,147 @@
+#include "ProofNumberSearch.h"
+
+namespace
+{
+    const size_t BytesPerMegabyte = 1024 * 1024;
+
+    // Two groups for each bit of work, unsolved and solved.
+    const int GarbageGroups = 64;
+}
+
+///// proofNumbers definitions /////
+
+bool proofNumbers::isProven() const { return proof == 0; }
+
+bool proofNumbers::isDisproven() const { return disproof == 0; }
+
+bool proofNumbers::isSolved() const { return isProven() or isDisproven(); }
+
+proofNumbers proofNumbers::unknown() { return proofNumbers{1, 1}; }
+
+proofNumbers proofNumbers::proven() { return proofNumbers{0, Infinite}; }
+
+proofNumbers proofNumbers::disproven() { return proofNumbers{Infinite, 0}; }
+
+///// ProofNumberTable definitions /////
+
+ProofNumberTable::ProofNumberTable()
+{
+    resize(DefaultMegabytes);
+}
+
+ProofNumberTable::ProofNumberTable(size_t megabytes)
+{
+    resize(megabytes);
+}
+
+void ProofNumberTable::resize(size_t megabytes)
+{
+    // round the number of buckets down to a power of two, but always have at least one.
+    size_t budgetBuckets = megabytes * BytesPerMegabyte / (BucketSize * sizeof(tableEntry));
+    bucketCount_ = 1;
+    while (bucketCount_ * 2 <= budgetBuckets) { bucketCount_ *= 2; }
+    entries_ = std::vector<tableEntry>(bucketCount_ * BucketSize, tableEntry{0, 0, 0, 0});
+    size_ = 0;
+    collections_ = 0;
+}
+
+void ProofNumberTable::clear()
+{
+    std::fill(entries_.begin(), entries_.end(), tableEntry{0, 0, 0, 0});
+    size_ = 0;
+}
+
+int ProofNumberTable::garbageGroup(const tableEntry& entry)
+{
+    int workBits = 0;
+    while (workBits < 31 and (entry.work >> (workBits + 1)) != 0) { workBits++; }
+    bool solved = entry.proof == 0 or entry.disproof == 0;
+    return workBits * 2 + int(solved);
+}
+
+bool ProofNumberTable::probe(uint64_t key, proofNumbers& numbers, uint32_t& work) const
+{
+    const tableEntry* bucket = &entries_[(key & (bucketCount_ - 1)) * BucketSize];
+    for (int i = 0; i < BucketSize; i++)
+    {
+        if (bucket[i].work != 0 and bucket[i].key == key)
+        {
+            numbers = proofNumbers{bucket[i].proof, bucket[i].disproof};
+            work = bucket[i].work;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ProofNumberTable::store(uint64_t key, const proofNumbers& numbers, uint32_t work)
+{
+    if (size_ * 100 >= getCapacity() * GarbageThreshold) { collectGarbage(); }
+
+    tableEntry* bucket = &entries_[(key & (bucketCount_ - 1)) * BucketSize];
+    tableEntry* replace = nullptr;
+    for (int i = 0; i < BucketSize and replace == nullptr; i++)
+    {
+        // an entry for the same state, or an empty entry, is always taken.
+        if (bucket[i].key == key or bucket[i].work == 0) { replace = &bucket[i]; }
+    }
+    if (replace == nullptr)
+    {
+        // otherwise the entry that would be thrown away first by garbage collection is.
+        replace = &bucket[0];
+        for (int i = 1; i < BucketSize; i++)
+        {
+            if (garbageGroup(bucket[i]) < garbageGroup(*replace)) { replace = &bucket[i]; }
+        }
+        size_--;
+    }
+    else if (replace->work != 0 and replace->key == key) { size_--; }
+    *replace = tableEntry{key, numbers.proof, numbers.disproof, std::max(work, 1u)};
+    size_++;
+}
+
+void ProofNumberTable::collectGarbage()
+{
+    // count the entries in each group, and find the group at which half of the entries have been counted.
+    size_t groupSizes[GarbageGroups] = {};
+    for (const tableEntry& entry : entries_)
+    {
+        if (entry.work != 0) { groupSizes[garbageGroup(entry)]++; }
+    }
+    size_t toRemove = (size_ + 1) / 2;
+    int lastGroup = 0;
+    size_t counted = groupSizes[0];
+    while (counted < toRemove and lastGroup < GarbageGroups - 1) { counted += groupSizes[++lastGroup]; }
+
+    // every group below it is thrown away, and enough of it to make half.
+    size_t lastGroupToRemove = toRemove - (counted - groupSizes[lastGroup]);
+    for (tableEntry& entry : entries_)
+    {
+        if (entry.work == 0) { continue; }
+        int group = garbageGroup(entry);
+        if (group > lastGroup) { continue; }
+        if (group == lastGroup)
+        {
+            if (lastGroupToRemove == 0) { continue; }
+            lastGroupToRemove--;
+        }
+        entry = tableEntry{0, 0, 0, 0};
+        size_--;
+    }
+    collections_++;
+}
+
+size_t ProofNumberTable::getCapacity() const
+{
+    return entries_.size();
+}
+
+size_t ProofNumberTable::size() const
+{
+    return size_;
+}
+
+unsigned int ProofNumberTable::getCollections() const
+{
+    return collections_;
+}
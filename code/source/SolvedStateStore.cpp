@@ -0,0 +1,213 @@
+#include "SolvedStateStore.h"
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+
+namespace
+{
+    const size_t BytesPerMegabyte = 1024 * 1024;
+
+    /// @brief Reads the entries of one source of a merge in order: a run on disk, or the sorted buffer.
+    struct runReader
+    {
+        /// @brief The run being read, or nullptr if the entries are all in memory.
+        std::FILE* file;
+
+        std::vector<trainerEntry> chunk;
+        const trainerEntry* next;
+        const trainerEntry* end;
+
+        /// @brief Gets the next entry, reading another chunk of the run if needed.
+        /// @return false if there are no more entries.
+        bool read(trainerEntry& entry)
+        {
+            if (next == end and file != nullptr)
+            {
+                chunk.resize(SolvedStateStore::ReadEntries);
+                size_t count = std::fread(chunk.data(), sizeof(trainerEntry), chunk.size(), file);
+                if (std::ferror(file)) { throw std::runtime_error("Could not read solved states back from disk"); }
+                next = chunk.data();
+                end = chunk.data() + count;
+            }
+            if (next == end) { return false; }
+            entry = *next++;
+            return true;
+        }
+    };
+
+    /// @brief The next entry of one source of a merge.
+    struct mergeHead
+    {
+        trainerEntry entry;
+        size_t source;
+    };
+
+    /// @brief Orders a priority queue so that the smallest position comes out first, and of equal positions the newest source.
+    struct mergeHeadAfter
+    {
+        bool operator()(const mergeHead& a, const mergeHead& b) const
+        {
+            if (a.entry.position != b.entry.position) { return b.entry.position < a.entry.position; }
+            return a.source < b.source;
+        }
+    };
+
+    void writeEntries(std::FILE* file, const trainerEntry* entries, size_t count)
+    {
+        if (std::fwrite(entries, sizeof(trainerEntry), count, file) != count)
+        {
+            throw std::runtime_error("Could not write solved states to disk");
+        }
+    }
+
+    std::FILE* createRunFile()
+    {
+        // tmpfile is removed as soon as it is closed, or the program ends.
+        std::FILE* file = std::tmpfile();
+        if (file == nullptr) { throw std::runtime_error("Could not create a temporary file for solved states"); }
+        return file;
+    }
+}
+
+SolvedStateStore::SolvedStateStore(size_t megabytes)
+{
+    resize(megabytes);
+}
+
+SolvedStateStore::~SolvedStateStore()
+{
+    closeRuns();
+}
+
+void SolvedStateStore::setBufferCapacity(size_t entries)
+{
+    bufferCapacity_ = std::max(entries, size_t(1));
+    if (buffer_.size() >= bufferCapacity_) { writeRun(); }
+}
+
+void SolvedStateStore::resize(size_t megabytes)
+{
+    setBufferCapacity(std::max(megabytes * BytesPerMegabyte / sizeof(trainerEntry), MinimumBufferEntries));
+}
+
+void SolvedStateStore::add(const trainerEntry& entry)
+{
+    // the buffer is given its whole budget up front, rather than growing past it by doubling.
+    if (buffer_.empty()) { buffer_.reserve(bufferCapacity_); }
+    buffer_.push_back(entry);
+    if (buffer_.size() >= bufferCapacity_) { writeRun(); }
+}
+
+void SolvedStateStore::sortBuffer()
+{
+    // reversed and sorted stably so that the last time a state was solved is the one kept, since a state solved again by refineDepthToWin() has gained its depth.
+    std::reverse(buffer_.begin(), buffer_.end());
+    std::stable_sort(buffer_.begin(), buffer_.end(), [](const trainerEntry& a, const trainerEntry& b) { return a.position < b.position; });
+    auto last = std::unique(buffer_.begin(), buffer_.end(), [](const trainerEntry& a, const trainerEntry& b) { return a.position == b.position; });
+    buffer_.erase(last, buffer_.end());
+}
+
+void SolvedStateStore::writeRun()
+{
+    sortBuffer();
+    std::FILE* file = createRunFile();
+    try
+    {
+        writeEntries(file, buffer_.data(), buffer_.size());
+    }
+    catch (...)
+    {
+        std::fclose(file);
+        throw;
+    }
+    runs_.push_back(file);
+    buffer_.clear();
+    if (runs_.size() > MaxRuns) { mergeRuns(); }
+}
+
+void SolvedStateStore::mergeRuns()
+{
+    std::FILE* file = createRunFile();
+    // entries are written a chunk at a time, so the merge takes no more memory than reading the runs does.
+    std::vector<trainerEntry> chunk;
+    chunk.reserve(ReadEntries);
+    try
+    {
+        merge(false, [file, &chunk](const trainerEntry& entry)
+        {
+            chunk.push_back(entry);
+            if (chunk.size() == ReadEntries)
+            {
+                writeEntries(file, chunk.data(), chunk.size());
+                chunk.clear();
+            }
+        });
+        writeEntries(file, chunk.data(), chunk.size());
+    }
+    catch (...)
+    {
+        std::fclose(file);
+        throw;
+    }
+    // the merged run is older than anything still in the buffer, as every run was.
+    closeRuns();
+    runs_.push_back(file);
+}
+
+void SolvedStateStore::merge(bool includeBuffer, const std::function<void(const trainerEntry&)>& visit)
+{
+    std::vector<runReader> readers;
+    for (std::FILE* file : runs_)
+    {
+        std::rewind(file);
+        readers.push_back(runReader{file, std::vector<trainerEntry>(), nullptr, nullptr});
+    }
+    if (includeBuffer)
+    {
+        sortBuffer();
+        readers.push_back(runReader{nullptr, std::vector<trainerEntry>(), buffer_.data(), buffer_.data() + buffer_.size()});
+    }
+
+    // sources are numbered from the oldest to the newest, so of the entries for one position the first to come out of the queue is the newest, and the rest are skipped.
+    std::priority_queue<mergeHead, std::vector<mergeHead>, mergeHeadAfter> heads;
+    for (size_t source = 0; source < readers.size(); source++)
+    {
+        mergeHead head{trainerEntry(), source};
+        if (readers[source].read(head.entry)) { heads.push(head); }
+    }
+    bool visitedAny = false;
+    packedPosition lastPosition{0, 0};
+    while (!heads.empty())
+    {
+        mergeHead head = heads.top();
+        heads.pop();
+        if (!visitedAny or head.entry.position != lastPosition)
+        {
+            visit(head.entry);
+            visitedAny = true;
+            lastPosition = head.entry.position;
+        }
+        if (readers[head.source].read(head.entry)) { heads.push(head); }
+    }
+}
+
+void SolvedStateStore::forEach(const std::function<void(const trainerEntry&)>& visit)
+{
+    merge(true, visit);
+}
+
+void SolvedStateStore::closeRuns()
+{
+    for (std::FILE* file : runs_) { std::fclose(file); }
+    runs_.clear();
+}
+
+void SolvedStateStore::clear()
+{
+    closeRuns();
+    buffer_ = std::vector<trainerEntry>();
+}
+
+size_t SolvedStateStore::getBufferCapacity() const { return bufferCapacity_; }
+
+size_t SolvedStateStore::getRunCount() const { return runs_.size(); }
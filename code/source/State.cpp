@@ -1,130 +1,514 @@
 #include "State.h"
 #include <stdexcept>
-#include <math.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-///// move struct definitions /////
+///// board result lookup table /////
 
-void move::init(activeBoard moveBoard, uint8_t moveSpace)
+namespace
 {
-    if (moveBoard > activeBoard::board8 or moveSpace > 8) 
+    /// @brief Number of possible masks of a 3x3 grid.
+    constexpr int GridMaskCount = 512;
+
+    /// @brief Each win combination as a mask of the spaces it covers.
+    constexpr uint16_t WinLines[8] = 
     {
-        throw std::out_of_range("Tried to create move outside of board");
+        // horizontal triplets
+        0b000000111, 0b000111000, 0b111000000,
+        // vertical triplets
+        0b001001001, 0b010010010, 0b100100100,
+        // diagonals
+        0b100010001, 0b001010100
+    };
+
+    /// @brief Builds a table of which masks of a 3x3 grid contain a full win line.
+    constexpr std::array<bool, GridMaskCount> generateWinTable()
+    {
+        std::array<bool, GridMaskCount> table{};
+        for (int mask = 0; mask < GridMaskCount; mask++)
+        {
+            for (uint16_t line : WinLines)
+            {
+                if ((mask & line) == line) { table[mask] = true; }
+            }
+        }
+        return table;
     }
-    board = moveBoard;
-    space = moveSpace;
+
+    constexpr std::array<bool, GridMaskCount> WinTable = generateWinTable();
+
+    /// @brief Builds the result of every 3x3 grid, indexed by [x mask][o mask]. x is checked first so a grid where both players have a line counts as an x win.
+    constexpr std::array<std::array<player, GridMaskCount>, GridMaskCount> generateBoardResultTable()
+    {
+        std::array<std::array<player, GridMaskCount>, GridMaskCount> table{};
+        for (int x = 0; x < GridMaskCount; x++)
+        {
+            for (int o = 0; o < GridMaskCount; o++)
+            {
+                if (WinTable[x]) { table[x][o] = player::x; }
+                else if (WinTable[o]) { table[x][o] = player::o; }
+                else if ((x | o) == GridMaskCount - 1) { table[x][o] = player::draw; }
+                else { table[x][o] = player::neither; }
+            }
+        }
+        return table;
+    }
+
+    /// @brief Result of a 3x3 grid, used for both the sub-boards and the super board so that checking a board costs a single load.
+    constexpr std::array<std::array<player, GridMaskCount>, GridMaskCount> BoardResultTable = generateBoardResultTable();
 }
 
-move::move()
+///// Zobrist keys /////
+
+namespace
 {
-    init(activeBoard::board0, 0);
+    /// @brief Random keys XORed together to make the hash of a state. Each table is indexed by the player enum, and the key for player::neither is 0 so that empty spaces add nothing.
+    struct zobristKeys
+    {
+        uint64_t spaces[81][4];
+        uint64_t superBoard[9][4];
+        uint64_t activeBoards[16];
+        uint64_t activePlayers[4];
+    };
+
+    /// @brief splitmix64, a small generator that is good enough for hash keys and can run at compile time.
+    constexpr uint64_t nextRandom(uint64_t& seed)
+    {
+        seed += 0x9E3779B97F4A7C15ull;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    constexpr zobristKeys generateZobristKeys()
+    {
+        zobristKeys keys{};
+        uint64_t seed = 0x5533A1E7u;
+        for (int space = 0; space < 81; space++)
+        {
+            for (int who = player::draw; who <= player::x; who++) { keys.spaces[space][who] = nextRandom(seed); }
+        }
+        for (int board = 0; board < 9; board++)
+        {
+            for (int who = player::draw; who <= player::x; who++) { keys.superBoard[board][who] = nextRandom(seed); }
+        }
+        for (int board = 0; board < 16; board++) { keys.activeBoards[board] = nextRandom(seed); }
+        for (int who = 0; who < 4; who++) { keys.activePlayers[who] = nextRandom(seed); }
+        return keys;
+    }
+
+    constexpr zobristKeys ZobristKeys = generateZobristKeys();
 }
 
-move::move(activeBoard moveBoard, uint8_t moveSpace) 
+///// Symmetry tables /////
+
+namespace
 {
-    init(moveBoard, moveSpace);
+    constexpr int SymmetryCount = Ultimate3TState::SymmetryCount;
+
+    /// @brief Where a space of a 3x3 grid ends up under each symmetry. In order: identity, the three clockwise rotations, then the reflections across the vertical middle, the horizontal middle, the main diagonal and the anti diagonal.
+    constexpr int symmetricIndex(int symmetry, int index)
+    {
+        int row = index / 3;
+        int column = index % 3;
+        switch (symmetry)
+        {
+        case 1: return column * 3 + (2 - row);
+        case 2: return (2 - row) * 3 + (2 - column);
+        case 3: return (2 - column) * 3 + row;
+        case 4: return row * 3 + (2 - column);
+        case 5: return (2 - row) * 3 + column;
+        case 6: return column * 3 + row;
+        case 7: return (2 - column) * 3 + (2 - row);
+        default: return index;
+        }
+    }
+
+    struct symmetryTables
+    {
+        /// @brief The space of the whole board, board * 9 + space, that each space moves to.
+        uint8_t spaces[SymmetryCount][81];
+
+        /// @brief Each grid mask with its bits moved, so a whole grid is transformed with one load.
+        uint16_t masks[SymmetryCount][GridMaskCount];
+
+        /// @brief The symmetry that undoes each symmetry.
+        uint8_t inverses[SymmetryCount];
+    };
+
+    constexpr symmetryTables generateSymmetryTables()
+    {
+        symmetryTables tables{};
+        for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+        {
+            for (int board = 0; board < 9; board++)
+            {
+                for (int space = 0; space < 9; space++)
+                {
+                    tables.spaces[symmetry][board * 9 + space] = uint8_t(symmetricIndex(symmetry, board) * 9 + symmetricIndex(symmetry, space));
+                }
+            }
+            for (int mask = 0; mask < GridMaskCount; mask++)
+            {
+                for (int space = 0; space < 9; space++)
+                {
+                    if (mask & (1 << space)) { tables.masks[symmetry][mask] |= uint16_t(1 << symmetricIndex(symmetry, space)); }
+                }
+            }
+            for (int inverse = 0; inverse < SymmetryCount; inverse++)
+            {
+                bool undoes = true;
+                for (int space = 0; space < 9; space++)
+                {
+                    if (symmetricIndex(inverse, symmetricIndex(symmetry, space)) != space) { undoes = false; }
+                }
+                if (undoes) { tables.inverses[symmetry] = uint8_t(inverse); }
+            }
+        }
+        return tables;
+    }
+
+    constexpr symmetryTables SymmetryTables = generateSymmetryTables();
+
+    /// @brief The active board a symmetry moves an active board to. Any board stays any board.
+    activeBoard symmetricActiveBoard(int symmetry, activeBoard board)
+    {
+        if (board == activeBoard::anyBoard) { return board; }
+        return activeBoard(symmetricIndex(symmetry, board));
+    }
+
+    /// @brief Transforms every mask of a grid.
+    bitBoard symmetricBitBoard(int symmetry, const bitBoard& grid)
+    {
+        bitBoard result;
+        result.x = SymmetryTables.masks[symmetry][grid.x];
+        result.o = SymmetryTables.masks[symmetry][grid.o];
+        result.draw = SymmetryTables.masks[symmetry][grid.draw];
+        return result;
+    }
 }
 
-move::move(uint8_t binary)
+///// Position packing tables /////
+
+namespace
 {
-    init(activeBoard(binary >> 4), binary & 0b1111);
+    /// @brief The number of ways to fill a 3x3 grid with x's, o's and empty spaces.
+    constexpr int TernaryGridCount = 19683;
+
+    /// @brief The number of fillings of an undecided board: no line for either player, and at least one space empty.
+    constexpr int UndecidedBoardCount = 11093;
+
+    /// @brief The number of packings of a decided board. Only which spaces are filled and who decided the board are kept.
+    constexpr int DecidedBoardCount = 3 * GridMaskCount;
+
+    /// @brief The number of packings of one board. A position is 9 of these, plus the active board and active player, in a mixed radix.
+    constexpr uint64_t BoardCodeCount = UndecidedBoardCount + DecidedBoardCount;
+
+    /// @brief The value of 4 boards packed together. Each word holds 4 boards, with part of the middle board's packing above them.
+    constexpr uint64_t FourBoardCodeCount = BoardCodeCount * BoardCodeCount * BoardCodeCount * BoardCodeCount;
+
+    /// @brief The middle board, the active board and the active player together, which is split between the two words.
+    constexpr int MiddleFieldBits = 9;
+    constexpr uint32_t MiddleFieldLowMask = (1 << MiddleFieldBits) - 1;
+
+    /// @brief Marks a ternary filling that is not an undecided board.
+    constexpr uint16_t InvalidCode = 0xFFFF;
+
+    /// @brief What a board code unpacks to.
+    struct packedBoard
+    {
+        uint16_t x;
+        uint16_t o;
+        uint16_t draw;
+        player result;
+    };
+
+    struct packingTables
+    {
+        /// @brief The mask's bits read as base 3 digits, so that ternary[x] + 2 * ternary[o] numbers a filling.
+        uint16_t ternary[GridMaskCount];
+
+        /// @brief The code of each ternary filling of an undecided board, or InvalidCode.
+        uint16_t undecidedCodes[TernaryGridCount];
+
+        /// @brief The board each code unpacks to.
+        packedBoard boards[BoardCodeCount];
+
+        /// @brief How many undecided boards were found, to check UndecidedBoardCount against.
+        int undecidedCount;
+    };
+
+    constexpr packingTables generatePackingTables()
+    {
+        packingTables tables{};
+        for (int mask = 0; mask < GridMaskCount; mask++)
+        {
+            int power = 1;
+            for (int space = 0; space < 9; space++)
+            {
+                if (mask & (1 << space)) { tables.ternary[mask] += uint16_t(power); }
+                power *= 3;
+            }
+        }
+        for (int filling = 0; filling < TernaryGridCount; filling++) { tables.undecidedCodes[filling] = InvalidCode; }
+        int code = 0;
+        for (int x = 0; x < GridMaskCount; x++)
+        {
+            for (int o = 0; o < GridMaskCount; o++)
+            {
+                if ((x & o) == 0 and BoardResultTable[x][o] == player::neither)
+                {
+                    tables.undecidedCodes[tables.ternary[x] + 2 * tables.ternary[o]] = uint16_t(code);
+                    tables.boards[code] = packedBoard{uint16_t(x), uint16_t(o), 0, player::neither};
+                    code++;
+                }
+            }
+        }
+        tables.undecidedCount = code;
+        // decided boards follow, grouped by result in the order x, o, draw. Their filled spaces unpack as draws.
+        for (int result = 0; result < 3; result++)
+        {
+            for (int filled = 0; filled < GridMaskCount; filled++)
+            {
+                tables.boards[UndecidedBoardCount + result * GridMaskCount + filled] = packedBoard{0, 0, uint16_t(filled), player(player::x - result)};
+            }
+        }
+        return tables;
+    }
+
+    constexpr packingTables PackingTables = generatePackingTables();
+
+    /// @brief Gives the code of a board's packing after each symmetry, so a packed position can be transformed without packing it again.
+    struct symmetricCodeTables
+    {
+        uint16_t codes[SymmetryCount][BoardCodeCount];
+    };
+
+    constexpr symmetricCodeTables generateSymmetricCodeTables()
+    {
+        symmetricCodeTables tables{};
+        for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+        {
+            for (uint64_t code = 0; code < BoardCodeCount; code++)
+            {
+                const packedBoard& board = PackingTables.boards[code];
+                uint16_t x = SymmetryTables.masks[symmetry][board.x];
+                uint16_t o = SymmetryTables.masks[symmetry][board.o];
+                uint16_t filled = SymmetryTables.masks[symmetry][board.draw];
+                tables.codes[symmetry][code] = board.result == player::neither
+                    ? PackingTables.undecidedCodes[PackingTables.ternary[x] + 2 * PackingTables.ternary[o]]
+                    : uint16_t(UndecidedBoardCount + (player::x - board.result) * GridMaskCount + filled);
+            }
+        }
+        return tables;
+    }
+
+    constexpr symmetricCodeTables SymmetricCodeTables = generateSymmetricCodeTables();
+
+    /// @brief Packs the codes of the 9 boards, the active board, 0 to 8 or 9 for any board, and whether o is to play into two words.
+    packedPosition packCodes(const uint32_t codes[9], uint64_t activeIndex, bool oToPlay)
+    {
+        uint64_t middleField = (uint64_t(codes[4]) * 10 + activeIndex) * 2 + oToPlay;
+        packedPosition position;
+        position.low = codes[0] + BoardCodeCount * (codes[1] + BoardCodeCount * (codes[2] + BoardCodeCount * (codes[3] + BoardCodeCount * (middleField & MiddleFieldLowMask))));
+        position.high = codes[5] + BoardCodeCount * (codes[6] + BoardCodeCount * (codes[7] + BoardCodeCount * (codes[8] + BoardCodeCount * (middleField >> MiddleFieldBits))));
+        return position;
+    }
+
+    static_assert(PackingTables.undecidedCount == UndecidedBoardCount, "UndecidedBoardCount does not match the number of undecided boards");
+    static_assert(MiddleFieldLowMask + 1 <= UINT64_MAX / FourBoardCodeCount, "The low word overflows");
+    static_assert(((BoardCodeCount * 20 - 1) >> MiddleFieldBits) + 1 <= UINT64_MAX / FourBoardCodeCount, "The high word overflows");
 }
 
-uint8_t move::toBinary() const
+///// Bit helpers /////
+
+namespace
 {
-    return (board << 4) + space;
+    /// @brief The index of the lowest set bit of a mask, which must not be 0.
+    inline int lowestSetBit(uint16_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return int(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    /// @brief The number of set bits in a mask.
+    inline int countSetBits(uint16_t mask)
+    {
+#ifdef _MSC_VER
+        return int(__popcnt16(mask));
+#else
+        return __builtin_popcount(mask);
+#endif
+    }
+
+    /// @brief Adds a move for every empty space of a board, visiting only the set bits of the empty mask.
+    inline void addMoves(moveList& legalMoves, activeBoard board, uint16_t empty)
+    {
+        while (empty)
+        {
+            legalMoves.add(board, uint8_t(lowestSetBit(empty)));
+            empty &= empty - 1; // clear the lowest set bit.
+        }
+    }
 }
 
-///// evaluationValue definitions /////
+///// Heuristic evaluation /////
 
-void evaluationValue::init(player toWin, int depthToWin)
+namespace
 {
-    playerToWin = toWin;
-    depth = depthToWin;
+    // Weights of the heuristic score. A sub-board is worth more than anything on it, and a line of the super board more than a sub-board.
+    const int SubBoardTwoInARow = 4;
+    const int SubBoardCenter = 3;
+    const int SubBoardCorner = 1;
+    const int WonBoard = 25;
+    const int SuperBoardTwoInARow = 40;
+    const int SuperBoardCenter = 15;
+    const int SuperBoardCorner = 8;
+    const int FreeChoice = 15;
+    const int SentToWinnableBoard = 10;
+
+    const uint16_t CenterMask = 0b000010000;
+    const uint16_t CornerMask = 0b101000101;
+
+    /// @brief Builds a table of the win lines, as a mask of their indices in WinLines, that a mask of a 3x3 grid holds exactly two spaces of.
+    constexpr std::array<uint8_t, GridMaskCount> generateTwoLineTable()
+    {
+        std::array<uint8_t, GridMaskCount> table{};
+        for (int mask = 0; mask < GridMaskCount; mask++)
+        {
+            for (int line = 0; line < 8; line++)
+            {
+                int held = 0;
+                for (int space = 0; space < 9; space++)
+                {
+                    if (mask & WinLines[line] & (1 << space)) { held++; }
+                }
+                if (held == 2) { table[mask] |= uint8_t(1 << line); }
+            }
+        }
+        return table;
+    }
+
+    /// @brief Builds a table of the win lines that a mask of a 3x3 grid holds any space of.
+    constexpr std::array<uint8_t, GridMaskCount> generateTouchedLineTable()
+    {
+        std::array<uint8_t, GridMaskCount> table{};
+        for (int mask = 0; mask < GridMaskCount; mask++)
+        {
+            for (int line = 0; line < 8; line++)
+            {
+                if (mask & WinLines[line]) { table[mask] |= uint8_t(1 << line); }
+            }
+        }
+        return table;
+    }
+
+    constexpr std::array<uint8_t, GridMaskCount> TwoLineTable = generateTwoLineTable();
+    constexpr std::array<uint8_t, GridMaskCount> TouchedLineTable = generateTouchedLineTable();
+
+    /// @brief The number of lines a player holds two spaces of where the third is empty, so they can take the line with one more move.
+    inline int openTwoInARows(uint16_t own, uint16_t blocked)
+    {
+        return countSetBits(TwoLineTable[own] & ~TouchedLineTable[blocked]);
+    }
+
+    /// @brief Scores a sub-board that is still being played for one player.
+    inline int subBoardSideScore(uint16_t own, uint16_t blocked)
+    {
+        return SubBoardTwoInARow * openTwoInARows(own, blocked) + SubBoardCenter * countSetBits(own & CenterMask) + SubBoardCorner * countSetBits(own & CornerMask);
+    }
+
+    /// @brief Scores the super board for one player, whose spaces are the sub-boards they won.
+    inline int superBoardSideScore(uint16_t own, uint16_t blocked)
+    {
+        return WonBoard * countSetBits(own) + SuperBoardTwoInARow * openTwoInARows(own, blocked) + SuperBoardCenter * countSetBits(own & CenterMask) + SuperBoardCorner * countSetBits(own & CornerMask);
+    }
+
+    /// @brief Scores a grid for player x, counting spaces marked as a draw as blocking both players.
+    inline int gridScore(const bitBoard& grid, int (*sideScore)(uint16_t, uint16_t))
+    {
+        return sideScore(grid.x, grid.o | grid.draw) - sideScore(grid.o, grid.x | grid.draw);
+    }
 }
 
-evaluationValue::evaluationValue()
+///// move struct definitions /////
+
+void move::init(activeBoard moveBoard, uint8_t moveSpace)
 {
-    init(player::neither, 0);
+    if (moveBoard > activeBoard::board8 or moveSpace > 8) 
+    {
+        throw std::out_of_range("Tried to create move outside of board");
+    }
+    board = moveBoard;
+    space = moveSpace;
 }
 
-evaluationValue::evaluationValue(player toWin, int depthToWin)
+move::move(activeBoard moveBoard, uint8_t moveSpace) 
 {
-    init(toWin, depthToWin);
+    init(moveBoard, moveSpace);
 }
 
-bool evaluationValue::operator==(const evaluationValue& other) const
+move::move(uint8_t binary)
 {
-    return playerToWin == other.playerToWin && depth == other.depth;
+    init(activeBoard(binary >> 4), binary & 0b1111);
 }
 
-bool evaluationValue::operator!=(const evaluationValue& other) const
+uint8_t move::toBinary() const
 {
-    return !(*this == other);
+    return (board << 4) + space;
 }
 
-bool evaluationValue::operator>(const evaluationValue& other) const
+///// bitBoard definitions /////
+
+bitBoard::bitBoard()
 {
-    int value, othersValue;
-    // check that Depth is within acceptable range, 0 to 81 inclusive.
-    if (0 > depth or depth > 81 or 0 > other.depth or other.depth > 81)
-    { 
-        throw std::invalid_argument("Passed evaluationValue with invalid depth");
-    }
+    x = 0;
+    o = 0;
+    draw = 0;
+}
 
-    // determine the value of this state.
-    switch (playerToWin)
-    {
-    case player::x:
-        value = 100;
-        value -= depth;
-        break;
-    case player::o:
-        value = -100;
-        value += depth;
-        break;
-    case player::draw:
-        value = 0;
-        break;
-    case player::neither:
-        throw std::invalid_argument("Passed indeterminant evaluationValue into comparison");
-        break;
-    }
+player bitBoard::get(int space) const
+{
+    uint16_t spaceMask = 1 << space;
+    if (x & spaceMask) { return player::x; }
+    if (o & spaceMask) { return player::o; }
+    if (draw & spaceMask) { return player::draw; }
+    return player::neither;
+}
 
-    // determine the other's value
-    switch (other.playerToWin)
+void bitBoard::set(int space, player who)
+{
+    uint16_t spaceMask = 1 << space;
+    // clear the space before filling it so that a space only ever holds one value.
+    x &= ~spaceMask;
+    o &= ~spaceMask;
+    draw &= ~spaceMask;
+    switch (who)
     {
     case player::x:
-        othersValue = 100;
-        othersValue -= other.depth;
+        x |= spaceMask;
         break;
     case player::o:
-        othersValue = -100;
-        othersValue += other.depth;
+        o |= spaceMask;
         break;
     case player::draw:
-        othersValue = 0;
+        draw |= spaceMask;
         break;
     case player::neither:
-        throw std::invalid_argument("Passed indeterminant evaluationValue into comparison");
         break;
     }
-
-    return value > othersValue;
 }
 
-bool evaluationValue::operator>=(const evaluationValue& other) const
+uint16_t bitBoard::filled() const
 {
-    return *this > other || *this == other;
-}
-
-bool evaluationValue::operator<(const evaluationValue& other) const
-{
-    return !(*this >= other);
-}
-
-bool evaluationValue::operator<=(const evaluationValue& other) const
-{
-    return !(*this > other);
+    return x | o | draw;
 }
 
 ///// Ultimate3TState definitions /////
@@ -132,52 +516,197 @@ bool evaluationValue::operator<=(const evaluationValue& other) const
 void Ultimate3TState::init
 (
     evaluationValue eval,
-    std::vector<std::vector<player>> board, 
-    std::vector<player> superBoardResults,
     move bestMove,
     activeBoard aBoard,
     player activePlayer
 )
 {
     evaluation_ = eval;
-    board_ = board;
-    superBoardResults_ = superBoardResults;
+    board_.fill(bitBoard());
+    superBoard_ = bitBoard();
     bestMove_ = bestMove;
     activeBoard_ = aBoard;
     activePlayer_ = activePlayer;
+    hashes_ = computeHashes();
+    computeScores();
+}
+
+player Ultimate3TState::boardResults(const bitBoard& board) const
+{
+    player result = BoardResultTable[board.x][board.o];
+    // spaces marked as a draw block both players, so a board holding them is only full once they are counted too.
+    if (result == player::neither and board.filled() == FullBoardMask) { return player::draw; }
+    return result;
+}
+
+void Ultimate3TState::setSpace(int boardNumber, int spaceNumber, player whoPlayed)
+{
+    updateSpaceHashes(boardNumber, spaceNumber, foldedSpace(boardNumber, board_[boardNumber].get(spaceNumber)), foldedSpace(boardNumber, whoPlayed));
+    board_[boardNumber].set(spaceNumber, whoPlayed);
+    updateBoardScore(boardNumber);
+}
+
+void Ultimate3TState::setBoardResult(int boardNumber, player result)
+{
+    player previousResult = superBoard_.get(boardNumber);
+    // deciding or undeciding a board changes how its filled spaces are hashed.
+    if ((previousResult == player::neither) != (result == player::neither))
+    {
+        for (int space = 0; space < TicTacToeNumberOfSpaces; space++)
+        {
+            player who = board_[boardNumber].get(space);
+            if (who == player::x or who == player::o)
+            {
+                updateSpaceHashes(boardNumber, space, result == player::neither ? player::draw : who, result == player::neither ? who : player::draw);
+            }
+        }
+    }
+    updateBoardResultHashes(boardNumber, previousResult, result);
+    superBoard_.set(boardNumber, result);
+    if (previousResult != result)
+    {
+        updateSuperBoardScore();
+        updateBoardScore(boardNumber);
+    }
+}
+
+player Ultimate3TState::foldedSpace(int boardNumber, player who) const
+{
+    if (who != player::neither and superBoard_.get(boardNumber) != player::neither) { return player::draw; }
+    return who;
+}
+
+void Ultimate3TState::updateSpaceHashes(int boardNumber, int spaceNumber, player before, player after)
+{
+    int index = boardNumber * TicTacToeNumberOfSpaces + spaceNumber;
+    for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+    {
+        const uint64_t* keys = ZobristKeys.spaces[SymmetryTables.spaces[symmetry][index]];
+        hashes_[symmetry] ^= keys[before] ^ keys[after];
+    }
+}
+
+void Ultimate3TState::updateBoardResultHashes(int boardNumber, player before, player after)
+{
+    for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+    {
+        const uint64_t* keys = ZobristKeys.superBoard[symmetricIndex(symmetry, boardNumber)];
+        hashes_[symmetry] ^= keys[before] ^ keys[after];
+    }
+}
+
+void Ultimate3TState::updateActiveBoardHashes(activeBoard before, activeBoard after)
+{
+    for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+    {
+        hashes_[symmetry] ^= ZobristKeys.activeBoards[symmetricActiveBoard(symmetry, before)] ^ ZobristKeys.activeBoards[symmetricActiveBoard(symmetry, after)];
+    }
 }
 
-player Ultimate3TState::boardResults(std::vector<player> board) const
+void Ultimate3TState::updateActivePlayerHashes(player before, player after)
 {
-    // check each possible win combination for x and o
-    for( int check = player::x, i = 0; i < 2; check = player::o, i++)
+    // the active player is the same in every variant.
+    uint64_t change = ZobristKeys.activePlayers[before] ^ ZobristKeys.activePlayers[after];
+    for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
     {
-        if (
-            // horizontal triplets
-            (board[0] == check and board[1] == check and board[2] == check) or
-            (board[3] == check and board[4] == check and board[5] == check) or
-            (board[6] == check and board[7] == check and board[8] == check) or
-            // vertical triplets
-            (board[0] == check and board[3] == check and board[6] == check) or
-            (board[1] == check and board[4] == check and board[7] == check) or
-            (board[2] == check and board[5] == check and board[8] == check) or
-            // diagonals
-            (board[0] == check and board[4] == check and board[8] == check) or
-            (board[2] == check and board[4] == check and board[6] == check)
-        ) { return player(check); }
+        hashes_[symmetry] ^= change;
+    }
+}
+
+std::array<uint64_t, Ultimate3TState::SymmetryCount> Ultimate3TState::computeHashes() const
+{
+    std::array<uint64_t, SymmetryCount> hashes;
+    for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+    {
+        hashes[symmetry] = ZobristKeys.activeBoards[symmetricActiveBoard(symmetry, activeBoard_)] ^ ZobristKeys.activePlayers[activePlayer_];
     }
-    // if noone has won, is the game still going?
     for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
     {
-        if (board[i] == player::neither) { return player::neither; }
+        player result = superBoard_.get(i);
+        for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+        {
+            hashes[symmetry] ^= ZobristKeys.superBoard[symmetricIndex(symmetry, i)][result];
+        }
+        // empty spaces have no key, so only the filled spaces are visited. The filled spaces of a decided board are all keyed as draws, see foldedSpace.
+        bool decided = result != player::neither;
+        const bitBoard& grid = board_[i];
+        uint16_t masks[3] = {uint16_t(decided ? 0 : grid.x), uint16_t(decided ? 0 : grid.o), uint16_t(decided ? grid.filled() : grid.draw)};
+        player owners[3] = {player::x, player::o, player::draw};
+        for (int group = 0; group < 3; group++)
+        {
+            for (uint16_t spaces = masks[group]; spaces; spaces &= spaces - 1)
+            {
+                int index = i * TicTacToeNumberOfSpaces + lowestSetBit(spaces);
+                for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+                {
+                    hashes[symmetry] ^= ZobristKeys.spaces[SymmetryTables.spaces[symmetry][index]][owners[group]];
+                }
+            }
+        }
+    }
+    return hashes;
+}
+
+void Ultimate3TState::updateBoardScore(int boardNumber)
+{
+    int16_t score = superBoard_.get(boardNumber) == player::neither ? int16_t(gridScore(board_[boardNumber], subBoardSideScore)) : int16_t(0);
+    positionalScore_ += score - boardScores_[boardNumber];
+    boardScores_[boardNumber] = score;
+}
+
+void Ultimate3TState::updateSuperBoardScore()
+{
+    int16_t score = int16_t(gridScore(superBoard_, superBoardSideScore));
+    positionalScore_ += score - superBoardScore_;
+    superBoardScore_ = score;
+}
+
+void Ultimate3TState::computeScores()
+{
+    boardScores_.fill(0);
+    superBoardScore_ = 0;
+    positionalScore_ = 0;
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++) { updateBoardScore(i); }
+    updateSuperBoardScore();
+}
+
+bool Ultimate3TState::winsBoard(move playedMove, player who) const
+{
+    // a decided board can not be won again.
+    if (superBoard_.get(playedMove.board) != player::neither) { return false; }
+    const bitBoard& grid = board_[playedMove.board];
+    uint16_t own = who == player::x ? grid.x : grid.o;
+    return WinTable[own | (1 << playedMove.space)];
+}
+
+bool Ultimate3TState::givesFreeChoice(move playedMove) const
+{
+    uint16_t filled = board_[playedMove.space].filled();
+    if (playedMove.board == playedMove.space) { filled |= 1 << playedMove.space; }
+    return filled == FullBoardMask;
+}
+
+int Ultimate3TState::heuristicScore() const
+{
+    int score = positionalScore_;
+    // being sent to any board, or to a board the player to move can take right away, is worth something to them.
+    int turnSign = activePlayer_ == player::x ? 1 : -1;
+    if (activeBoard_ == activeBoard::anyBoard) { score += turnSign * FreeChoice; }
+    else if (superBoard_.get(activeBoard_) == player::neither)
+    {
+        const bitBoard& grid = board_[activeBoard_];
+        uint16_t own = activePlayer_ == player::x ? grid.x : grid.o;
+        uint16_t blocked = grid.filled() & ~own;
+        if (openTwoInARows(own, blocked) > 0) { score += turnSign * SentToWinnableBoard; }
     }
-    // if noone has won, and the game has ended, then it is a draw.
-    return player::draw;
+    if (score > MaxHeuristicScore) { return MaxHeuristicScore; }
+    if (score < -MaxHeuristicScore) { return -MaxHeuristicScore; }
+    return score;
 }
 
 player Ultimate3TState::utility()
 {
-    return boardResults(superBoardResults_);
+    return boardResults(superBoard_);
 }
 
 Ultimate3TState::Ultimate3TState()
@@ -185,56 +714,73 @@ Ultimate3TState::Ultimate3TState()
     init
     (
         evaluationValue(),
-        std::vector<std::vector<player>>(TicTacToeNumberOfSpaces, std::vector<player>(TicTacToeNumberOfSpaces, player::neither)),
-        std::vector<player>(TicTacToeNumberOfSpaces, player::neither),
         move(),
         activeBoard::anyBoard,
         player::x
     );
 }
 
-Ultimate3TState::~Ultimate3TState() {}
-
 Ultimate3TState::Ultimate3TState(std::bitset<ENCODINGSIZE> binaryEncoding) 
 {
     std::bitset<ENCODINGSIZE> copy = binaryEncoding;
+    init(evaluationValue(), move(), activeBoard::anyBoard, player::x);
     bestMove_ = move(numberBinaryExtraction(8, copy));
     evaluation_ = evaluationValue(player(numberBinaryExtraction(2, copy)), 0);
-    activePlayer_ = player(numberBinaryExtraction(2, copy));
-    activeBoard_ = activeBoard(numberBinaryExtraction(4, copy));
-    superBoardResults_ = std::vector<player>(TicTacToeNumberOfSpaces, player::neither);
-    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    positionBinaryExtraction(copy);
+}
+
+Ultimate3TState::Ultimate3TState(packedPosition position)
+{
+    init(evaluationValue(), move(), activeBoard::anyBoard, player::x);
+    uint32_t codes[TicTacToeNumberOfSpaces];
+    // the outer boards are the mixed radix digits of each word, lowest first.
+    uint64_t low = position.low;
+    uint64_t high = position.high;
+    for (int i = 0; i < 4; i++)
     {
-        superBoardResults_[TicTacToeNumberOfSpaces-(i +1)] = player(numberBinaryExtraction(2, copy));
+        codes[i] = uint32_t(low % BoardCodeCount);
+        low /= BoardCodeCount;
+        codes[i + 5] = uint32_t(high % BoardCodeCount);
+        high /= BoardCodeCount;
     }
-    board_ = std::vector<std::vector<player>>(TicTacToeNumberOfSpaces, std::vector<player>(TicTacToeNumberOfSpaces, player::neither));
-    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    uint64_t middleField = low | (high << MiddleFieldBits);
+    codes[4] = uint32_t(middleField / 20);
+    uint32_t activeIndex = uint32_t(middleField % 20) >> 1;
+    if (low > MiddleFieldLowMask or codes[4] >= BoardCodeCount)
     {
-        for (int j = 0; j < TicTacToeNumberOfSpaces; j++)
-        {
-            board_[TicTacToeNumberOfSpaces-(i +1)][TicTacToeNumberOfSpaces-(j +1)] = player(numberBinaryExtraction(2, copy));
-        }
+        throw std::invalid_argument("Tried to unpack an invalid packed position");
     }
-}
 
-Ultimate3TState::Ultimate3TState(Ultimate3TState& source)
-{
-    init
-    (
-        source.evaluation_,
-        source.board_,
-        source.superBoardResults_,
-        source.bestMove_,
-        source.activeBoard_,
-        source.activePlayer_
-    );
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    {
+        const packedBoard& unpacked = PackingTables.boards[codes[i]];
+        board_[i].x = unpacked.x;
+        board_[i].o = unpacked.o;
+        board_[i].draw = unpacked.draw;
+        superBoard_.set(i, unpacked.result);
+    }
+    activeBoard_ = activeIndex == 9 ? activeBoard::anyBoard : activeBoard(activeIndex);
+    activePlayer_ = (middleField & 1) ? player::o : player::x;
+    hashes_ = computeHashes();
+    computeScores();
 }
 
 evaluationValue Ultimate3TState::getEvaluation() const { return evaluation_; }
 
 void Ultimate3TState::setEvaluation(evaluationValue newEvaluation) { evaluation_ = newEvaluation; }
 
-std::vector<std::vector<player>> Ultimate3TState::getBoard() const { return board_; }
+std::vector<std::vector<player>> Ultimate3TState::getBoard() const 
+{
+    std::vector<std::vector<player>> board(TicTacToeNumberOfSpaces, std::vector<player>(TicTacToeNumberOfSpaces, player::neither));
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    {
+        for (int j = 0; j < TicTacToeNumberOfSpaces; j++)
+        {
+            board[i][j] = board_[i].get(j);
+        }
+    }
+    return board;
+}
 
 void Ultimate3TState::setBoard(std::vector<std::vector<player>> newBoard) {
     if ((newBoard.size() != TicTacToeNumberOfSpaces))
@@ -248,7 +794,15 @@ void Ultimate3TState::setBoard(std::vector<std::vector<player>> newBoard) {
             throw std::invalid_argument("Tried to setBoard with invalid board");
         }
     }
-    board_ = newBoard;
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    {
+        for (int j = 0; j < TicTacToeNumberOfSpaces; j++)
+        {
+            board_[i].set(j, newBoard[i][j]);
+        }
+    }
+    hashes_ = computeHashes();
+    computeScores();
 }
 
 move Ultimate3TState::getBestMove() const { return bestMove_; }
@@ -257,11 +811,117 @@ void Ultimate3TState::setBestMove(move newBestMove) { bestMove_ = newBestMove; }
 
 activeBoard Ultimate3TState::getActiveBoard() const { return activeBoard_; }
 
-void Ultimate3TState::setActiveBoard(activeBoard newActiveBoard) { activeBoard_ = newActiveBoard; }
+void Ultimate3TState::setActiveBoard(activeBoard newActiveBoard) 
+{
+    updateActiveBoardHashes(activeBoard_, newActiveBoard);
+    activeBoard_ = newActiveBoard; 
+}
 
 player Ultimate3TState::getActivePlayer() const { return activePlayer_; }
 
-void Ultimate3TState::setActivePlayer(player newActivePlayer) { activePlayer_ = newActivePlayer; }
+void Ultimate3TState::setActivePlayer(player newActivePlayer) 
+{
+    updateActivePlayerHashes(activePlayer_, newActivePlayer);
+    activePlayer_ = newActivePlayer; 
+}
+
+uint64_t Ultimate3TState::hash() const { return hashes_[0]; }
+
+uint64_t Ultimate3TState::canonicalHash() const
+{
+    // every variant has the same set of symmetric hashes, so they all have the same lowest one.
+    uint64_t lowest = hashes_[0];
+    for (int symmetry = 1; symmetry < SymmetryCount; symmetry++)
+    {
+        lowest = std::min(lowest, hashes_[symmetry]);
+    }
+    return lowest;
+}
+
+int Ultimate3TState::canonicalSymmetry() const
+{
+    // the variant with the lowest packed position is the canonical one. Every variant has the same set of symmetric packings, so they all pick the same variant, and unlike the hashes the packings do not depend on the Zobrist keys.
+    uint32_t codes[TicTacToeNumberOfSpaces];
+    packBoards(codes);
+    uint64_t activeIndex[SymmetryCount];
+    int candidates[SymmetryCount];
+    for (int symmetry = 0; symmetry < SymmetryCount; symmetry++)
+    {
+        activeBoard symmetricActive = symmetricActiveBoard(symmetry, activeBoard_);
+        activeIndex[symmetry] = symmetricActive < activeBoard::anyBoard ? symmetricActive : 9;
+        candidates[symmetry] = symmetry;
+    }
+
+    // packings are compared a part at a time from the most significant, and variants higher than another are dropped, so usually only a few boards of each are packed. The parts are the middle field above the low word, boards 8 to 5, the rest of the middle field and boards 3 to 0, with -1 and -2 standing for the two halves of the middle field.
+    const int Parts[] = {-1, 8, 7, 6, 5, -2, 3, 2, 1, 0};
+    int candidateCount = SymmetryCount;
+    for (int part : Parts)
+    {
+        if (candidateCount == 1) { break; }
+        uint64_t values[SymmetryCount];
+        uint64_t lowest = UINT64_MAX;
+        for (int i = 0; i < candidateCount; i++)
+        {
+            int symmetry = candidates[i];
+            if (part < 0)
+            {
+                uint64_t middleField = (uint64_t(SymmetricCodeTables.codes[symmetry][codes[4]]) * 10 + activeIndex[symmetry]) * 2 + (activePlayer_ == player::o);
+                values[i] = part == -1 ? middleField >> MiddleFieldBits : middleField & MiddleFieldLowMask;
+            }
+            else
+            {
+                // the board that the symmetry moves to this part.
+                values[i] = SymmetricCodeTables.codes[symmetry][codes[symmetricIndex(SymmetryTables.inverses[symmetry], part)]];
+            }
+            lowest = std::min(lowest, values[i]);
+        }
+        // candidates stay in order, so of variants that pack the same the lowest symmetry is kept.
+        int kept = 0;
+        for (int i = 0; i < candidateCount; i++)
+        {
+            if (values[i] == lowest) { candidates[kept++] = candidates[i]; }
+        }
+        candidateCount = kept;
+    }
+    return candidates[0];
+}
+
+Ultimate3TState Ultimate3TState::transformed(int symmetry) const
+{
+    if (symmetry < 0 or symmetry >= SymmetryCount)
+    {
+        throw std::out_of_range("Tried to transform by a symmetry that does not exist");
+    }
+    Ultimate3TState result(*this);
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    {
+        result.board_[symmetricIndex(symmetry, i)] = symmetricBitBoard(symmetry, board_[i]);
+    }
+    result.superBoard_ = symmetricBitBoard(symmetry, superBoard_);
+    result.activeBoard_ = symmetricActiveBoard(symmetry, activeBoard_);
+    result.bestMove_ = transformMove(bestMove_, symmetry);
+    result.hashes_ = result.computeHashes();
+    result.computeScores();
+    return result;
+}
+
+move Ultimate3TState::transformMove(move original, int symmetry)
+{
+    if (symmetry < 0 or symmetry >= SymmetryCount)
+    {
+        throw std::out_of_range("Tried to transform by a symmetry that does not exist");
+    }
+    return move(activeBoard(symmetricIndex(symmetry, original.board)), uint8_t(symmetricIndex(symmetry, original.space)));
+}
+
+int Ultimate3TState::inverseSymmetry(int symmetry)
+{
+    if (symmetry < 0 or symmetry >= SymmetryCount)
+    {
+        throw std::out_of_range("Tried to invert a symmetry that does not exist");
+    }
+    return SymmetryTables.inverses[symmetry];
+}
 
 player Ultimate3TState::getSpacePlayed(int boardNumber, int spaceNumber) const
 {
@@ -269,7 +929,16 @@ player Ultimate3TState::getSpacePlayed(int boardNumber, int spaceNumber) const
     {
         throw std::out_of_range("Tried to getSpacePlayed out of board Range");
     }
-    return board_[boardNumber][spaceNumber];
+    return board_[boardNumber].get(spaceNumber);
+}
+
+player Ultimate3TState::getBoardResult(int boardNumber) const
+{
+    if (boardNumber >= TicTacToeNumberOfSpaces)
+    {
+        throw std::out_of_range("Tried to getBoardResult out of board Range");
+    }
+    return superBoard_.get(boardNumber);
 }
 
 void Ultimate3TState::setSpacePlayed(int boardNumber, int spaceNumber, player whoPlayed) 
@@ -278,72 +947,116 @@ void Ultimate3TState::setSpacePlayed(int boardNumber, int spaceNumber, player wh
     {
         throw std::out_of_range("Tried to setSpacePlayed out of board Range");
     }
-    board_[boardNumber][spaceNumber] = whoPlayed;
+    setSpace(boardNumber, spaceNumber, whoPlayed);
     // if this move causes a player to win, update the superBoard.
-    if (superBoardResults_[boardNumber] == player::neither) 
+    if (superBoard_.get(boardNumber) == player::neither) 
     { 
-        superBoardResults_[boardNumber] = boardResults(board_[boardNumber]);
+        setBoardResult(boardNumber, boardResults(board_[boardNumber]));
     }
 }
 
 std::vector<move> Ultimate3TState::generateMoves()
 {
-    std::vector<move> legalMoves;
+    moveList legalMoves;
+    generateMoves(legalMoves);
+    return std::vector<move>(legalMoves.begin(), legalMoves.end());
+}
+
+void Ultimate3TState::generateMoves(moveList& legalMoves)
+{
+    legalMoves.count = 0;
     if (isTerminalState())
     {
-        return legalMoves;
+        return;
     }
+    // a board can be played on if it has an empty space, so the empty spaces of the active board are the moves unless there are none.
     if (activeBoard_ != activeBoard::anyBoard)
     {
-        for (int space = 0; space < TicTacToeNumberOfSpaces; space++)
+        uint16_t empty = ~board_[activeBoard_].filled() & FullBoardMask;
+        if (empty)
         {
-            if (getSpacePlayed(activeBoard_, space) == player::neither)
-            {
-                legalMoves.push_back(move(activeBoard_, space));
-            }
+            addMoves(legalMoves, activeBoard_, empty);
+            return;
         }
-        if (legalMoves.size() > 0) { return legalMoves; }
     }
     // the active board is any board, or the active board had no legal moves.
     for (int board = 0; board < TicTacToeNumberOfSpaces; board++)
     {
-        for (int space = 0; space < TicTacToeNumberOfSpaces; space++)
-        {
-            if (getSpacePlayed(board, space) == player::neither)
-            {
-                legalMoves.push_back(move(activeBoard(board), space));
-            }
-        }
+        addMoves(legalMoves, activeBoard(board), ~board_[board].filled() & FullBoardMask);
+    }
+}
+
+int Ultimate3TState::countMoves()
+{
+    if (isTerminalState())
+    {
+        return 0;
     }
-    return legalMoves;
+    if (activeBoard_ != activeBoard::anyBoard)
+    {
+        int count = countSetBits(~board_[activeBoard_].filled() & FullBoardMask);
+        if (count > 0) { return count; }
+    }
+    int count = 0;
+    for (int board = 0; board < TicTacToeNumberOfSpaces; board++)
+    {
+        count += countSetBits(~board_[board].filled() & FullBoardMask);
+    }
+    return count;
 }
 
 Ultimate3TState Ultimate3TState::generateSuccessorState(move playedMove)
 {
     Ultimate3TState successor(*this); // create a copy of this State to work from
+    successor.makeMove(playedMove);
+    return successor;
+}
+
+undoRecord Ultimate3TState::makeMove(move playedMove)
+{
+    uint16_t spaceMask = 1 << playedMove.space;
     if ( // check for legal move
-        successor.getSpacePlayed(playedMove.board, playedMove.space) != player::neither
+        (board_[playedMove.board].filled() & spaceMask)
         || (activeBoard_ != playedMove.board && activeBoard_ != activeBoard::anyBoard)
         ) 
     {
-        throw std::invalid_argument("Tried to generate seccessor from illegal move");
+        throw std::invalid_argument("Tried to make an illegal move");
     }
-    successor.setSpacePlayed
-    (
-        playedMove.board, playedMove.space, // where the move is to be played
-        getActivePlayer() // who is playing the move
-    );
-    successor.setActivePlayer(getActivePlayer() == player::x ? player::o : player::x); // make it the other player's turn.
-    // determine if the next board to be played on is full. if it is, then any board can be played on. If not, the board corresponding to the space of the played move must be played on.
-    successor.setActiveBoard(activeBoard::anyBoard);
-    for (int space = 0; space < 8; space++)
+    undoRecord record;
+    record.playedMove = playedMove;
+    record.previousActiveBoard = activeBoard_;
+    record.previousBoardResult = superBoard_.get(playedMove.board);
+
+    // play the move for the active player, and update the superBoard if this move decides the board.
+    bitBoard& playedBoard = board_[playedMove.board];
+    if (activePlayer_ == player::x) { playedBoard.x |= spaceMask; }
+    else { playedBoard.o |= spaceMask; }
+    updateSpaceHashes(playedMove.board, playedMove.space, player::neither, foldedSpace(playedMove.board, activePlayer_));
+    // the spaces of a decided board score nothing, so only a board still being played needs rescoring.
+    if (record.previousBoardResult == player::neither)
     {
-        if (successor.getSpacePlayed(playedMove.space, space) == player::neither)
-        {
-            successor.setActiveBoard(activeBoard(playedMove.space));
-        }
+        setBoardResult(playedMove.board, boardResults(playedBoard));
+        updateBoardScore(playedMove.board);
     }
-    return successor;
+    setActivePlayer(activePlayer_ == player::x ? player::o : player::x); // make it the other player's turn.
+    // determine if the next board to be played on is full. if it is, then any board can be played on. If not, the board corresponding to the space of the played move must be played on.
+    setActiveBoard(board_[playedMove.space].filled() == FullBoardMask ? activeBoard::anyBoard : activeBoard(playedMove.space));
+    return record;
+}
+
+void Ultimate3TState::unmakeMove(const undoRecord& record)
+{
+    // every change is undone with the same hash update that made it, since XORing a key twice cancels it out.
+    uint16_t spaceMask = 1 << record.playedMove.space;
+    player mover = activePlayer_ == player::x ? player::o : player::x;
+    bitBoard& playedBoard = board_[record.playedMove.board];
+    playedBoard.x &= ~spaceMask;
+    playedBoard.o &= ~spaceMask;
+    updateSpaceHashes(record.playedMove.board, record.playedMove.space, foldedSpace(record.playedMove.board, mover), player::neither);
+    setBoardResult(record.playedMove.board, record.previousBoardResult);
+    if (record.previousBoardResult == player::neither) { updateBoardScore(record.playedMove.board); }
+    setActivePlayer(mover);
+    setActiveBoard(record.previousActiveBoard);
 }
 
 bool Ultimate3TState::isTerminalState()
@@ -352,12 +1065,13 @@ bool Ultimate3TState::isTerminalState()
     return utility() != player::neither;
 }
 
-void Ultimate3TState::numberBinaryInsertion(int number, int size, std::bitset<ENCODINGSIZE>& binary) const
+template <size_t BinarySize>
+void Ultimate3TState::numberBinaryInsertion(int number, int size, std::bitset<BinarySize>& binary) const
 {
     // allocate new space for the number
     binary <<= size;
     // turn the number into binary
-    std::bitset<ENCODINGSIZE> temp(number);
+    std::bitset<BinarySize> temp(number);
     // read the new binary into the binary string.
     for (int i = 0; i < size; i++)
     {
@@ -365,43 +1079,109 @@ void Ultimate3TState::numberBinaryInsertion(int number, int size, std::bitset<EN
     }
 }
 
-int Ultimate3TState::numberBinaryExtraction(int size, std::bitset<ENCODINGSIZE>& binary) const
+template <size_t BinarySize>
+int Ultimate3TState::numberBinaryExtraction(int size, std::bitset<BinarySize>& binary) const
 {
     int value = 0;
     for (int i = 0; i < size; i++)
     {
-        value += binary[0]*std::pow(2, i);
-        binary >>= 1;
+        value |= int(binary[i]) << i;
     }
+    binary >>= size;
     return value;
 }
 
-std::bitset<ENCODINGSIZE> Ultimate3TState::toBinary() const
+template <size_t BinarySize>
+void Ultimate3TState::positionBinaryInsertion(std::bitset<BinarySize>& binary) const
 {
-    std::bitset<ENCODINGSIZE> binary;
-
     // iterate over the board and encode it into binary.
     for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
     {
         for (int j = 0; j < TicTacToeNumberOfSpaces; j++)
         {
-            numberBinaryInsertion(board_[i][j], 2, binary);
+            numberBinaryInsertion(board_[i].get(j), 2, binary);
         }
     }
 
     for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
     {
-        numberBinaryInsertion(superBoardResults_[i], 2, binary);
+        numberBinaryInsertion(superBoard_.get(i), 2, binary);
     }
         
     numberBinaryInsertion(activeBoard_, 4, binary);
     numberBinaryInsertion(activePlayer_, 2, binary);
-    numberBinaryInsertion(evaluation_.playerToWin, 2, binary);
+}
+
+template <size_t BinarySize>
+void Ultimate3TState::positionBinaryExtraction(std::bitset<BinarySize>& binary)
+{
+    activePlayer_ = player(numberBinaryExtraction(2, binary));
+    activeBoard_ = activeBoard(numberBinaryExtraction(4, binary));
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    {
+        superBoard_.set(TicTacToeNumberOfSpaces-(i +1), player(numberBinaryExtraction(2, binary)));
+    }
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    {
+        for (int j = 0; j < TicTacToeNumberOfSpaces; j++)
+        {
+            board_[TicTacToeNumberOfSpaces-(i +1)].set(TicTacToeNumberOfSpaces-(j +1), player(numberBinaryExtraction(2, binary)));
+        }
+    }
+    hashes_ = computeHashes();
+    computeScores();
+}
+
+std::bitset<ENCODINGSIZE> Ultimate3TState::toBinary() const
+{
+    std::bitset<ENCODINGSIZE> binary;
+
+    positionBinaryInsertion(binary);
+    numberBinaryInsertion(evaluation_.getPlayerToWin(), 2, binary);
     numberBinaryInsertion(bestMove_.toBinary(), 8, binary);
     
     return binary;
 }
 
+void Ultimate3TState::packBoards(uint32_t codes[TicTacToeNumberOfSpaces]) const
+{
+    bool invalid = false;
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    {
+        const bitBoard& grid = board_[i];
+        // the superBoard holds one bit per board in each mask, which together give the result as a player value.
+        uint32_t result = (((superBoard_.x >> i) & 1) * player::x) | (((superBoard_.o >> i) & 1) * player::o) | ((superBoard_.draw >> i) & 1);
+        uint32_t undecidedCode = PackingTables.undecidedCodes[PackingTables.ternary[grid.x] + 2 * PackingTables.ternary[grid.o]];
+        uint32_t decidedCode = UndecidedBoardCount + (player::x - result) * GridMaskCount + grid.filled();
+        codes[i] = result == player::neither ? undecidedCode : decidedCode;
+        invalid |= result == player::neither and (undecidedCode == InvalidCode or grid.draw != 0);
+    }
+    if (invalid)
+    {
+        throw std::invalid_argument("Tried to pack a position with a board that can not come up in a game");
+    }
+}
+
+packedPosition Ultimate3TState::toPackedPosition(int symmetry) const
+{
+    if (symmetry < 0 or symmetry >= SymmetryCount)
+    {
+        throw std::out_of_range("Tried to transform by a symmetry that does not exist");
+    }
+    uint32_t codes[TicTacToeNumberOfSpaces];
+    packBoards(codes);
+    uint32_t symmetricCodes[TicTacToeNumberOfSpaces];
+    for (int i = 0; i < TicTacToeNumberOfSpaces; i++)
+    {
+        // pack board i of the state as it would be after the symmetry, without building the transformed state.
+        symmetricCodes[symmetricIndex(symmetry, i)] = SymmetricCodeTables.codes[symmetry][codes[i]];
+    }
+
+    // the active board is 0 to 8, or 9 for any board, and o to play is 1.
+    activeBoard symmetricActive = symmetricActiveBoard(symmetry, activeBoard_);
+    return packCodes(symmetricCodes, symmetricActive < activeBoard::anyBoard ? symmetricActive : 9, activePlayer_ == player::o);
+}
+
 bool Ultimate3TState::isMaxNode()
 {
     return getActivePlayer() == player::x;
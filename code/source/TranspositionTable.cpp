@@ -0,0 +1,311 @@
+#include "TranspositionTable.h"
+#include <new>
+#include <stdexcept>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    // Layout of the packed data of an entry.
+    const int EvaluationShift = 0;
+    const int MoveShift = 16;
+    const int DepthShift = 24;
+    const int GenerationShift = 32;
+    const int BoundShift = 40;
+    const int ScoreShift = 42;
+    const uint64_t ByteMask = 0xFF;
+    const uint64_t BoundMask = 0b11;
+    const uint64_t WordMask = 0xFFFF;
+    // Set on every stored entry so that an empty entry, which is all zeros, is never mistaken for a stored one.
+    const uint64_t OccupiedBit = 1ull << 63;
+
+    const size_t BytesPerMegabyte = 1024 * 1024;
+
+    // Layout of a WinDrawLossTable entry: the result takes the lowest bits of the hash.
+    const uint64_t ResultMask = 0b11;
+}
+
+///// transpositionData definitions /////
+
+uint64_t transpositionData::pack() const
+{
+    return (uint64_t(evaluation.pack()) << EvaluationShift)
+        | (uint64_t(bestMove.toBinary()) << MoveShift)
+        | (uint64_t(depth) << DepthShift)
+        | (uint64_t(bound) << BoundShift)
+        | (uint64_t(uint16_t(score)) << ScoreShift)
+        | OccupiedBit;
+}
+
+transpositionData transpositionData::unpack(uint64_t packed)
+{
+    transpositionData data;
+    data.evaluation = evaluationValue::unpack(uint16_t((packed >> EvaluationShift) & WordMask));
+    data.bestMove = move(uint8_t((packed >> MoveShift) & ByteMask));
+    data.depth = uint8_t((packed >> DepthShift) & ByteMask);
+    data.bound = boundType((packed >> BoundShift) & BoundMask);
+    data.score = int16_t(uint16_t((packed >> ScoreShift) & WordMask));
+    return data;
+}
+
+///// TranspositionTable definitions /////
+
+void TranspositionTable::init(size_t megabytes, bool useHugePages)
+{
+    buckets_ = nullptr;
+    bucketCount_ = 0;
+    allocatedBytes_ = 0;
+    mapped_ = false;
+    useHugePages_ = useHugePages;
+    generation_ = 0;
+    allocate(megabytes);
+}
+
+void TranspositionTable::allocate(size_t megabytes)
+{
+    // round the number of buckets down to a power of two, but always have at least one.
+    size_t budgetBuckets = megabytes * BytesPerMegabyte / sizeof(bucket);
+    bucketCount_ = 1;
+    while (bucketCount_ * 2 <= budgetBuckets) { bucketCount_ *= 2; }
+    allocatedBytes_ = bucketCount_ * sizeof(bucket);
+
+#ifdef __linux__
+    // mmap hands back zeroed, page aligned memory that is only committed once it is touched.
+    void* memory = mmap(nullptr, allocatedBytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) { throw std::bad_alloc(); }
+    if (useHugePages_) { madvise(memory, allocatedBytes_, MADV_HUGEPAGE); }
+    buckets_ = static_cast<bucket*>(memory);
+    mapped_ = true;
+#else
+    buckets_ = new bucket[bucketCount_]();
+    mapped_ = false;
+#endif
+}
+
+void TranspositionTable::release()
+{
+    if (buckets_ == nullptr) { return; }
+#ifdef __linux__
+    if (mapped_) { munmap(buckets_, allocatedBytes_); }
+#endif
+    if (!mapped_) { delete[] buckets_; }
+    buckets_ = nullptr;
+}
+
+TranspositionTable::TranspositionTable()
+{
+    init(DefaultMegabytes, false);
+}
+
+TranspositionTable::TranspositionTable(size_t megabytes, bool useHugePages)
+{
+    init(megabytes, useHugePages);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+    release();
+}
+
+void TranspositionTable::resize(size_t megabytes, bool useHugePages)
+{
+    release();
+    useHugePages_ = useHugePages;
+    generation_ = 0;
+    allocate(megabytes);
+}
+
+void TranspositionTable::clear()
+{
+    for (size_t i = 0; i < bucketCount_; i++)
+    {
+        for (int j = 0; j < BucketSize; j++)
+        {
+            buckets_[i].entries[j].check.store(0, std::memory_order_relaxed);
+            buckets_[i].entries[j].data.store(0, std::memory_order_relaxed);
+        }
+    }
+    generation_ = 0;
+}
+
+void TranspositionTable::newSearch()
+{
+    generation_++;
+}
+
+TranspositionTable::bucket& TranspositionTable::bucketFor(uint64_t key) const
+{
+    return buckets_[key & (bucketCount_ - 1)];
+}
+
+// Every load and store of an entry is relaxed. The XOR check catches a slot whose two words came from different stores, so no ordering between them is needed.
+bool TranspositionTable::probe(uint64_t key, transpositionData& data) const
+{
+    const bucket& candidates = bucketFor(key);
+    for (int i = 0; i < BucketSize; i++)
+    {
+        const transpositionEntry& entry = candidates.entries[i];
+        uint64_t entryData = entry.data.load(std::memory_order_relaxed);
+        uint64_t entryCheck = entry.check.load(std::memory_order_relaxed);
+        if ((entryCheck ^ entryData) == key and (entryData & OccupiedBit))
+        {
+            data = transpositionData::unpack(entryData);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, const transpositionData& data)
+{
+    bucket& candidates = bucketFor(key);
+    transpositionEntry* replace = &candidates.entries[0];
+    int replaceValue = 0x7FFFFFFF;
+    for (int i = 0; i < BucketSize; i++)
+    {
+        transpositionEntry& entry = candidates.entries[i];
+        uint64_t entryData = entry.data.load(std::memory_order_relaxed);
+        uint64_t entryKey = entry.check.load(std::memory_order_relaxed) ^ entryData;
+        if (entryKey == key and (entryData & OccupiedBit))
+        {
+            // a shallower bound for the same state would throw away the deeper result, so it is dropped unless it is exact or the entry is left from an older search.
+            bool olderSearch = uint8_t((entryData >> GenerationShift) & ByteMask) != generation_;
+            if (data.bound != exactBound and !olderSearch and data.depth < ((entryData >> DepthShift) & ByteMask)) { return; }
+            replace = &entry;
+            break;
+        }
+        // an empty entry is always taken.
+        if (!(entryData & OccupiedBit))
+        {
+            replace = &entry;
+            break;
+        }
+        // otherwise replace the shallowest entry, counting entries from older searches as shallower.
+        int age = uint8_t(generation_ - uint8_t((entryData >> GenerationShift) & ByteMask));
+        int value = int((entryData >> DepthShift) & ByteMask) - 8 * age;
+        if (value < replaceValue)
+        {
+            replace = &entry;
+            replaceValue = value;
+        }
+    }
+    uint64_t packed = data.pack() | (uint64_t(generation_) << GenerationShift);
+    replace->check.store(key ^ packed, std::memory_order_relaxed);
+    replace->data.store(packed, std::memory_order_relaxed);
+}
+
+size_t TranspositionTable::getCapacity() const
+{
+    return bucketCount_ * BucketSize;
+}
+
+///// WinDrawLossTable definitions /////
+
+WinDrawLossTable::WinDrawLossTable()
+{
+    buckets_ = nullptr;
+    allocate(TranspositionTable::DefaultMegabytes);
+}
+
+WinDrawLossTable::WinDrawLossTable(size_t megabytes)
+{
+    buckets_ = nullptr;
+    allocate(megabytes);
+}
+
+WinDrawLossTable::~WinDrawLossTable()
+{
+    release();
+}
+
+// The same as TranspositionTable::allocate(), so that a table is only paid for as it fills.
+void WinDrawLossTable::allocate(size_t megabytes)
+{
+    size_t budgetBuckets = megabytes * BytesPerMegabyte / sizeof(bucket);
+    bucketCount_ = 1;
+    while (bucketCount_ * 2 <= budgetBuckets) { bucketCount_ *= 2; }
+    allocatedBytes_ = bucketCount_ * sizeof(bucket);
+
+#ifdef __linux__
+    void* memory = mmap(nullptr, allocatedBytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) { throw std::bad_alloc(); }
+    buckets_ = static_cast<bucket*>(memory);
+    mapped_ = true;
+#else
+    buckets_ = new bucket[bucketCount_]();
+    mapped_ = false;
+#endif
+}
+
+void WinDrawLossTable::release()
+{
+    if (buckets_ == nullptr) { return; }
+#ifdef __linux__
+    if (mapped_) { munmap(buckets_, allocatedBytes_); }
+#endif
+    if (!mapped_) { delete[] buckets_; }
+    buckets_ = nullptr;
+}
+
+void WinDrawLossTable::resize(size_t megabytes)
+{
+    release();
+    allocate(megabytes);
+}
+
+void WinDrawLossTable::clear()
+{
+    std::fill(buckets_, buckets_ + bucketCount_, bucket());
+}
+
+WinDrawLossTable::bucket& WinDrawLossTable::bucketFor(uint64_t key)
+{
+    return buckets_[key & (bucketCount_ - 1)];
+}
+
+const WinDrawLossTable::bucket& WinDrawLossTable::bucketFor(uint64_t key) const
+{
+    return buckets_[key & (bucketCount_ - 1)];
+}
+
+bool WinDrawLossTable::probe(uint64_t key, player& result) const
+{
+    const bucket& candidates = bucketFor(key);
+    uint64_t check = key & ~ResultMask;
+    for (int i = 0; i < BucketSize; i++)
+    {
+        uint64_t entry = candidates.entries[i];
+        if (entry != 0 and (entry & ~ResultMask) == check)
+        {
+            result = player(entry & ResultMask);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WinDrawLossTable::store(uint64_t key, player result)
+{
+    if (result == player::neither) { throw std::invalid_argument("Tried to store a result for a state that is not over"); }
+    bucket& candidates = bucketFor(key);
+    uint64_t check = key & ~ResultMask;
+    // the top bits of the hash, far from the bucket index, pick the entry to replace, so that which entries are kept does not depend on the order states were stored in.
+    uint64_t* replace = &candidates.entries[(key >> 56) % BucketSize];
+    for (int i = 0; i < BucketSize; i++)
+    {
+        uint64_t& entry = candidates.entries[i];
+        if (entry == 0 or (entry & ~ResultMask) == check)
+        {
+            replace = &entry;
+            break;
+        }
+    }
+    *replace = check | uint64_t(result);
+}
+
+size_t WinDrawLossTable::getCapacity() const
+{
+    return bucketCount_ * BucketSize;
+}
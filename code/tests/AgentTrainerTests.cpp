@@ -4,6 +4,7 @@ Tests for AgnetTrainer class which includes the minimax function and file output
 */
 #include "gtest/gtest.h"
 #include "Agent.h"
+#include "TestStates.h"
 #include <sstream>
 
 namespace AgentTrainerTestFunctions
@@ -21,28 +22,9 @@ namespace AgentTrainerTestFunctions
         }
         return state;
     }
-
-    // Creates a state where the players play a "normal" game of tic tac toe
-    Ultimate3TState createSmallGame()
-    {
-        Ultimate3TState state;
-
-        for (int i = 0; i < 9; i++)
-        {
-            state.setSpacePlayed(0, i, draw);
-            state.setSpacePlayed(1, i, draw);
-            state.setSpacePlayed(2, i, x);
-            state.setSpacePlayed(3, i, draw);
-            state.setSpacePlayed(4, i, draw);
-            state.setSpacePlayed(5, i, x);
-            state.setSpacePlayed(6, i, o);
-            state.setSpacePlayed(7, i, o);
-        }
-
-        return state;
-    }
 }
 using namespace AgentTrainerTestFunctions;
+using namespace TestStates;
 
 TEST(AgentTrainerTests, Minimax_TerminalState_DoesNotExpandMoreStates) 
 {
@@ -56,23 +38,206 @@ TEST(AgentTrainerTests, Minimax_TerminalState_DoesNotExpandMoreStates)
     std::string output = outputStream.str();
     
     EXPECT_EQ(outputStream.str().size(), ENCODINGSIZE+1); // test that there is only one entry in the output. size should be encodingsize + 1 since there should be a terminating newline character at the end of the encoding.
-    EXPECT_EQ(state.toBinary().to_string() + "\n", output);
+    // states are written as their canonical variant, with the spaces of decided boards folded.
+    Ultimate3TState expectedState(state.transformed(state.canonicalSymmetry()).toPackedPosition());
+    expectedState.setEvaluation(evaluationValue(x, 0));
+    // a terminal state has no best move, so the placeholder move is written as it is.
+    expectedState.setBestMove(move());
+    EXPECT_EQ(expectedState.toBinary().to_string() + "\n", output);
 }
 
 TEST(AgentTrainerTests, MinimaxTranspositionTable_SimpleLineTree_ExpandsCorrectNumberOfStates)
 {
     std::stringstream outputStream;
     AgentTrainer trainer(outputStream);
-    Ultimate3TState state = createSmallGame();
-    for (int i = 3; i < 9; i++)
-    {
-        state.setSpacePlayed(8, i, draw);
-    }
+    Ultimate3TState state = createTopRowGame();
 
     trainer.minimax(state);
     trainer.writeToOutput();
     std::string output = outputStream.str();
 
-    EXPECT_EQ(trainer.getStatesExpanded(), 10);
-    EXPECT_EQ(output.size(), (ENCODINGSIZE+1) * 13);
-}
\ No newline at end of file
+    // x can play 0, 1 or 2. After 0, o must answer 1 or 2 and x fills the last space. x wins at once with 1. After 2, o wins with 0 or plays 1 and x fills the last space.
+    // That expands the start, x0, x0 o1, x0 o2, x2 and x2 o1. x0 o1 x2 and x2 o1 x0 are the same position, so 10 positions are solved.
+    EXPECT_EQ(trainer.getStatesExpanded(), 6);
+    EXPECT_EQ(output.size(), (ENCODINGSIZE+1) * 10);
+}
+
+TEST(AgentTrainerTests, Minimax_SymmetricState_DoesNotExpandMoreStates)
+{
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream);
+    Ultimate3TState state = createTopRowGame();
+    evaluationValue value = trainer.minimax(state);
+    trainer.resetStatesExpanded();
+
+    for (int symmetry = 0; symmetry < Ultimate3TState::SymmetryCount; symmetry++)
+    {
+        Ultimate3TState symmetricState = state.transformed(symmetry);
+        EXPECT_EQ(trainer.minimax(symmetricState), value);
+    }
+
+    EXPECT_EQ(trainer.getStatesExpanded(), 0);
+}
+
+TEST(AgentTrainerTests, Minimax_SeveralThreads_MatchesSerialOutput)
+{
+    // the small game with board 8 and a space of board 7 left to play.
+    Ultimate3TState state = createSmallGame();
+    state.setSpacePlayed(7, 0, neither);
+    state.setActiveBoard(anyBoard);
+
+    std::stringstream serialOutput;
+    AgentTrainer serialTrainer(serialOutput);
+    evaluationValue serialValue = serialTrainer.minimax(state);
+    serialTrainer.writeToOutput();
+
+    for (unsigned int threadCount : {2u, 8u})
+    {
+        for (int splitPly : {1, 3})
+        {
+            std::stringstream output;
+            AgentTrainer trainer(output);
+            EXPECT_EQ(trainer.minimax(state, threadCount, splitPly), serialValue);
+            trainer.writeToOutput();
+            // compared with EXPECT_TRUE, since gtest's diff of two large outputs takes more memory than the test has.
+            EXPECT_TRUE(output.str() == serialOutput.str()) << threadCount << " threads, split ply " << splitPly;
+            EXPECT_GE(trainer.getStatesExpanded(), serialTrainer.getStatesExpanded());
+        }
+    }
+}
+
+TEST(AgentTrainerTests, Minimax_SmallSolvedStateBudget_WritesSameBrain)
+{
+    Ultimate3TState state = createSmallGame();
+    state.setSpacePlayed(7, 0, neither);
+    state.setActiveBoard(anyBoard);
+
+    std::stringstream unused;
+    AgentTrainer expectedTrainer(unused);
+    expectedTrainer.minimax(state);
+    std::stringstream expectedBrain;
+    expectedTrainer.writeBrain(expectedBrain);
+
+    // with the smallest budget, most of the solved states are written to disk as runs, and several threads hand theirs over in batches.
+    for (unsigned int threadCount : {1u, 4u})
+    {
+        AgentTrainer trainer(unused);
+        trainer.setSolvedStateMegabytes(0);
+        trainer.minimax(state, threadCount);
+        std::stringstream brain;
+        trainer.writeBrain(brain);
+        EXPECT_TRUE(brain.str() == expectedBrain.str()) << threadCount << " threads";
+    }
+    EXPECT_GT(expectedBrain.str().size(), SolvedStateStore::MinimumBufferEntries * 4 * sizeof(brainRecord));
+}
+
+TEST(AgentTrainerTests, Minimax_SymmetricVariants_WriteSameOutput)
+{
+    Ultimate3TState state = createSmallGame();
+    state.setSpacePlayed(7, 0, neither);
+    state.setActiveBoard(anyBoard);
+
+    std::stringstream expectedOutput;
+    AgentTrainer expectedTrainer(expectedOutput);
+    expectedTrainer.minimax(state);
+    expectedTrainer.writeToOutput();
+
+    // every variant has the same canonical states, and equally good moves are broken by their canonical move, so the best moves written match too.
+    for (int symmetry = 1; symmetry < Ultimate3TState::SymmetryCount; symmetry++)
+    {
+        std::stringstream output;
+        AgentTrainer trainer(output);
+        Ultimate3TState variant = state.transformed(symmetry);
+        trainer.minimax(variant);
+        trainer.writeToOutput();
+        EXPECT_TRUE(output.str() == expectedOutput.str()) << "symmetry " << symmetry;
+    }
+}
+
+TEST(AgentTrainerTests, Minimax_NoThreads_ThrowsError)
+{
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream);
+    Ultimate3TState state;
+
+    EXPECT_THROW(trainer.minimax(state, 0), std::invalid_argument);
+}
+
+TEST(AgentTrainerTests, SolveWinDrawLoss_LateGames_MatchesMinimaxWithFewerStates)
+{
+    unsigned int minimaxStates = 0;
+    unsigned int winDrawLossStates = 0;
+    for (unsigned int seed = 1; seed <= 8; seed++)
+    {
+        Ultimate3TState state = createRandomGameState(seed, LateGameMoves);
+        std::stringstream outputStream;
+        AgentTrainer minimaxTrainer(outputStream, 1);
+        // the result only solve splits its budget between two tables, so it is given twice as much to keep a megabyte for each.
+        AgentTrainer winDrawLossTrainer(outputStream, 2);
+
+        evaluationValue minimaxValue = minimaxTrainer.minimax(state);
+        player result = winDrawLossTrainer.solveWinDrawLoss(state);
+
+        EXPECT_EQ(result, minimaxValue.getPlayerToWin()) << "seed " << seed;
+        minimaxStates += minimaxTrainer.getStatesExpanded();
+        winDrawLossStates += winDrawLossTrainer.getStatesExpanded();
+    }
+
+    EXPECT_LT(winDrawLossStates, minimaxStates);
+}
+
+TEST(AgentTrainerTests, RefineDepthToWin_LateGames_MatchesMinimaxOnWinningLines)
+{
+    for (unsigned int seed = 1; seed <= 8; seed++)
+    {
+        Ultimate3TState state = createRandomGameState(seed, LateGameMoves);
+        std::stringstream outputStream;
+        AgentTrainer minimaxTrainer(outputStream, 1);
+        // the result only solve splits its budget between two tables, so it is given twice as much to keep a megabyte for each.
+        AgentTrainer winDrawLossTrainer(outputStream, 2);
+
+        evaluationValue minimaxValue = minimaxTrainer.minimax(state);
+        winDrawLossTrainer.solveWinDrawLoss(state);
+        evaluationValue refinedValue = winDrawLossTrainer.refineDepthToWin(state);
+        BrainTable minimaxBrain = minimaxTrainer.createBrainTable();
+        BrainTable refinedBrain = winDrawLossTrainer.createBrainTable();
+        evaluationValue minimaxEvaluation, refinedEvaluation;
+        move minimaxMove, refinedMove;
+
+        ASSERT_TRUE(minimaxBrain.lookup(state, minimaxEvaluation, minimaxMove));
+        ASSERT_TRUE(refinedBrain.lookup(state, refinedEvaluation, refinedMove));
+        if (minimaxValue.getPlayerToWin() == player::draw)
+        {
+            EXPECT_EQ(refinedValue, evaluationValue(player::draw, 0)) << "seed " << seed;
+            EXPECT_EQ(refinedEvaluation.getPlayerToWin(), player::draw) << "seed " << seed;
+        }
+        else
+        {
+            EXPECT_EQ(refinedValue, minimaxValue) << "seed " << seed;
+            EXPECT_EQ(refinedEvaluation, minimaxEvaluation) << "seed " << seed;
+            EXPECT_EQ(refinedMove.toBinary(), minimaxMove.toBinary()) << "seed " << seed;
+        }
+    }
+}
+
+TEST(AgentTrainerTests, SolveWinDrawLoss_WonState_BestMovesWin)
+{
+    for (unsigned int seed = 1; seed <= 8; seed++)
+    {
+        Ultimate3TState state = createRandomGameState(seed, LateGameMoves);
+        std::stringstream outputStream;
+        AgentTrainer trainer(outputStream, 2);
+        player result = trainer.solveWinDrawLoss(state);
+        if (result == player::draw) { continue; }
+        BrainTable brain = trainer.createBrainTable();
+
+        // the winner follows the brain, and the loser plays the first legal move. Whatever the loser plays was solved too, since every move of a lost state is searched.
+        while (!state.isTerminalState())
+        {
+            move played = state.generateMoves()[0];
+            if (state.getActivePlayer() == result) { played = brain.bestMove(state); }
+            state.makeMove(played);
+        }
+        EXPECT_EQ(state.utility(), result) << "seed " << seed;
+    }
+}
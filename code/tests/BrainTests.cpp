@@ -0,0 +1,393 @@
+/* Andrew Bergman
+12-9-23
+Tests for the binary brain file, written by AgentTrainer and read by Brain.
+*/
+#include "gtest/gtest.h"
+#include "Brain.h"
+#include "CompressedBrain.h"
+#include "Agent.h"
+#include "TestStates.h"
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <string.h>
+#include <sstream>
+
+namespace BrainTestFunctions
+{
+    std::string brainPath(const std::string& name)
+    {
+        return testing::TempDir() + name;
+    }
+
+    // Plays random moves from the start, keeping every state reached.
+    std::vector<Ultimate3TState> createRandomStates(int count, unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<Ultimate3TState> states;
+        Ultimate3TState state;
+        while ((int)states.size() < count)
+        {
+            if (state.isTerminalState()) { state = Ultimate3TState(); }
+            TestStates::playRandomMove(state, random);
+            states.push_back(state);
+        }
+        return states;
+    }
+
+    // Makes a record for each state, with the state's number as the depth of its evaluation and its first legal move in the canonical variant as its best move.
+    std::vector<brainRecord> createRecords(std::vector<Ultimate3TState>& states)
+    {
+        std::vector<brainRecord> records;
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            Ultimate3TState canonical = states[i].transformed(states[i].canonicalSymmetry());
+            std::vector<move> legalMoves = canonical.generateMoves();
+            move bestMove = legalMoves.empty() ? move() : legalMoves[0];
+            records.push_back(brainRecord::create(canonical.toPackedPosition(), evaluationValue(player::x, int(i)), bestMove));
+        }
+        std::stable_sort(records.begin(), records.end(), [](const brainRecord& a, const brainRecord& b) { return a.key < b.key; });
+        auto last = std::unique(records.begin(), records.end(), [](const brainRecord& a, const brainRecord& b) { return a.key == b.key; });
+        records.erase(last, records.end());
+        return records;
+    }
+
+    void writeBrainFile(const std::string& path, const std::vector<brainRecord>& records, uint64_t indexStride)
+    {
+        std::ofstream file(path, std::ios::binary);
+        Brain::write(file, records, indexStride);
+    }
+}
+using namespace BrainTestFunctions;
+using namespace TestStates;
+
+TEST(BrainTests, BrainRecord_Create_RoundTripsEvaluationAndMove)
+{
+    brainRecord record = brainRecord::create(packedPosition{1, 2}, evaluationValue(player::o, 57), move(board6, 4));
+
+    EXPECT_EQ(record.getEvaluation(), evaluationValue(player::o, 57));
+    EXPECT_EQ(record.getBestMove().toBinary(), move(board6, 4).toBinary());
+    EXPECT_EQ(sizeof(brainRecord), 24);
+    EXPECT_EQ(sizeof(brainHeader), 64);
+}
+
+TEST(BrainTests, Lookup_EveryIndexStride_FindsEveryState)
+{
+    std::vector<Ultimate3TState> states = createRandomStates(300, 5);
+    std::vector<brainRecord> records = createRecords(states);
+
+    for (uint64_t indexStride : {uint64_t(0), uint64_t(1), uint64_t(7), Brain::DefaultIndexStride, uint64_t(1000)})
+    {
+        std::string path = brainPath("stride.bin");
+        writeBrainFile(path, records, indexStride);
+        Brain brain(path);
+        ASSERT_EQ(brain.size(), records.size());
+
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            evaluationValue evaluation;
+            move bestMove;
+            ASSERT_TRUE(brain.lookup(states[i], evaluation, bestMove)) << "stride " << indexStride << " state " << i;
+        }
+    }
+}
+
+TEST(BrainTests, Lookup_SymmetricVariants_TransformsBestMove)
+{
+    std::vector<Ultimate3TState> states = createRandomStates(40, 6);
+    std::vector<brainRecord> records = createRecords(states);
+    std::string path = brainPath("symmetric.bin");
+    writeBrainFile(path, records, Brain::DefaultIndexStride);
+    Brain brain(path);
+
+    for (Ultimate3TState& state : states)
+    {
+        evaluationValue expectedEvaluation;
+        move expectedMove;
+        ASSERT_TRUE(brain.lookup(state, expectedEvaluation, expectedMove));
+        for (int symmetry = 0; symmetry < Ultimate3TState::SymmetryCount; symmetry++)
+        {
+            evaluationValue evaluation;
+            move bestMove;
+            ASSERT_TRUE(brain.lookup(state.transformed(symmetry), evaluation, bestMove));
+            EXPECT_EQ(evaluation, expectedEvaluation);
+            EXPECT_EQ(bestMove.toBinary(), Ultimate3TState::transformMove(expectedMove, symmetry).toBinary());
+        }
+    }
+}
+
+TEST(BrainTests, Lookup_MissingState_ReturnsFalse)
+{
+    std::vector<Ultimate3TState> states = createRandomStates(50, 7);
+    std::vector<brainRecord> records = createRecords(states);
+    std::string path = brainPath("missing.bin");
+    writeBrainFile(path, records, 4);
+    Brain brain(path);
+
+    Ultimate3TState start;
+    evaluationValue evaluation;
+    move bestMove;
+    EXPECT_FALSE(brain.lookup(start, evaluation, bestMove));
+    EXPECT_THROW(brain.bestMove(start), std::out_of_range);
+}
+
+TEST(BrainTests, WriteBrain_TrainerSolve_MatchesMinimax)
+{
+    std::stringstream unused;
+    AgentTrainer trainer(unused);
+    Ultimate3TState state = createTopRowGame();
+    evaluationValue solved = trainer.minimax(state);
+    std::string path = brainPath("trainer.bin");
+    {
+        std::ofstream file(path, std::ios::binary);
+        trainer.writeBrain(file);
+    }
+    Brain brain(path);
+
+    EXPECT_EQ(brain.size(), 10);
+    evaluationValue evaluation;
+    move bestMove;
+    ASSERT_TRUE(brain.lookup(state, evaluation, bestMove));
+    EXPECT_EQ(evaluation, solved);
+    // x takes board 8, and with it the game, down the middle column.
+    EXPECT_EQ(bestMove.toBinary(), move(board8, 1).toBinary());
+    EXPECT_EQ(brain.bestMove(state).toBinary(), move(board8, 1).toBinary());
+}
+
+TEST(BrainTests, Write_UnsortedRecords_ThrowsError)
+{
+    std::vector<brainRecord> records = {brainRecord::create(packedPosition{2, 0}, evaluationValue(), move()), brainRecord::create(packedPosition{1, 0}, evaluationValue(), move())};
+    std::stringstream output;
+
+    EXPECT_THROW(Brain::write(output, records), std::invalid_argument);
+}
+
+TEST(BrainTests, Constructor_InvalidFiles_ThrowsError)
+{
+    EXPECT_THROW(Brain brain(brainPath("does_not_exist.bin")), std::runtime_error);
+
+    std::string path = brainPath("not_a_brain.bin");
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << std::string(200, '0');
+    }
+    EXPECT_THROW(Brain brain(path), std::runtime_error);
+
+    // a brain cut off part way through its records.
+    std::vector<Ultimate3TState> states = createRandomStates(20, 8);
+    std::stringstream full;
+    Brain::write(full, createRecords(states));
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << full.str().substr(0, sizeof(brainHeader) + sizeof(brainRecord));
+    }
+    EXPECT_THROW(Brain brain(path), std::runtime_error);
+
+    // a brain of an older version, and brains whose records or index are not aligned.
+    for (int change = 0; change < 3; change++)
+    {
+        std::string contents = full.str();
+        brainHeader header;
+        memcpy(&header, contents.data(), sizeof(header));
+        if (change == 0) { header.version = 1; }
+        if (change == 1) { header.recordsOffset += 4; }
+        if (change == 2) { header.indexOffset += 4; }
+        memcpy(&contents[0], &header, sizeof(header));
+        {
+            std::ofstream file(path, std::ios::binary);
+            file << contents << std::string(8, '0');
+        }
+        EXPECT_THROW(Brain brain(path), std::runtime_error) << "change " << change;
+    }
+}
+
+TEST(BrainTests, BrainTable_EveryTableSize_MatchesBrain)
+{
+    std::vector<Ultimate3TState> states = createRandomStates(200, 9);
+    std::vector<brainRecord> allRecords = createRecords(states);
+    std::string path = brainPath("table.bin");
+    writeBrainFile(path, allRecords, Brain::DefaultIndexStride);
+    Brain brain(path);
+
+    // sizes around powers of two, where the shape of the tree changes.
+    for (size_t size : {size_t(0), size_t(1), size_t(2), size_t(3), size_t(7), size_t(8), size_t(9), size_t(64), allRecords.size()})
+    {
+        std::vector<brainRecord> records(allRecords.begin(), allRecords.begin() + size);
+        BrainTable table(records);
+        ASSERT_EQ(table.size(), size);
+
+        for (Ultimate3TState& state : states)
+        {
+            evaluationValue brainEvaluation;
+            move brainMove;
+            bool inTable = std::any_of(records.begin(), records.end(), [&state](const brainRecord& record) { return record.key == state.toPackedPosition(state.canonicalSymmetry()); });
+            ASSERT_TRUE(brain.lookup(state, brainEvaluation, brainMove));
+
+            evaluationValue evaluation;
+            move bestMove;
+            ASSERT_EQ(table.lookup(state, evaluation, bestMove), inTable) << "size " << size;
+            if (inTable)
+            {
+                EXPECT_EQ(evaluation, brainEvaluation);
+                EXPECT_EQ(bestMove.toBinary(), brainMove.toBinary());
+            }
+        }
+    }
+}
+
+TEST(BrainTests, BrainTable_LookupBatch_MatchesLookup)
+{
+    std::vector<Ultimate3TState> states = createRandomStates(100, 10);
+    std::vector<Ultimate3TState> storedStates(states.begin(), states.begin() + 60);
+    BrainTable table(createRecords(storedStates));
+
+    // a batch that is not a multiple of BatchSize, with states missing from the table mixed in.
+    std::vector<Ultimate3TState> queries(states.begin(), states.begin() + 2 * BrainTable::BatchSize + 5);
+    queries.push_back(Ultimate3TState());
+    queries.insert(queries.end(), states.begin() + 60, states.end());
+    std::vector<brainLookup> results;
+    table.lookupBatch(queries, results);
+
+    ASSERT_EQ(results.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        evaluationValue evaluation;
+        move bestMove;
+        bool found = table.lookup(queries[i], evaluation, bestMove);
+        ASSERT_EQ(results[i].found, found) << "query " << i;
+        if (found)
+        {
+            EXPECT_EQ(results[i].evaluation, evaluation);
+            EXPECT_EQ(results[i].bestMove.toBinary(), bestMove.toBinary());
+        }
+    }
+    EXPECT_FALSE(results[2 * BrainTable::BatchSize + 5].found);
+}
+
+TEST(BrainTests, BrainTable_FromBrainFile_MatchesTrainerTable)
+{
+    std::stringstream unused;
+    AgentTrainer trainer(unused);
+    Ultimate3TState state = createTopRowGame();
+    trainer.minimax(state);
+    std::string path = brainPath("trainer_table.bin");
+    {
+        std::ofstream file(path, std::ios::binary);
+        trainer.writeBrain(file);
+    }
+    Brain brain(path);
+    BrainTable fromBrain(brain);
+    BrainTable fromTrainer = trainer.createBrainTable();
+
+    EXPECT_EQ(fromBrain.size(), 10);
+    EXPECT_EQ(fromTrainer.size(), 10);
+    EXPECT_EQ(fromBrain.bestMove(state).toBinary(), move(board8, 1).toBinary());
+    EXPECT_EQ(fromTrainer.bestMove(state).toBinary(), move(board8, 1).toBinary());
+    EXPECT_THROW(fromTrainer.bestMove(Ultimate3TState()), std::out_of_range);
+}
+
+TEST(BrainTests, BrainTable_UnsortedRecords_ThrowsError)
+{
+    std::vector<brainRecord> records = {brainRecord::create(packedPosition{2, 0}, evaluationValue(), move()), brainRecord::create(packedPosition{1, 0}, evaluationValue(), move())};
+
+    EXPECT_THROW(BrainTable table(records), std::invalid_argument);
+}
+
+TEST(BrainTests, CompressedBrain_EveryBlockSize_MatchesBrain)
+{
+    std::vector<Ultimate3TState> states = createRandomStates(300, 11);
+    std::vector<brainRecord> records = createRecords(states);
+    std::string brainFile = brainPath("uncompressed.bin");
+    writeBrainFile(brainFile, records, Brain::DefaultIndexStride);
+    Brain brain(brainFile);
+
+    for (uint32_t blockSize : {uint32_t(1), uint32_t(7), CompressedBrain::DefaultBlockSize, uint32_t(1000)})
+    {
+        std::string path = brainPath("compressed.binz");
+        {
+            std::ofstream file(path, std::ios::binary);
+            CompressedBrain::write(file, records, blockSize);
+        }
+        CompressedBrain compressed(path);
+        ASSERT_EQ(compressed.size(), records.size());
+
+        for (Ultimate3TState& state : states)
+        {
+            evaluationValue brainEvaluation;
+            move brainMove;
+            ASSERT_TRUE(brain.lookup(state, brainEvaluation, brainMove));
+
+            evaluationValue evaluation;
+            move bestMove;
+            ASSERT_TRUE(compressed.lookup(state, evaluation, bestMove)) << "block size " << blockSize;
+            // the compressed brain does not keep depths.
+            EXPECT_EQ(evaluation, evaluationValue(brainEvaluation.getPlayerToWin(), 0));
+            EXPECT_EQ(bestMove.toBinary(), brainMove.toBinary());
+        }
+        EXPECT_THROW(compressed.bestMove(Ultimate3TState()), std::out_of_range);
+    }
+}
+
+TEST(BrainTests, CompressedBrain_KeyGaps_WriteShortestVarints)
+{
+    // a gap that borrows from the high word, and one that fills almost all 128 bits.
+    std::vector<brainRecord> records = {
+        brainRecord::create(packedPosition{UINT64_MAX, 0}, evaluationValue(player::x, 1), move(board1, 2)),
+        brainRecord::create(packedPosition{5, 1}, evaluationValue(player::o, 1), move(board8, 8)),
+        brainRecord::create(packedPosition{0, UINT64_MAX >> 1}, evaluationValue(player::draw, 1), move(board4, 0))};
+    std::string path = brainPath("wide.binz");
+    {
+        std::ofstream file(path, std::ios::binary);
+        CompressedBrain::write(file, records, 4);
+    }
+    std::ifstream file(path, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // 27 bits of values in 4 bytes, a gap of 6 in 1 byte, and a gap of about 2^127 in 19 bytes.
+    EXPECT_EQ(contents.size(), sizeof(compressedBrainHeader) + sizeof(blockSample) + 4 + 1 + 19);
+}
+
+TEST(BrainTests, CompressedBrain_TrainerSolve_IsSmallerThanBrain)
+{
+    std::stringstream unused;
+    AgentTrainer trainer(unused);
+    Ultimate3TState state = createTopRowGame();
+    trainer.minimax(state);
+    std::stringstream brainOutput;
+    trainer.writeBrain(brainOutput);
+    std::string path = brainPath("trainer.binz");
+    {
+        std::ofstream file(path, std::ios::binary);
+        trainer.writeCompressedBrain(file);
+    }
+    CompressedBrain compressed(path);
+
+    EXPECT_EQ(compressed.size(), 10);
+    EXPECT_EQ(compressed.bestMove(state).toBinary(), move(board8, 1).toBinary());
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    EXPECT_LT(size_t(file.tellg()), brainOutput.str().size());
+}
+
+TEST(BrainTests, CompressedBrain_InvalidFiles_ThrowsError)
+{
+    std::string path = brainPath("invalid.binz");
+    std::vector<Ultimate3TState> states = createRandomStates(20, 12);
+    std::vector<brainRecord> records = createRecords(states);
+    {
+        std::ofstream file(path, std::ios::binary);
+        Brain::write(file, records);
+    }
+    // an uncompressed brain is not a compressed one.
+    EXPECT_THROW(CompressedBrain compressed(path), std::runtime_error);
+
+    std::stringstream full;
+    CompressedBrain::write(full, records);
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << full.str().substr(0, full.str().size() - 1);
+    }
+    EXPECT_THROW(CompressedBrain compressed(path), std::runtime_error);
+
+    std::stringstream unused;
+    EXPECT_THROW(CompressedBrain::write(unused, records, 0), std::invalid_argument);
+}
@@ -0,0 +1,217 @@
+/* Andrew Bergman
+12-14-23
+Tests for the proof number search solver and its table.
+*/
+#include "gtest/gtest.h"
+#include "Agent.h"
+#include "ProofNumberSearch.h"
+#include "TestStates.h"
+#include <fstream>
+#include <sstream>
+
+namespace ProofNumberSearchTestFunctions
+{
+    // Whether x is sure to get at least result (or at most, if atLeast is false) by following the brain, whatever o plays, and o the other way round. Every state the check reaches must be in the brain with a result that bound holds for.
+    bool brainKeepsBound(const BrainTable& brain, Ultimate3TState& state, player result, bool atLeast)
+    {
+        if (state.isTerminalState())
+        {
+            evaluationValue final(state.utility(), 0);
+            evaluationValue bound(result, 0);
+            return atLeast ? !(final < bound) : !(bound < final);
+        }
+        evaluationValue evaluation;
+        move bestMove;
+        if (!brain.lookup(state, evaluation, bestMove)) { return false; }
+        // the player the bound is for follows the brain, and every move of the other player is tried.
+        player boundPlayer = atLeast ? player::x : player::o;
+        std::vector<move> moves = state.generateMoves();
+        if (state.getActivePlayer() == boundPlayer) { moves = {bestMove}; }
+        for (const move& action : moves)
+        {
+            undoRecord undo = state.makeMove(action);
+            bool kept = brainKeepsBound(brain, state, result, atLeast);
+            state.unmakeMove(undo);
+            if (!kept) { return false; }
+        }
+        return true;
+    }
+}
+using namespace ProofNumberSearchTestFunctions;
+using namespace TestStates;
+
+TEST(ProofNumberSearchTests, Probe_StoredState_ReturnsStoredNumbers)
+{
+    ProofNumberTable table(1);
+    table.store(0x1234, proofNumbers{3, 7}, 12);
+    proofNumbers found;
+    uint32_t work;
+
+    ASSERT_TRUE(table.probe(0x1234, found, work));
+    EXPECT_EQ(found.proof, 3u);
+    EXPECT_EQ(found.disproof, 7u);
+    EXPECT_EQ(work, 12u);
+    EXPECT_FALSE(table.probe(0x4321, found, work));
+    EXPECT_EQ(table.size(), 1u);
+}
+
+TEST(ProofNumberSearchTests, Store_SameState_OverwritesWithoutGrowing)
+{
+    ProofNumberTable table(1);
+    table.store(0x1234, proofNumbers{3, 7}, 12);
+    table.store(0x1234, proofNumbers::proven(), 20);
+    proofNumbers found;
+    uint32_t work;
+
+    ASSERT_TRUE(table.probe(0x1234, found, work));
+    EXPECT_TRUE(found.isProven());
+    EXPECT_EQ(table.size(), 1u);
+}
+
+TEST(ProofNumberSearchTests, Store_FullBucket_ReplacesLeastWork)
+{
+    ProofNumberTable table(1);
+    uint64_t sameBucket = uint64_t(1) << 40;
+    for (int i = 0; i < ProofNumberTable::BucketSize; i++)
+    {
+        table.store(sameBucket * (i + 1), proofNumbers{1, 1}, 1 << (i + 2));
+    }
+
+    table.store(sameBucket * 10, proofNumbers{1, 1}, 100);
+    proofNumbers found;
+    uint32_t work;
+
+    EXPECT_FALSE(table.probe(sameBucket * 1, found, work));
+    EXPECT_TRUE(table.probe(sameBucket * 2, found, work));
+    EXPECT_TRUE(table.probe(sameBucket * 10, found, work));
+}
+
+TEST(ProofNumberSearchTests, CollectGarbage_FullTable_KeepsMostWorkAndSolved)
+{
+    ProofNumberTable table(0);
+    // a table of no megabytes still has one bucket.
+    ASSERT_EQ(table.getCapacity(), size_t(ProofNumberTable::BucketSize));
+    uint64_t sameBucket = uint64_t(1) << 40;
+    table.store(sameBucket * 1, proofNumbers{1, 1}, 5);
+    table.store(sameBucket * 2, proofNumbers{2, 2}, 1000);
+    table.store(sameBucket * 3, proofNumbers::proven(), 1000);
+
+    // the table is 75% full, so this store collects garbage first, which throws away two of the three entries, least work first and unsolved before solved.
+    table.store(sameBucket * 4, proofNumbers{1, 1}, 1);
+    proofNumbers found;
+    uint32_t work;
+
+    EXPECT_EQ(table.getCollections(), 1u);
+    EXPECT_FALSE(table.probe(sameBucket * 1, found, work));
+    EXPECT_FALSE(table.probe(sameBucket * 2, found, work));
+    EXPECT_TRUE(table.probe(sameBucket * 3, found, work));
+    EXPECT_TRUE(table.probe(sameBucket * 4, found, work));
+    EXPECT_EQ(table.size(), 2u);
+}
+
+TEST(ProofNumberSearchTests, CollectGarbage_ManyEntries_RemovesAtLeastHalf)
+{
+    ProofNumberTable table(1);
+    for (uint64_t i = 0; i < 1000; i++)
+    {
+        table.store(i * 0x9E3779B97F4A7C15ull, proofNumbers{1, 1}, uint32_t(i % 50 + 1));
+    }
+
+    table.collectGarbage();
+
+    EXPECT_LE(table.size(), 500u);
+    EXPECT_GT(table.size(), 0u);
+}
+
+TEST(ProofNumberSearchTests, Clear_StoredState_IsRemoved)
+{
+    ProofNumberTable table(1);
+    table.store(0x1234, proofNumbers{3, 7}, 12);
+
+    table.clear();
+    proofNumbers found;
+    uint32_t work;
+
+    EXPECT_FALSE(table.probe(0x1234, found, work));
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST(ProofNumberSearchTests, Solve_LateGames_MatchesMinimaxWithFewerStates)
+{
+    unsigned int minimaxStates = 0;
+    unsigned int proofNumberStates = 0;
+    for (unsigned int seed = 1; seed <= 8; seed++)
+    {
+        Ultimate3TState state = createRandomGameState(seed, LateGameMoves);
+        std::stringstream outputStream;
+        AgentTrainer trainer(outputStream, 1);
+        ProofNumberSolver<Ultimate3TState> solver(1);
+        std::string originalEncoding = state.toBinary().to_string();
+
+        evaluationValue minimaxValue = trainer.minimax(state);
+        player result = solver.solve(state);
+
+        EXPECT_EQ(result, minimaxValue.getPlayerToWin()) << "seed " << seed;
+        EXPECT_EQ(state.toBinary().to_string(), originalEncoding);
+        minimaxStates += trainer.getStatesExpanded();
+        proofNumberStates += solver.getStatesExpanded();
+    }
+
+    EXPECT_LT(proofNumberStates, minimaxStates);
+}
+
+TEST(ProofNumberSearchTests, Solve_TinyTable_CollectsGarbageAndStillSolves)
+{
+    unsigned int collections = 0;
+    for (unsigned int seed = 1; seed <= 8; seed++)
+    {
+        Ultimate3TState state = createRandomGameState(seed, LateGameMoves);
+        ProofNumberSolver<Ultimate3TState> solver(1);
+        ProofNumberSolver<Ultimate3TState> tinySolver(0);
+
+        EXPECT_EQ(tinySolver.solve(state), solver.solve(state)) << "seed " << seed;
+        collections += tinySolver.getTable().getCollections();
+    }
+
+    EXPECT_GT(collections, 0u);
+}
+
+TEST(ProofNumberSearchTests, CreateProofTree_LateGames_ProvesResultFromBrain)
+{
+    for (unsigned int seed = 1; seed <= 8; seed++)
+    {
+        Ultimate3TState state = createRandomGameState(seed, LateGameMoves);
+        ProofNumberSolver<Ultimate3TState> solver(1);
+        player result = solver.solve(state);
+
+        std::vector<brainRecord> records = solver.createProofTree(state);
+        BrainTable brain(records);
+        evaluationValue evaluation;
+        move bestMove;
+
+        ASSERT_TRUE(brain.lookup(state, evaluation, bestMove)) << "seed " << seed;
+        EXPECT_EQ(evaluation, evaluationValue(result, 0)) << "seed " << seed;
+        // a win only needs the winner's bound proven, and a draw needs both.
+        if (result != player::o) { EXPECT_TRUE(brainKeepsBound(brain, state, result, true)) << "seed " << seed; }
+        if (result != player::x) { EXPECT_TRUE(brainKeepsBound(brain, state, result, false)) << "seed " << seed; }
+    }
+}
+
+TEST(ProofNumberSearchTests, WriteBrain_LateGame_OpensAsBrain)
+{
+    Ultimate3TState state = createRandomGameState(3, LateGameMoves);
+    ProofNumberSolver<Ultimate3TState> solver(1);
+    player result = solver.solve(state);
+    std::string path = testing::TempDir() + "proofTree.bin";
+    {
+        std::ofstream file(path, std::ios::binary);
+        solver.writeBrain(file, state);
+    }
+    Brain brain(path);
+
+    EXPECT_EQ(brain.size(), solver.createProofTree(state).size());
+    evaluationValue evaluation;
+    move bestMove;
+    ASSERT_TRUE(brain.lookup(state, evaluation, bestMove));
+    EXPECT_EQ(evaluation, evaluationValue(result, 0));
+}
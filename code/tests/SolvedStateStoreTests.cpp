@@ -0,0 +1,123 @@
+/* Andrew Bergman
+12-15-23
+Tests for SolvedStateStore, which keeps the states AgentTrainer solves in a fixed amount of memory.
+*/
+#include "gtest/gtest.h"
+#include "SolvedStateStore.h"
+#include <vector>
+
+namespace SolvedStateStoreTestFunctions
+{
+    // An entry whose position is the given number, with the given depth, so that entries for the same position can be told apart.
+    trainerEntry createEntry(uint64_t position, int depth = 0)
+    {
+        return trainerEntry{packedPosition{position, 0}, evaluationValue(player::x, depth), move()};
+    }
+
+    std::vector<trainerEntry> readAll(SolvedStateStore& store)
+    {
+        std::vector<trainerEntry> entries;
+        store.forEach([&entries](const trainerEntry& entry) { entries.push_back(entry); });
+        return entries;
+    }
+}
+using namespace SolvedStateStoreTestFunctions;
+
+TEST(SolvedStateStoreTests, ForEach_FewEntries_SortedWithoutRuns)
+{
+    SolvedStateStore store;
+    for (uint64_t position : {5, 1, 3, 2, 4}) { store.add(createEntry(position)); }
+
+    std::vector<trainerEntry> entries = readAll(store);
+
+    EXPECT_EQ(store.getRunCount(), 0u);
+    ASSERT_EQ(entries.size(), 5u);
+    for (size_t i = 0; i < entries.size(); i++) { EXPECT_EQ(entries[i].position.low, i + 1); }
+}
+
+TEST(SolvedStateStoreTests, Add_FullBuffer_WritesSortedRuns)
+{
+    SolvedStateStore store;
+    store.setBufferCapacity(4);
+    for (uint64_t position = 10; position > 0; position--) { store.add(createEntry(position)); }
+
+    std::vector<trainerEntry> entries = readAll(store);
+
+    EXPECT_EQ(store.getRunCount(), 2u);
+    ASSERT_EQ(entries.size(), 10u);
+    for (size_t i = 0; i < entries.size(); i++) { EXPECT_EQ(entries[i].position.low, i + 1); }
+}
+
+TEST(SolvedStateStoreTests, ForEach_PositionInSeveralRuns_KeepsLastAdded)
+{
+    SolvedStateStore store;
+    store.setBufferCapacity(3);
+    // position 7 is in the first run, the second run and the buffer, and position 8 in both runs.
+    store.add(createEntry(7, 1));
+    store.add(createEntry(8, 1));
+    store.add(createEntry(7, 2));
+    store.add(createEntry(8, 2));
+    store.add(createEntry(7, 3));
+    store.add(createEntry(1));
+    store.add(createEntry(7, 4));
+
+    std::vector<trainerEntry> entries = readAll(store);
+
+    EXPECT_EQ(store.getRunCount(), 2u);
+    ASSERT_EQ(entries.size(), 3u);
+    EXPECT_EQ(entries[1].position.low, 7u);
+    EXPECT_EQ(entries[1].evaluation, evaluationValue(player::x, 4));
+    EXPECT_EQ(entries[2].position.low, 8u);
+    EXPECT_EQ(entries[2].evaluation, evaluationValue(player::x, 2));
+}
+
+TEST(SolvedStateStoreTests, Add_MoreThanMaxRuns_MergesRunsKeepingLastAdded)
+{
+    SolvedStateStore store;
+    store.setBufferCapacity(2);
+    const uint64_t Positions = SolvedStateStore::MaxRuns * 3;
+    for (uint64_t position = 0; position < Positions; position++) { store.add(createEntry(position % 5, int(position))); }
+
+    std::vector<trainerEntry> entries = readAll(store);
+
+    EXPECT_LE(store.getRunCount(), SolvedStateStore::MaxRuns);
+    ASSERT_EQ(entries.size(), 5u);
+    for (uint64_t position = 0; position < 5; position++)
+    {
+        // the last depth added for each position is the largest below Positions with the same remainder.
+        uint64_t lastAdded = Positions - 1 - (Positions - 1 - position) % 5;
+        EXPECT_EQ(entries[position].evaluation, evaluationValue(player::x, int(lastAdded))) << "position " << position;
+    }
+}
+
+TEST(SolvedStateStoreTests, ForEach_CalledTwice_GivesSameEntries)
+{
+    SolvedStateStore store;
+    store.setBufferCapacity(3);
+    for (uint64_t position = 0; position < 10; position++) { store.add(createEntry(position * 7 % 10)); }
+
+    std::vector<trainerEntry> first = readAll(store);
+    std::vector<trainerEntry> second = readAll(store);
+
+    ASSERT_EQ(first.size(), second.size());
+    for (size_t i = 0; i < first.size(); i++) { EXPECT_EQ(first[i].position, second[i].position); }
+}
+
+TEST(SolvedStateStoreTests, Clear_WithRuns_RemovesEverything)
+{
+    SolvedStateStore store;
+    store.setBufferCapacity(2);
+    for (uint64_t position = 0; position < 5; position++) { store.add(createEntry(position)); }
+
+    store.clear();
+
+    EXPECT_EQ(store.getRunCount(), 0u);
+    EXPECT_TRUE(readAll(store).empty());
+}
+
+TEST(SolvedStateStoreTests, Resize_NoMegabytes_KeepsMinimumBuffer)
+{
+    SolvedStateStore store(0);
+
+    EXPECT_EQ(store.getBufferCapacity(), size_t(SolvedStateStore::MinimumBufferEntries));
+}
@@ -0,0 +1,607 @@
+/* Andrew Bergman
+11-20-23
+Tests for the TIM agent's alpha beta search.
+*/
+#include "gtest/gtest.h"
+#include "Agent.h"
+#include "TestStates.h"
+#include <random>
+#include <sstream>
+#include <chrono>
+#include <future>
+#include <thread>
+
+namespace TIMTestFunctions
+{
+    // Creates a state where every board but board 8 is decided, and x takes the game by winning board 8.
+    Ultimate3TState createWinInOneState()
+    {
+        Ultimate3TState state;
+
+        for (int i = 0; i < 9; i++)
+        {
+            state.setSpacePlayed(0, i, draw);
+            state.setSpacePlayed(1, i, draw);
+            state.setSpacePlayed(2, i, x);
+            state.setSpacePlayed(3, i, draw);
+            state.setSpacePlayed(4, i, draw);
+            state.setSpacePlayed(5, i, x);
+            state.setSpacePlayed(6, i, o);
+            state.setSpacePlayed(7, i, o);
+        }
+        state.setSpacePlayed(8, 0, x);
+        state.setSpacePlayed(8, 1, x);
+        for (int i = 4; i < 9; i++)
+        {
+            state.setSpacePlayed(8, i, draw);
+        }
+        return state;
+    }
+
+    // Creates a state where only boards 7 and 8 are still being played, each with emptySpaces empty spaces. x takes the game by winning board 8 and o by winning board 7. The filled spaces are chosen randomly from the seed.
+    Ultimate3TState createEndgameState(unsigned int seed, int emptySpaces)
+    {
+        std::mt19937 random(seed);
+        player decided[7] = {draw, o, x, draw, o, x, draw};
+        Ultimate3TState state;
+        // keep filling boards 7 and 8 randomly until there is a fill where noone has won either board yet. Board results are not undone when spaces are cleared, so each attempt starts from a new state.
+        do
+        {
+            state = Ultimate3TState();
+            for (int board = 0; board < 7; board++)
+            {
+                for (int space = 0; space < 9; space++)
+                {
+                    state.setSpacePlayed(board, space, decided[board]);
+                }
+            }
+            for (int board = 7; board < 9; board++)
+            {
+                std::vector<int> spaces = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+                std::shuffle(spaces.begin(), spaces.end(), random);
+                for (int i = 0; i < 9 - emptySpaces; i++)
+                {
+                    state.setSpacePlayed(board, spaces[i], i % 2 == 0 ? player::x : player::o);
+                }
+            }
+        } while (state.getBoardResult(7) != player::neither or state.getBoardResult(8) != player::neither);
+        state.setActiveBoard(anyBoard);
+        state.setActivePlayer(seed % 2 == 0 ? player::x : player::o);
+        return state;
+    }
+
+    // Whether a move is one of the legal moves in a state.
+    bool isLegalMove(Ultimate3TState state, move played)
+    {
+        std::vector<move> legalMoves = state.generateMoves();
+        return std::any_of(legalMoves.begin(), legalMoves.end(), [&played](const move& legal) { return legal.toBinary() == played.toBinary(); });
+    }
+
+    // Whether two evaluations are worth the same. Draws are worth the same at any depth, so minimax and TIM may report different depths for them.
+    bool equallyGood(evaluationValue first, evaluationValue second)
+    {
+        return !(first > second) and !(second > first);
+    }
+}
+using namespace TIMTestFunctions;
+using namespace TestStates;
+
+TEST(TIMTests, PlayMove_WinInOne_PlaysWinningMove)
+{
+    TIM<Ultimate3TState> tim;
+    Ultimate3TState state = createWinInOneState();
+
+    move played = tim.playMove(state);
+
+    EXPECT_EQ(played.toBinary(), move(board8, 2).toBinary());
+}
+
+TEST(TIMTests, Search_WinInOne_EvaluatesXWin)
+{
+    TIM<Ultimate3TState> tim;
+    Ultimate3TState state = createWinInOneState();
+
+    std::pair<move, evaluationValue> result = tim.search(state);
+
+    EXPECT_EQ(result.second, evaluationValue(player::x, 1));
+}
+
+TEST(TIMTests, Search_EmptyWindow_ThrowsInvalidArgument)
+{
+    TIM<Ultimate3TState> tim;
+    Ultimate3TState state = createWinInOneState();
+
+    EXPECT_THROW(tim.search(state, evaluationValue(player::draw, 0), evaluationValue(player::draw, 0)), std::invalid_argument);
+}
+
+TEST(TIMTests, Search_AnyState_LeavesStateUnchanged)
+{
+    TIM<Ultimate3TState> tim;
+    Ultimate3TState state = createWinInOneState();
+    std::bitset<ENCODINGSIZE> originalEncoding = state.toBinary();
+
+    tim.search(state);
+
+    EXPECT_EQ(state.toBinary(), originalEncoding);
+}
+
+class TIMEndgameTests :
+    public testing::TestWithParam<unsigned int>
+{};
+
+TEST_P(TIMEndgameTests, Search_Endgame_MatchesMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 3);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+    std::pair<move, evaluationValue> result = tim.search(state);
+
+    EXPECT_TRUE(equallyGood(result.second, minimaxValue));
+}
+
+TEST_P(TIMEndgameTests, Search_NarrowWindowThenFullWindow_MatchesMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 3);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+    // no evaluation is strictly between a draw and x's slowest win, so this window only asks whether x wins. It fills the table with bounds, which the full search must not treat as exact.
+    tim.search(state, evaluationValue(player::draw, 0), evaluationValue(player::x, 81));
+    std::pair<move, evaluationValue> result = tim.search(state);
+
+    EXPECT_TRUE(equallyGood(result.second, minimaxValue));
+}
+
+TEST_P(TIMEndgameTests, Search_BestMove_AchievesEvaluation)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 3);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+
+    std::pair<move, evaluationValue> result = tim.search(state);
+    state.makeMove(result.first);
+    evaluationValue afterBestMove = trainer.minimax(state);
+    afterBestMove = afterBestMove.deeper();
+
+    EXPECT_TRUE(equallyGood(afterBestMove, result.second));
+}
+
+TEST_P(TIMEndgameTests, Search_SeveralThreads_MatchesMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 3);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1, false, 4);
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+    std::pair<move, evaluationValue> result = tim.search(state);
+    state.makeMove(result.first);
+    evaluationValue afterBestMove = trainer.minimax(state);
+    afterBestMove = afterBestMove.deeper();
+
+    EXPECT_TRUE(equallyGood(result.second, minimaxValue));
+    EXPECT_TRUE(equallyGood(afterBestMove, result.second));
+}
+
+TEST_P(TIMEndgameTests, IterativeDeepening_Endgame_SolvesAndMatchesMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 3);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+    timSearchResult result = tim.iterativeDeepening(state);
+    state.makeMove(result.bestMove);
+    evaluationValue afterBestMove = trainer.minimax(state);
+    afterBestMove = afterBestMove.deeper();
+
+    EXPECT_TRUE(result.solved or result.evaluation.getPlayerToWin() != player::draw);
+    EXPECT_TRUE(equallyGood(result.evaluation, minimaxValue));
+    EXPECT_TRUE(equallyGood(afterBestMove, minimaxValue));
+}
+
+TEST_P(TIMEndgameTests, Search_NoMoveOrdering_MatchesMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 3);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+    tim.setMoveOrdering(moveOrdering::none());
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+    std::pair<move, evaluationValue> result = tim.search(state);
+
+    EXPECT_TRUE(equallyGood(result.second, minimaxValue));
+}
+
+TEST_P(TIMEndgameTests, Search_PrincipalVariation_MatchesMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 4);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+    tim.setSearchAlgorithm(principalVariationSearch);
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+    std::pair<move, evaluationValue> result = tim.search(state);
+    state.makeMove(result.first);
+    evaluationValue afterBestMove = trainer.minimax(state);
+    afterBestMove = afterBestMove.deeper();
+
+    EXPECT_TRUE(equallyGood(result.second, minimaxValue));
+    EXPECT_TRUE(equallyGood(afterBestMove, minimaxValue));
+}
+
+TEST_P(TIMEndgameTests, Search_Mtdf_MatchesMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 4);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+    tim.setSearchAlgorithm(mtdfSearch);
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+    std::pair<move, evaluationValue> result = tim.search(state);
+    state.makeMove(result.first);
+    evaluationValue afterBestMove = trainer.minimax(state);
+    afterBestMove = afterBestMove.deeper();
+
+    EXPECT_TRUE(equallyGood(result.second, minimaxValue));
+    EXPECT_TRUE(equallyGood(afterBestMove, minimaxValue));
+    EXPECT_GE(tim.getRootSearches(), 1u);
+}
+
+TEST_P(TIMEndgameTests, IterativeDeepening_Mtdf_SolvesAndMatchesMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 3);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+    tim.setSearchAlgorithm(mtdfSearch);
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+    timSearchResult result = tim.iterativeDeepening(state);
+
+    EXPECT_TRUE(result.solved or result.evaluation.getPlayerToWin() != player::draw);
+    EXPECT_TRUE(equallyGood(result.evaluation, minimaxValue));
+}
+
+TEST_P(TIMEndgameTests, NullWindowSearch_Endgame_AgreesWithMinimax)
+{
+    Ultimate3TState state = createEndgameState(GetParam(), 3);
+    std::stringstream outputStream;
+    AgentTrainer trainer(outputStream, 1);
+    TIM<Ultimate3TState> tim(1);
+    move bestMove;
+
+    evaluationValue minimaxValue = trainer.minimax(state);
+
+    EXPECT_TRUE(tim.nullWindowSearch(state, minimaxValue, bestMove));
+    EXPECT_EQ(tim.nullWindowSearch(state, evaluationValue(player::draw, 0), bestMove), !(minimaxValue < evaluationValue(player::draw, 0)));
+    EXPECT_EQ(tim.nullWindowSearch(state, evaluationValue(player::x, 81), bestMove), minimaxValue.getPlayerToWin() == player::x);
+}
+
+INSTANTIATE_TEST_SUITE_P(TIMTests, TIMEndgameTests, testing::Values(1u, 2u, 3u, 4u, 5u, 6u, 7u, 8u));
+
+TEST(TIMTests, PlayMove_SeveralThreads_PlaysWinningMove)
+{
+    TIM<Ultimate3TState> tim;
+    tim.setThreadCount(4);
+    Ultimate3TState state = createWinInOneState();
+
+    move played = tim.playMove(state);
+
+    EXPECT_EQ(played.toBinary(), move(board8, 2).toBinary());
+    EXPECT_EQ(tim.getThreadCount(), 4);
+}
+
+// MTD(f) runs many root searches, which the same helper threads are woken for each time, until the thread count changes and new ones are started.
+TEST(TIMTests, SetThreadCount_BetweenMtdfSearches_SolvesAlike)
+{
+    Ultimate3TState state = createEndgameState(3, 3);
+    TIM<Ultimate3TState> tim(1, false, 4);
+    tim.setSearchAlgorithm(mtdfSearch);
+
+    evaluationValue fourThreads = tim.search(state).second;
+    tim.setThreadCount(2);
+    evaluationValue twoThreads = tim.search(state).second;
+    tim.setThreadCount(1);
+    evaluationValue oneThread = tim.search(state).second;
+
+    EXPECT_GT(tim.getRootSearches(), 3u);
+    EXPECT_TRUE(equallyGood(fourThreads, oneThread));
+    EXPECT_TRUE(equallyGood(twoThreads, oneThread));
+}
+
+TEST(TIMTests, SetThreadCount_Zero_ThrowsInvalidArgument)
+{
+    TIM<Ultimate3TState> tim;
+
+    EXPECT_THROW(tim.setThreadCount(0), std::invalid_argument);
+}
+
+TEST(TIMTests, IterativeDeepening_WinInOne_StopsAtFirstDepth)
+{
+    TIM<Ultimate3TState> tim;
+    Ultimate3TState state = createWinInOneState();
+
+    timSearchResult result = tim.iterativeDeepening(state);
+
+    EXPECT_EQ(result.depth, 1);
+    EXPECT_EQ(result.bestMove.toBinary(), move(board8, 2).toBinary());
+    EXPECT_TRUE(result.evaluation == evaluationValue(player::x, 1));
+}
+
+TEST(TIMTests, IterativeDeepening_DepthLimit_StopsAtLimit)
+{
+    TIM<Ultimate3TState> tim(1);
+    tim.setTimeControl(timeControl::depth(3));
+    Ultimate3TState state;
+
+    timSearchResult result = tim.iterativeDeepening(state);
+
+    EXPECT_EQ(result.depth, 3);
+    EXPECT_FALSE(result.solved);
+    EXPECT_EQ(result.evaluation.getPlayerToWin(), player::draw);
+}
+
+TEST(TIMTests, PlayMove_MoveTime_ReturnsLegalMoveInTime)
+{
+    TIM<Ultimate3TState> tim(1, false, 2);
+    tim.setTimeControl(timeControl::fixedMoveTime(50));
+    Ultimate3TState state;
+
+    auto start = std::chrono::steady_clock::now();
+    move played = tim.playMove(state);
+    long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_LT(elapsedMs, 500);
+    EXPECT_TRUE(isLegalMove(state, played));
+}
+
+TEST(TIMTests, PlayMove_DefaultTimeControl_ReturnsLegalMoveInTime)
+{
+    TIM<Ultimate3TState> tim(1);
+    Ultimate3TState state;
+
+    auto start = std::chrono::steady_clock::now();
+    move played = tim.playMove(state);
+    long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_EQ(tim.getTimeControl().budgetMs(), TIM<Ultimate3TState>::DefaultMoveTimeMs);
+    EXPECT_LT(elapsedMs, TIM<Ultimate3TState>::DefaultMoveTimeMs + 500);
+    EXPECT_TRUE(isLegalMove(state, played));
+}
+
+TEST(TIMTests, TimeControl_Clock_SharesRemainingTime)
+{
+    EXPECT_EQ(timeControl::clock(20000, 100).budgetMs(), 20000 / timeControl::MovesToGo + 100);
+    EXPECT_EQ(timeControl::clock(100, 1000).budgetMs(), 100 - timeControl::SafetyMarginMs);
+    EXPECT_EQ(timeControl::clock(5).budgetMs(), 1);
+    EXPECT_EQ(timeControl::fixedMoveTime(250).budgetMs(), 250);
+    EXPECT_FALSE(timeControl::unlimited().hasBudget());
+    EXPECT_FALSE(timeControl::depth(4).hasBudget());
+}
+
+TEST(TIMTests, StartSearch_MoveTime_FutureGivesLegalMove)
+{
+    TIM<Ultimate3TState> tim(1);
+    Ultimate3TState state;
+
+    std::future<timSearchResult> search = tim.startSearch(state, timeControl::fixedMoveTime(50));
+    timSearchResult result = search.get();
+
+    EXPECT_GE(result.depth, 1);
+    EXPECT_TRUE(isLegalMove(state, result.bestMove));
+}
+
+TEST(TIMTests, Stop_UnlimitedSearch_GivesLastFinishedSearch)
+{
+    TIM<Ultimate3TState> tim(1, false, 2);
+    Ultimate3TState state;
+
+    std::future<timSearchResult> search = tim.startSearch(state, timeControl::unlimited());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    tim.stop();
+
+    ASSERT_EQ(search.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    timSearchResult result = search.get();
+    EXPECT_GE(result.depth, 1);
+    EXPECT_TRUE(isLegalMove(state, result.bestMove));
+    EXPECT_FALSE(tim.isSearching());
+}
+
+TEST(TIMTests, StartSearch_WhileSearching_ThrowsLogicError)
+{
+    TIM<Ultimate3TState> tim(1);
+    Ultimate3TState state;
+    move expectedReply;
+
+    std::future<timSearchResult> search = tim.startSearch(state, timeControl::unlimited());
+
+    EXPECT_THROW(tim.startSearch(state, timeControl::unlimited()), std::logic_error);
+    EXPECT_THROW(tim.startPonder(state, expectedReply), std::logic_error);
+    tim.stop();
+    search.wait();
+}
+
+TEST(TIMTests, ProgressCallback_DepthLimit_CalledForEachDepth)
+{
+    TIM<Ultimate3TState> tim(1);
+    tim.setTimeControl(timeControl::depth(4));
+    std::vector<int> depths;
+    tim.setProgressCallback([&depths](const timSearchResult& result) { depths.push_back(result.depth); });
+    Ultimate3TState state;
+
+    tim.iterativeDeepening(state);
+
+    EXPECT_EQ(depths, std::vector<int>({1, 2, 3, 4}));
+}
+
+TEST(TIMTests, PonderHit_ExpectedReply_FinishesAsNormalSearch)
+{
+    TIM<Ultimate3TState> tim(1);
+    tim.setTimeControl(timeControl::depth(4));
+    Ultimate3TState state;
+    state.makeMove(tim.playMove(state));
+    move expectedReply;
+
+    std::future<timSearchResult> ponder = tim.startPonder(state, expectedReply);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_TRUE(tim.isSearching());
+    tim.ponderHit(timeControl::fixedMoveTime(30));
+
+    ASSERT_EQ(ponder.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    timSearchResult result = ponder.get();
+    EXPECT_TRUE(isLegalMove(state, expectedReply));
+    state.makeMove(expectedReply);
+    EXPECT_GE(result.depth, 1);
+    EXPECT_TRUE(isLegalMove(state, result.bestMove));
+}
+
+TEST(TIMTests, StartPonder_WinInOne_PondersOpponentsBestReply)
+{
+    TIM<Ultimate3TState> tim;
+    Ultimate3TState state = createWinInOneState();
+    // searching the state leaves x's winning move in the table, which is the reply x is expected to make when o ponders.
+    tim.iterativeDeepening(state);
+    move expectedReply;
+
+    std::future<timSearchResult> ponder = tim.startPonder(state, expectedReply);
+    timSearchResult result = ponder.get();
+
+    EXPECT_EQ(expectedReply.toBinary(), move(board8, 2).toBinary());
+    EXPECT_TRUE(result.solved);
+}
+
+TEST(TIMTests, NullWindowSearch_WinInOne_OnlyProvesWinInOne)
+{
+    Ultimate3TState state = createWinInOneState();
+    TIM<Ultimate3TState> tim(1);
+    move bestMove;
+
+    EXPECT_TRUE(tim.nullWindowSearch(state, evaluationValue(player::x, 1), bestMove));
+    EXPECT_EQ(bestMove.toBinary(), move(board8, 2).toBinary());
+    EXPECT_FALSE(tim.nullWindowSearch(state, evaluationValue(player::x, 0), bestMove));
+}
+
+TEST(TIMTests, IterativeDeepening_DepthOne_TakesSubBoard)
+{
+    TIM<Ultimate3TState> tim(1);
+    tim.setTimeControl(timeControl::depth(1));
+    Ultimate3TState state;
+    state.setSpacePlayed(0, 0, player::x);
+    state.setSpacePlayed(0, 1, player::x);
+    state.setSpacePlayed(3, 0, player::o);
+    state.setSpacePlayed(6, 0, player::o);
+    state.setActiveBoard(board0);
+
+    timSearchResult result = tim.iterativeDeepening(state);
+
+    EXPECT_EQ(result.depth, 1);
+    EXPECT_EQ(result.bestMove.toBinary(), move(board0, 2).toBinary());
+    EXPECT_GT(result.score, 0);
+}
+
+TEST(TIMTests, MoveOrdering_DepthLimitedSearches_ExpandsFewerStates)
+{
+    std::mt19937 random(5);
+    unsigned int orderedStates = 0;
+    unsigned int unorderedStates = 0;
+    unsigned int orderedCutoffs = 0;
+    unsigned int unorderedCutoffs = 0;
+    double orderedFirstMoveCutoffs = 0;
+    double unorderedFirstMoveCutoffs = 0;
+    for (int game = 0; game < 6; game++)
+    {
+        Ultimate3TState state = createRandomGameState(random, 12);
+        if (state.isTerminalState()) { continue; }
+        TIM<Ultimate3TState> ordered(1);
+        TIM<Ultimate3TState> unordered(1);
+        unordered.setMoveOrdering(moveOrdering::none());
+        ordered.setTimeControl(timeControl::depth(5));
+        unordered.setTimeControl(timeControl::depth(5));
+
+        timSearchResult orderedResult = ordered.iterativeDeepening(state);
+        timSearchResult unorderedResult = unordered.iterativeDeepening(state);
+
+        // ordering only changes which moves are cut off, never the score of the root.
+        EXPECT_EQ(orderedResult.score, unorderedResult.score);
+        EXPECT_GT(ordered.getFirstMoveCutoffRate(), 0.0);
+        EXPECT_LE(ordered.getFirstMoveCutoffRate(), 1.0);
+        orderedStates += ordered.getStatesExpanded();
+        unorderedStates += unordered.getStatesExpanded();
+        orderedCutoffs += ordered.getCutoffs();
+        orderedFirstMoveCutoffs += ordered.getFirstMoveCutoffRate() * ordered.getCutoffs();
+        unorderedCutoffs += unordered.getCutoffs();
+        unorderedFirstMoveCutoffs += unordered.getFirstMoveCutoffRate() * unordered.getCutoffs();
+    }
+
+    EXPECT_LT(orderedStates, unorderedStates);
+    // the point of ordering is that the first move tried causes the cutoff more often.
+    EXPECT_GT(orderedFirstMoveCutoffs / orderedCutoffs, unorderedFirstMoveCutoffs / unorderedCutoffs);
+}
+
+// Helper threads search one move deeper than the calling thread, which then searches the same states with a shallower draft in the same search.
+TEST(TIMTests, TranspositionTable_ShallowerBoundInSameSearch_KeepsHelpersDeeperEntry)
+{
+    TranspositionTable table(1);
+    table.newSearch();
+    table.store(0x1234, transpositionData{evaluationValue(player::x, 9), move(board4, 4), 6, lowerBound, 120});
+
+    table.store(0x1234, transpositionData{evaluationValue(player::o, 9), move(board0, 0), 5, upperBound, -40});
+    transpositionData found;
+
+    ASSERT_TRUE(table.probe(0x1234, found));
+    EXPECT_EQ(found.depth, 6);
+    EXPECT_EQ(found.bound, lowerBound);
+    EXPECT_EQ(found.score, 120);
+    EXPECT_EQ(found.bestMove.toBinary(), move(board4, 4).toBinary());
+}
+
+TEST(TIMTests, ResetStatesExpanded_AfterSearch_ClearsCutoffs)
+{
+    TIM<Ultimate3TState> tim(1);
+    tim.setTimeControl(timeControl::depth(3));
+    Ultimate3TState state;
+    tim.iterativeDeepening(state);
+
+    EXPECT_GT(tim.getCutoffs(), 0u);
+    tim.resetStatesExpanded();
+    EXPECT_EQ(tim.getCutoffs(), 0u);
+    EXPECT_EQ(tim.getFirstMoveCutoffRate(), 0.0);
+}
+
+// A benchmark of the search algorithms on a fixed set of positions from random games, which are late enough in the game to solve quickly but still far from over. Each is solved by a new TIM, so no algorithm gains from another's table.
+TEST(TIMTests, SearchAlgorithms_MidgamePositions_SolveAlikeWithFewerStates)
+{
+    const int Positions = 12;
+    const int MovesPlayed = 58;
+    searchAlgorithm algorithms[3] = {alphaBetaSearch, principalVariationSearch, mtdfSearch};
+    unsigned int statesExpanded[3] = {0, 0, 0};
+    std::mt19937 random(17);
+    for (int position = 0; position < Positions; position++)
+    {
+        Ultimate3TState state = createRandomGameState(random, MovesPlayed);
+        evaluationValue evaluations[3];
+        for (int algorithm = 0; algorithm < 3; algorithm++)
+        {
+            TIM<Ultimate3TState> tim(16);
+            tim.setSearchAlgorithm(algorithms[algorithm]);
+            evaluations[algorithm] = tim.search(state).second;
+            statesExpanded[algorithm] += tim.getStatesExpanded();
+        }
+        EXPECT_TRUE(equallyGood(evaluations[1], evaluations[0]));
+        EXPECT_TRUE(equallyGood(evaluations[2], evaluations[0]));
+    }
+    // null windows cut off more than the whole window, so both expand no more states than alpha beta on these positions.
+    EXPECT_LE(statesExpanded[1], statesExpanded[0]);
+    EXPECT_LE(statesExpanded[2], statesExpanded[0]);
+}
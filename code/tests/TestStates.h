@@ -0,0 +1,74 @@
+/* Andrew Bergman
+12-9-23
+States shared by the tests of more than one part of the project.
+*/
+#pragma once
+#include "State.h"
+#include <random>
+
+namespace TestStates
+{
+    // Random games this long are late enough that minimax solves them quickly.
+    const int LateGameMoves = 62;
+
+    // Creates a state where the players play a "normal" game of tic tac toe
+    inline Ultimate3TState createSmallGame()
+    {
+        Ultimate3TState state;
+
+        for (int i = 0; i < 9; i++)
+        {
+            state.setSpacePlayed(0, i, draw);
+            state.setSpacePlayed(1, i, draw);
+            state.setSpacePlayed(2, i, x);
+            state.setSpacePlayed(3, i, draw);
+            state.setSpacePlayed(4, i, draw);
+            state.setSpacePlayed(5, i, x);
+            state.setSpacePlayed(6, i, o);
+            state.setSpacePlayed(7, i, o);
+        }
+
+        return state;
+    }
+
+    // Creates the small game with only the top row of board 8 left to play. x can take board 8, and with it the game, down the middle column, and o down the left column.
+    //  _ _ _
+    //  o x x
+    //  o x o
+    inline Ultimate3TState createTopRowGame()
+    {
+        Ultimate3TState state = createSmallGame();
+        player bottomRows[6] = {o, x, x, o, x, o};
+        for (int i = 3; i < 9; i++)
+        {
+            state.setSpacePlayed(8, i, bottomRows[i - 3]);
+        }
+        return state;
+    }
+
+    // Plays one random legal move. The state must not be terminal.
+    inline void playRandomMove(Ultimate3TState& state, std::mt19937& random)
+    {
+        moveList legalMoves;
+        state.generateMoves(legalMoves);
+        state.makeMove(legalMoves[random() % legalMoves.size()]);
+    }
+
+    // Plays up to movesPlayed random moves from the start, stopping early if the game ends. Taking several games from one generator gives a different game each time.
+    inline Ultimate3TState createRandomGameState(std::mt19937& random, int movesPlayed)
+    {
+        Ultimate3TState state;
+        for (int i = 0; i < movesPlayed and !state.isTerminalState(); i++)
+        {
+            playRandomMove(state, random);
+        }
+        return state;
+    }
+
+    // Plays the random game given by the seed, so that each seed always gives the same position.
+    inline Ultimate3TState createRandomGameState(unsigned int seed, int movesPlayed)
+    {
+        std::mt19937 random(seed);
+        return createRandomGameState(random, movesPlayed);
+    }
+}
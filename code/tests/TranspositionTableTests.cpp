@@ -0,0 +1,292 @@
+/* Andrew Bergman
+12-2-23
+Tests for the fixed size TranspositionTable.
+*/
+#include "gtest/gtest.h"
+#include "TranspositionTable.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace TranspositionTableTestFunctions
+{
+    uint64_t mixKey(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    // The data every thread stores for a key, so that a probe can tell whether what it found was stored for that key.
+    transpositionData dataForKey(uint64_t key)
+    {
+        player players[3] = {player::x, player::o, player::draw};
+        return transpositionData{evaluationValue(players[key % 3], int((key >> 8) % 82)), move(activeBoard((key >> 16) % 9), uint8_t((key >> 24) % 9)), uint8_t(key >> 32), boundType((key >> 40) % 3), int16_t(key >> 48)};
+    }
+}
+using namespace TranspositionTableTestFunctions;
+
+TEST(TranspositionTableTests, Probe_StoredState_ReturnsStoredData)
+{
+    TranspositionTable table(1);
+    transpositionData stored{evaluationValue(player::o, 7), move(board3, 5), 7, exactBound, -42};
+
+    table.store(0x1234, stored);
+    transpositionData found;
+    bool wasFound = table.probe(0x1234, found);
+
+    EXPECT_TRUE(wasFound);
+    EXPECT_EQ(found.evaluation, stored.evaluation);
+    EXPECT_EQ(found.bestMove.toBinary(), stored.bestMove.toBinary());
+    EXPECT_EQ(found.depth, 7);
+    EXPECT_EQ(found.score, -42);
+}
+
+TEST(TranspositionTableTests, Probe_StoredBound_ReturnsStoredBound)
+{
+    TranspositionTable table(1);
+    table.store(0x1234, transpositionData{evaluationValue(player::draw, 0), move(), 3, upperBound, 0});
+
+    transpositionData found;
+    table.probe(0x1234, found);
+
+    EXPECT_EQ(found.bound, upperBound);
+}
+
+TEST(TranspositionTableTests, Probe_StoredScore_ReturnsStoredScore)
+{
+    TranspositionTable table(1);
+    table.store(0x1234, transpositionData{evaluationValue(player::draw, 0), move(), 3, lowerBound, -321});
+    table.store(0x5678, transpositionData{evaluationValue(player::x, 2), move(), 3, upperBound, 998});
+
+    transpositionData negative;
+    transpositionData positive;
+    table.probe(0x1234, negative);
+    table.probe(0x5678, positive);
+
+    EXPECT_EQ(negative.score, -321);
+    EXPECT_EQ(negative.bound, lowerBound);
+    EXPECT_EQ(positive.score, 998);
+    EXPECT_EQ(positive.bound, upperBound);
+}
+
+TEST(TranspositionTableTests, Probe_EmptyTable_ReturnsFalse)
+{
+    TranspositionTable table(1);
+    transpositionData found;
+
+    EXPECT_FALSE(table.probe(0x1234, found));
+    EXPECT_FALSE(table.probe(0, found));
+}
+
+TEST(TranspositionTableTests, Store_FullBucket_ReplacesShallowestEntry)
+{
+    TranspositionTable table(1);
+    // keys that differ only above the index bits all land in the same bucket.
+    uint64_t sameBucket = uint64_t(1) << 40;
+    for (int i = 0; i < TranspositionTable::BucketSize; i++)
+    {
+        table.store(sameBucket * (i + 1), transpositionData{evaluationValue(player::x, 10 + i), move(), uint8_t(10 + i), exactBound, 0});
+    }
+
+    table.store(sameBucket * 10, transpositionData{evaluationValue(player::x, 50), move(), 50, exactBound, 0});
+    transpositionData found;
+
+    EXPECT_FALSE(table.probe(sameBucket * 1, found));
+    EXPECT_TRUE(table.probe(sameBucket * 2, found));
+    EXPECT_TRUE(table.probe(sameBucket * 10, found));
+}
+
+TEST(TranspositionTableTests, Store_FullBucket_ReplacesOlderSearchFirst)
+{
+    TranspositionTable table(1);
+    uint64_t sameBucket = uint64_t(1) << 40;
+    table.store(sameBucket, transpositionData{evaluationValue(player::x, 15), move(), 15, exactBound, 0});
+    table.newSearch();
+    for (int i = 1; i < TranspositionTable::BucketSize; i++)
+    {
+        table.store(sameBucket * (i + 1), transpositionData{evaluationValue(player::x, 10), move(), 10, exactBound, 0});
+    }
+
+    table.store(sameBucket * 10, transpositionData{evaluationValue(player::x, 10), move(), 10, exactBound, 0});
+    transpositionData found;
+
+    EXPECT_FALSE(table.probe(sameBucket, found));
+}
+
+TEST(TranspositionTableTests, Store_ShallowerExactForSameState_Overwrites)
+{
+    TranspositionTable table(1);
+    table.store(0x1234, transpositionData{evaluationValue(player::x, 20), move(), 20, lowerBound, 0});
+
+    table.store(0x1234, transpositionData{evaluationValue(player::o, 5), move(), 5, exactBound, 0});
+    transpositionData found;
+
+    ASSERT_TRUE(table.probe(0x1234, found));
+    EXPECT_EQ(found.depth, 5);
+    EXPECT_EQ(found.bound, exactBound);
+}
+
+TEST(TranspositionTableTests, Store_ShallowerBoundAfterNewSearch_Overwrites)
+{
+    TranspositionTable table(1);
+    table.store(0x1234, transpositionData{evaluationValue(player::x, 20), move(), 20, exactBound, 0});
+    table.newSearch();
+
+    table.store(0x1234, transpositionData{evaluationValue(player::o, 5), move(), 5, upperBound, 0});
+    transpositionData found;
+
+    ASSERT_TRUE(table.probe(0x1234, found));
+    EXPECT_EQ(found.depth, 5);
+    EXPECT_EQ(found.bound, upperBound);
+}
+
+TEST(TranspositionTableTests, Clear_StoredState_IsRemoved)
+{
+    TranspositionTable table(1);
+    table.store(0x1234, transpositionData{evaluationValue(player::draw, 0), move(), 0, exactBound, 0});
+
+    table.clear();
+    transpositionData found;
+
+    EXPECT_FALSE(table.probe(0x1234, found));
+}
+
+TEST(TranspositionTableTests, GetCapacity_OneMegabyte_FitsInBudget)
+{
+    TranspositionTable table(1);
+
+    EXPECT_EQ(table.getCapacity() * sizeof(transpositionEntry), 1024 * 1024);
+}
+
+TEST(TranspositionTableTests, ProbeAndStore_ManyThreads_NeverReturnOtherStatesData)
+{
+    // a small table and many more keys than it holds, so that threads keep overwriting each other's entries.
+    TranspositionTable table(1);
+    const int ThreadCount = 8;
+    const int OperationsPerThread = 200000;
+    const uint64_t KeyCount = table.getCapacity() * 2;
+    std::atomic<int> hits(0);
+    std::atomic<int> wrongHits(0);
+
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < ThreadCount; thread++)
+    {
+        threads.push_back(std::thread([&, thread]()
+        {
+            for (int i = 0; i < OperationsPerThread; i++)
+            {
+                uint64_t random = mixKey(uint64_t(thread) * OperationsPerThread + i);
+                uint64_t key = mixKey(random % KeyCount);
+                if (random & (1ull << 63))
+                {
+                    table.store(key, dataForKey(key));
+                    continue;
+                }
+                transpositionData found;
+                if (!table.probe(key, found)) { continue; }
+                hits++;
+                transpositionData expected = dataForKey(key);
+                if (found.evaluation != expected.evaluation or found.bestMove.toBinary() != expected.bestMove.toBinary() or found.depth != expected.depth or found.bound != expected.bound or found.score != expected.score)
+                {
+                    wrongHits++;
+                }
+            }
+        }));
+    }
+    for (std::thread& thread : threads) { thread.join(); }
+
+    EXPECT_GT(hits.load(), 0);
+    EXPECT_EQ(wrongHits.load(), 0);
+}
+
+TEST(TranspositionTableTests, WinDrawLossProbe_StoredStates_ReturnsStoredResults)
+{
+    WinDrawLossTable table(1);
+    player players[3] = {player::x, player::o, player::draw};
+    for (uint64_t i = 0; i < 1000; i++)
+    {
+        table.store(mixKey(i), players[i % 3]);
+    }
+    player found;
+
+    // a 1 megabyte table has room for every key, so every one is found with its own result.
+    for (uint64_t i = 0; i < 1000; i++)
+    {
+        ASSERT_TRUE(table.probe(mixKey(i), found));
+        EXPECT_EQ(found, players[i % 3]);
+    }
+    EXPECT_FALSE(table.probe(mixKey(1000), found));
+}
+
+TEST(TranspositionTableTests, WinDrawLossStore_SameState_OverwritesResult)
+{
+    WinDrawLossTable table(1);
+    table.store(0x1234, player::draw);
+    table.store(0x1234, player::o);
+    player found;
+
+    EXPECT_TRUE(table.probe(0x1234, found));
+    EXPECT_EQ(found, player::o);
+}
+
+TEST(TranspositionTableTests, WinDrawLossStore_FullBucket_KeepsOtherResults)
+{
+    WinDrawLossTable table(1);
+    uint64_t sameBucket = uint64_t(1) << 40;
+    for (int i = 0; i <= WinDrawLossTable::BucketSize; i++)
+    {
+        table.store(sameBucket * (i + 1), i % 2 == 0 ? player::x : player::o);
+    }
+    player found;
+
+    // one entry was replaced to make room, and every other still has its own result.
+    int kept = 0;
+    for (int i = 0; i <= WinDrawLossTable::BucketSize; i++)
+    {
+        if (!table.probe(sameBucket * (i + 1), found)) { continue; }
+        kept++;
+        EXPECT_EQ(found, i % 2 == 0 ? player::x : player::o);
+    }
+    EXPECT_EQ(kept, int(WinDrawLossTable::BucketSize));
+    EXPECT_TRUE(table.probe(sameBucket * (WinDrawLossTable::BucketSize + 1), found));
+}
+
+TEST(TranspositionTableTests, WinDrawLossProbe_SameBucketAndTopBits_IsNotFound)
+{
+    WinDrawLossTable table(1);
+    uint64_t key = uint64_t(1) << 40;
+    table.store(key, player::x);
+    player found;
+
+    // the second key is in the same bucket and only differs in the middle of the hash, so a check of just the high bits would take it for the first.
+    EXPECT_FALSE(table.probe(key | (uint64_t(1) << 20), found));
+}
+
+TEST(TranspositionTableTests, WinDrawLossStore_Neither_ThrowsInvalidArgument)
+{
+    WinDrawLossTable table(1);
+
+    EXPECT_THROW(table.store(0x1234, player::neither), std::invalid_argument);
+}
+
+TEST(TranspositionTableTests, WinDrawLossClear_StoredState_IsRemoved)
+{
+    WinDrawLossTable table(1);
+    table.store(0x1234, player::x);
+
+    table.clear();
+    player found;
+
+    EXPECT_FALSE(table.probe(0x1234, found));
+}
+
+TEST(TranspositionTableTests, WinDrawLossGetCapacity_OneMegabyte_FitsTwiceTranspositionTable)
+{
+    WinDrawLossTable table(1);
+    TranspositionTable transpositionTable(1);
+
+    EXPECT_EQ(table.getCapacity() * sizeof(uint64_t), 1024 * 1024);
+    EXPECT_EQ(table.getCapacity(), 2 * transpositionTable.getCapacity());
+}
@@ -5,6 +5,7 @@ Tests for the Ultimate3TState class.
 
 #include "State.h"
 #include <gtest/gtest.h>
+#include <random>
 namespace Ultimate3TStateTestFunctions
 {
     Ultimate3TState createTerminalState()
@@ -563,4 +564,496 @@ TEST(Ultimate3TStateTests, BinaryConstructor_Generates_CorrectActiveBoard)
     Ultimate3TState stateReconstruction(stateEncoding);
 
     EXPECT_EQ(state.getActiveBoard(), stateReconstruction.getActiveBoard());
-}
\ No newline at end of file
+}
+TEST(Ultimate3TStateTests, MakeMove_LegalMove_MatchesGenerateSuccessor)
+{
+    Ultimate3TState state;
+    state.setActiveBoard(board4);
+    state.setSpacePlayed(board4, 0, player::o);
+    move action(board4, 4);
+    Ultimate3TState successorState = state.generateSuccessorState(action);
+
+    state.makeMove(action);
+
+    EXPECT_EQ(state.toBinary(), successorState.toBinary());
+}
+
+TEST(Ultimate3TStateTests, UnmakeMove_AfterMakeMove_RestoresState)
+{
+    Ultimate3TState state;
+    state.setActiveBoard(board8);
+    std::bitset<ENCODINGSIZE> originalEncoding = state.toBinary();
+
+    undoRecord undo = state.makeMove(move(board8, 8));
+    state.unmakeMove(undo);
+
+    EXPECT_EQ(state.toBinary(), originalEncoding);
+}
+
+TEST(Ultimate3TStateTests, UnmakeMove_MoveThatWonBoard_RestoresBoardResult)
+{
+    Ultimate3TState state;
+    state.setActivePlayer(player::x);
+    state.setActiveBoard(board0);
+    state.setSpacePlayed(board0, 0, player::x);
+    state.setSpacePlayed(board0, 1, player::x);
+    std::bitset<ENCODINGSIZE> originalEncoding = state.toBinary();
+
+    undoRecord undo = state.makeMove(move(board0, 2));
+    player wonBoardResult = state.getBoard()[0][2];
+    state.unmakeMove(undo);
+
+    EXPECT_EQ(wonBoardResult, player::x);
+    EXPECT_EQ(state.toBinary(), originalEncoding);
+    EXPECT_EQ(state.getActiveBoard(), board0);
+    EXPECT_EQ(state.getActivePlayer(), player::x);
+}
+
+TEST(Ultimate3TStateTests, MakeMove_IllegalMove_ThrowsError)
+{
+    Ultimate3TState state;
+    state.setActiveBoard(board1);
+
+    EXPECT_THROW(state.makeMove(move(board0, 0)), std::invalid_argument);
+}
+
+TEST(Ultimate3TStateTests, Hash_MadeMovesAndSetSpaces_IsEqual)
+{
+    Ultimate3TState madeMoves;
+    madeMoves.makeMove(move(board4, 0));
+    madeMoves.makeMove(move(board0, 4));
+    madeMoves.makeMove(move(board4, 8));
+    Ultimate3TState setSpaces;
+    setSpaces.setSpacePlayed(board4, 8, player::x);
+    setSpaces.setSpacePlayed(board0, 4, player::o);
+    setSpaces.setSpacePlayed(board4, 0, player::x);
+    setSpaces.setActiveBoard(board8);
+    setSpaces.setActivePlayer(player::o);
+
+    EXPECT_EQ(madeMoves.hash(), setSpaces.hash());
+}
+
+TEST(Ultimate3TStateTests, Hash_BinaryConstructor_MatchesIncrementalHash)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board2, 2));
+    state.makeMove(move(board2, 5));
+    state.setActiveBoard(board7);
+
+    Ultimate3TState stateReconstruction(state.toBinary());
+
+    EXPECT_EQ(state.hash(), stateReconstruction.hash());
+}
+
+TEST(Ultimate3TStateTests, Hash_DifferentActivePlayer_IsNotEqual)
+{
+    Ultimate3TState state;
+    Ultimate3TState otherPlayerToMove;
+    otherPlayerToMove.setActivePlayer(player::o);
+
+    EXPECT_NE(state.hash(), otherPlayerToMove.hash());
+}
+
+TEST(Ultimate3TStateTests, UnmakeMove_AfterMakeMove_RestoresHash)
+{
+    Ultimate3TState state;
+    uint64_t originalHash = state.hash();
+
+    undoRecord undo = state.makeMove(move(board3, 6));
+    uint64_t movedHash = state.hash();
+    state.unmakeMove(undo);
+
+    EXPECT_NE(movedHash, originalHash);
+    EXPECT_EQ(state.hash(), originalHash);
+}
+
+TEST(Ultimate3TStateTests, ToPackedPosition_DifferentAnnotations_IsEqual)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board5, 1));
+    Ultimate3TState annotatedState(state);
+    annotatedState.setEvaluation(evaluationValue(player::x, 3));
+    annotatedState.setBestMove(move(board1, 7));
+
+    EXPECT_NE(state.toBinary(), annotatedState.toBinary());
+    EXPECT_EQ(state.toPackedPosition(), annotatedState.toPackedPosition());
+}
+
+TEST(Ultimate3TStateTests, PackedPositionConstructor_ReconstructsPosition)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board5, 1));
+    state.makeMove(move(board1, 0));
+
+    Ultimate3TState stateReconstruction(state.toPackedPosition());
+
+    EXPECT_EQ(state.toBinary(), stateReconstruction.toBinary());
+    EXPECT_EQ(state.hash(), stateReconstruction.hash());
+}
+
+TEST(Ultimate3TStateTests, CanonicalHash_AllSymmetricVariants_IsEqual)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board0, 1));
+    state.makeMove(move(board1, 5));
+    state.makeMove(move(board5, 5));
+
+    for (int symmetry = 0; symmetry < Ultimate3TState::SymmetryCount; symmetry++)
+    {
+        EXPECT_EQ(state.transformed(symmetry).canonicalHash(), state.canonicalHash());
+    }
+}
+
+TEST(Ultimate3TStateTests, CanonicalSymmetry_AllSymmetricVariants_PackToLowestPosition)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board0, 1));
+    state.makeMove(move(board1, 5));
+    state.makeMove(move(board5, 5));
+    packedPosition canonical = state.toPackedPosition(state.canonicalSymmetry());
+
+    for (int symmetry = 0; symmetry < Ultimate3TState::SymmetryCount; symmetry++)
+    {
+        Ultimate3TState variant = state.transformed(symmetry);
+        EXPECT_EQ(variant.toPackedPosition(variant.canonicalSymmetry()), canonical);
+        EXPECT_FALSE(state.toPackedPosition(symmetry) < canonical);
+        // packing with a symmetry is the same as packing the transformed state.
+        EXPECT_EQ(variant.toPackedPosition(), state.toPackedPosition(symmetry));
+    }
+}
+
+TEST(Ultimate3TStateTests, CanonicalHash_DifferentPositions_IsNotEqual)
+{
+    Ultimate3TState corner;
+    corner.makeMove(move(board0, 0));
+    Ultimate3TState edge;
+    edge.makeMove(move(board0, 1));
+
+    EXPECT_NE(corner.canonicalHash(), edge.canonicalHash());
+}
+
+TEST(Ultimate3TStateTests, CanonicalHash_AfterMakeAndUnmakeMove_MatchesRebuiltState)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board4, 2));
+    undoRecord undo = state.makeMove(move(board2, 4));
+    Ultimate3TState rebuiltMoved(state.toBinary());
+    uint64_t movedHash = state.canonicalHash();
+    state.unmakeMove(undo);
+    Ultimate3TState rebuiltUnmoved(state.toBinary());
+
+    EXPECT_EQ(movedHash, rebuiltMoved.canonicalHash());
+    EXPECT_EQ(state.canonicalHash(), rebuiltUnmoved.canonicalHash());
+}
+
+TEST(Ultimate3TStateTests, Transformed_RotatedQuarterTurn_MovesSpacesAndActiveBoard)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board0, 1));
+
+    Ultimate3TState rotated = state.transformed(1);
+
+    // a clockwise quarter turn moves the top left board to the top right, and the top middle space to the middle right.
+    EXPECT_EQ(rotated.getSpacePlayed(board2, 5), player::x);
+    EXPECT_EQ(rotated.getActiveBoard(), board5);
+    EXPECT_EQ(rotated.getActivePlayer(), player::o);
+}
+
+TEST(Ultimate3TStateTests, TransformMove_InverseSymmetry_RestoresMove)
+{
+    move original(board3, 2);
+
+    for (int symmetry = 0; symmetry < Ultimate3TState::SymmetryCount; symmetry++)
+    {
+        move transformedMove = Ultimate3TState::transformMove(original, symmetry);
+        move restored = Ultimate3TState::transformMove(transformedMove, Ultimate3TState::inverseSymmetry(symmetry));
+        EXPECT_EQ(restored.toBinary(), original.toBinary());
+    }
+}
+
+TEST(Ultimate3TStateTests, Transformed_InvalidSymmetry_ThrowsError)
+{
+    Ultimate3TState state;
+
+    EXPECT_THROW(state.transformed(Ultimate3TState::SymmetryCount), std::out_of_range);
+}
+
+TEST(Ultimate3TStateTests, Hash_DecidedBoardsWithDifferentContents_IsEqual)
+{
+    // x wins board 0 on the top row in both states, and the same spaces are filled, but by different players.
+    Ultimate3TState first;
+    Ultimate3TState second;
+    for (int i = 0; i < 3; i++)
+    {
+        first.setSpacePlayed(board0, i, player::x);
+        second.setSpacePlayed(board0, i, player::x);
+    }
+    first.setSpacePlayed(board0, 3, player::o);
+    second.setSpacePlayed(board0, 3, player::x);
+    first.setSpacePlayed(board0, 4, player::x);
+    second.setSpacePlayed(board0, 4, player::o);
+
+    EXPECT_EQ(first.hash(), second.hash());
+    EXPECT_EQ(first.toPackedPosition(), second.toPackedPosition());
+    EXPECT_NE(first.toBinary(), second.toBinary());
+}
+
+TEST(Ultimate3TStateTests, Hash_DecidedBoardsWithDifferentEmptySpaces_IsNotEqual)
+{
+    Ultimate3TState first;
+    Ultimate3TState second;
+    for (int i = 0; i < 3; i++)
+    {
+        first.setSpacePlayed(board0, i, player::x);
+        second.setSpacePlayed(board0, i, player::x);
+    }
+    first.setSpacePlayed(board0, 3, player::o);
+    second.setSpacePlayed(board0, 5, player::o);
+
+    EXPECT_NE(first.hash(), second.hash());
+}
+
+TEST(Ultimate3TStateTests, Hash_MovesDecidingBoard_MatchesRebuiltStateAndUnmakes)
+{
+    Ultimate3TState state;
+    std::vector<undoRecord> undos;
+    // x takes the top row of board 4, then o plays into the decided board.
+    move moves[] = {move(board4, 0), move(board0, 4), move(board4, 1), move(board1, 4), move(board4, 2), move(board2, 4), move(board4, 3)};
+    std::vector<uint64_t> hashes;
+    for (move played : moves)
+    {
+        hashes.push_back(state.hash());
+        undos.push_back(state.makeMove(played));
+        Ultimate3TState rebuilt(state.toBinary());
+        EXPECT_EQ(state.hash(), rebuilt.hash());
+        EXPECT_EQ(state.canonicalHash(), rebuilt.canonicalHash());
+    }
+    for (int i = int(undos.size()) - 1; i >= 0; i--)
+    {
+        state.unmakeMove(undos[i]);
+        EXPECT_EQ(state.hash(), hashes[i]);
+    }
+}
+
+TEST(Ultimate3TStateTests, GenerateMoveList_AnyBoard_MatchesGenerateMoves)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board4, 4));
+    state.makeMove(move(board4, 0));
+    state.setActiveBoard(anyBoard);
+    std::vector<move> expected = state.generateMoves();
+    moveList legalMoves;
+
+    state.generateMoves(legalMoves);
+
+    ASSERT_EQ(legalMoves.size(), int(expected.size()));
+    for (int i = 0; i < legalMoves.size(); i++)
+    {
+        EXPECT_EQ(legalMoves[i].toBinary(), expected[i].toBinary());
+    }
+    EXPECT_EQ(state.countMoves(), 79);
+}
+
+TEST(Ultimate3TStateTests, GenerateMoveList_ActiveBoard_OnlyEmptySpacesOfBoard)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board2, 3));
+    state.makeMove(move(board3, 2));
+    moveList legalMoves;
+
+    // x must play in board 2, where space 3 is taken.
+    state.generateMoves(legalMoves);
+
+    EXPECT_EQ(legalMoves.size(), 8);
+    EXPECT_EQ(state.countMoves(), 8);
+    for (const move& legalMove : legalMoves)
+    {
+        EXPECT_EQ(legalMove.board, board2);
+        EXPECT_NE(legalMove.space, 3);
+    }
+}
+
+TEST(Ultimate3TStateTests, GenerateMoveList_TerminalState_EmptiesList)
+{
+    Ultimate3TState state = createTerminalState();
+    moveList legalMoves;
+    legalMoves.add(board0, 0);
+
+    state.generateMoves(legalMoves);
+
+    EXPECT_EQ(legalMoves.size(), 0);
+    EXPECT_EQ(state.countMoves(), 0);
+}
+
+TEST(Ultimate3TStateTests, PackedPositionConstructor_RandomGames_ReconstructsEveryPosition)
+{
+    std::mt19937 random(11);
+    for (int game = 0; game < 20; game++)
+    {
+        Ultimate3TState state;
+        while (!state.isTerminalState())
+        {
+            moveList legalMoves;
+            state.generateMoves(legalMoves);
+            state.makeMove(legalMoves[random() % legalMoves.size()]);
+
+            packedPosition packed = state.toPackedPosition();
+            Ultimate3TState unpacked(packed);
+
+            // decided boards unpack with their filled spaces as draws, so compare what the state is keyed by.
+            EXPECT_EQ(unpacked.toPackedPosition(), packed);
+            EXPECT_EQ(unpacked.hash(), state.hash());
+            EXPECT_EQ(unpacked.getActiveBoard(), state.getActiveBoard());
+            EXPECT_EQ(unpacked.getActivePlayer(), state.getActivePlayer());
+        }
+    }
+}
+
+TEST(Ultimate3TStateTests, PackedPositionConstructor_NoDecidedBoards_ReconstructsFullEncoding)
+{
+    Ultimate3TState state;
+    state.makeMove(move(board8, 8));
+    state.makeMove(move(board8, 0));
+    state.makeMove(move(board0, 8));
+    state.setActiveBoard(anyBoard);
+
+    Ultimate3TState unpacked(state.toPackedPosition());
+
+    EXPECT_EQ(unpacked.toBinary(), state.toBinary());
+}
+
+TEST(Ultimate3TStateTests, ToPackedPosition_DrawSpaceInUndecidedBoard_ThrowsError)
+{
+    Ultimate3TState state;
+    state.setSpacePlayed(board3, 3, player::draw);
+
+    EXPECT_THROW(state.toPackedPosition(), std::invalid_argument);
+}
+
+TEST(Ultimate3TStateTests, PackedPositionConstructor_InvalidWords_ThrowsError)
+{
+    packedPosition invalid{UINT64_MAX, UINT64_MAX};
+
+    EXPECT_THROW(Ultimate3TState state(invalid), std::invalid_argument);
+}
+
+TEST(Ultimate3TStateTests, ToPackedPosition_Symmetry_MatchesTransformedState)
+{
+    std::mt19937 random(12);
+    Ultimate3TState state;
+    for (int i = 0; i < 30 and !state.isTerminalState(); i++)
+    {
+        moveList legalMoves;
+        state.generateMoves(legalMoves);
+        state.makeMove(legalMoves[random() % legalMoves.size()]);
+    }
+
+    for (int symmetry = 0; symmetry < Ultimate3TState::SymmetryCount; symmetry++)
+    {
+        EXPECT_EQ(state.toPackedPosition(symmetry), state.transformed(symmetry).toPackedPosition());
+    }
+    EXPECT_THROW(state.toPackedPosition(Ultimate3TState::SymmetryCount), std::out_of_range);
+}
+
+TEST(Ultimate3TStateTests, HeuristicScore_StartState_FavoursPlayerToMove)
+{
+    Ultimate3TState state;
+
+    // x is free to play on any board, and nothing else is on the board yet.
+    EXPECT_GT(state.heuristicScore(), 0);
+}
+
+TEST(Ultimate3TStateTests, HeuristicScore_XHoldsMoreOfEachBoard_FavoursX)
+{
+    Ultimate3TState state;
+    state.setSpacePlayed(4, 4, player::x);
+    state.setSpacePlayed(4, 0, player::x);
+    state.setSpacePlayed(4, 1, player::o);
+    state.setActiveBoard(board1);
+    state.setActivePlayer(player::o);
+
+    EXPECT_GT(state.heuristicScore(), 0);
+
+    state.setSpacePlayed(0, 0, player::o);
+    state.setSpacePlayed(0, 1, player::o);
+    state.setSpacePlayed(0, 2, player::o);
+
+    EXPECT_LT(state.heuristicScore(), 0);
+}
+
+TEST(Ultimate3TStateTests, HeuristicScore_RandomGames_MatchesRebuiltStateAndUnmakes)
+{
+    std::mt19937 random(13);
+    for (int game = 0; game < 20; game++)
+    {
+        Ultimate3TState state;
+        std::vector<undoRecord> undos;
+        std::vector<int> scores;
+        while (!state.isTerminalState())
+        {
+            moveList legalMoves;
+            state.generateMoves(legalMoves);
+            scores.push_back(state.heuristicScore());
+            undos.push_back(state.makeMove(legalMoves[random() % legalMoves.size()]));
+
+            Ultimate3TState rebuilt(state.toPackedPosition());
+            EXPECT_EQ(rebuilt.heuristicScore(), state.heuristicScore());
+            EXPECT_LE(std::abs(state.heuristicScore()), int(Ultimate3TState::MaxHeuristicScore));
+            for (int symmetry = 1; symmetry < Ultimate3TState::SymmetryCount; symmetry++)
+            {
+                EXPECT_EQ(state.transformed(symmetry).heuristicScore(), state.heuristicScore());
+            }
+        }
+        while (!undos.empty())
+        {
+            state.unmakeMove(undos.back());
+            undos.pop_back();
+            EXPECT_EQ(state.heuristicScore(), scores.back());
+            scores.pop_back();
+        }
+    }
+}
+
+TEST(Ultimate3TStateTests, WinsBoard_TwoInARow_WinsForOwnerOnly)
+{
+    Ultimate3TState state;
+    state.setSpacePlayed(0, 0, player::x);
+    state.setSpacePlayed(0, 1, player::x);
+    state.setActiveBoard(board0);
+    state.setActivePlayer(player::o);
+
+    EXPECT_TRUE(state.winsBoard(move(board0, 2), player::x));
+    EXPECT_FALSE(state.winsBoard(move(board0, 2), player::o));
+    EXPECT_FALSE(state.winsBoard(move(board0, 4), player::x));
+}
+
+TEST(Ultimate3TStateTests, WinsBoard_DecidedBoard_ReturnsFalse)
+{
+    Ultimate3TState state;
+    state.setSpacePlayed(0, 0, player::o);
+    state.setSpacePlayed(0, 1, player::o);
+    state.setSpacePlayed(0, 2, player::o);
+    state.setSpacePlayed(0, 3, player::x);
+    state.setSpacePlayed(0, 4, player::x);
+
+    EXPECT_FALSE(state.winsBoard(move(board0, 5), player::x));
+}
+
+TEST(Ultimate3TStateTests, GivesFreeChoice_SendsToFullBoard_ReturnsTrue)
+{
+    Ultimate3TState state;
+    for (int space = 0; space < 9; space++)
+    {
+        state.setSpacePlayed(1, space, player::draw);
+    }
+    // board 2 is full except for the space that sends the next player back to it.
+    for (int space = 0; space < 9; space++)
+    {
+        if (space != 2) { state.setSpacePlayed(2, space, player::draw); }
+    }
+
+    EXPECT_TRUE(state.givesFreeChoice(move(board0, 1)));
+    EXPECT_FALSE(state.givesFreeChoice(move(board0, 3)));
+    EXPECT_FALSE(state.givesFreeChoice(move(board0, 2)));
+    EXPECT_TRUE(state.givesFreeChoice(move(board2, 2)));
+}
@@ -85,6 +85,8 @@ TEST_P(EvaluationUnitTestFalseResult, GreaterThan_FirstLessThanOrEqualTo_Returns
     EXPECT_FALSE(values[0] > values[1]);
 }
 
+// Comparisons only check their values in debug builds, so these tests only run there.
+#ifndef NDEBUG
 // Needed for parameterized tests
 class EvaluationUnitTestThrowResult :
     public testing::TestWithParam<std::vector<evaluationValue>>
@@ -156,6 +158,7 @@ TEST_P(EvaluationUnitTestThrowResult, GreaterThan_EitherInvalid_Throws_InvalidAr
     
     EXPECT_THROW(values[0] > values[1], std::invalid_argument);
 }
+#endif
 
 TEST(EvaluationValueComparisonTests, EqualTo_EqualInput_Returns_True)
 {
@@ -192,4 +195,50 @@ TEST(EvaluationValueComparisonTests, NotEqual_UnequalInputs_Returns_True)
     evaluationValue firstValue(player::x, 0), secondValue(player::x, 1);
 
     EXPECT_TRUE(firstValue != secondValue);
-}
\ No newline at end of file
+}
+
+TEST(EvaluationValueComparisonTests, Compare_DrawsOfDifferentDepths_AreEquallyGoodButNotEqual)
+{
+    evaluationValue shallow(player::draw, 5), deep(player::draw, 6);
+
+    EXPECT_FALSE(shallow > deep);
+    EXPECT_FALSE(shallow < deep);
+    EXPECT_TRUE(shallow >= deep);
+    EXPECT_TRUE(shallow <= deep);
+    EXPECT_FALSE(shallow == deep);
+}
+
+TEST(EvaluationValueComparisonTests, Compare_IsConstantExpression)
+{
+    static_assert(evaluationValue(player::x, 3) > evaluationValue(player::x, 4), "a quicker win is better");
+    static_assert(evaluationValue(player::o, 4) > evaluationValue(player::o, 3), "a slower loss is better");
+    static_assert(evaluationValue(player::draw, 9) < evaluationValue(player::x, 81), "any win beats a draw");
+    static_assert(sizeof(evaluationValue) == 2, "an evaluationValue is one small integer");
+    SUCCEED();
+}
+
+TEST(EvaluationValueTests, Accessors_EveryValue_ReturnConstructedValue)
+{
+    player players[3] = {player::x, player::o, player::draw};
+    for (player who : players)
+    {
+        for (int depth = 0; depth <= 81; depth++)
+        {
+            evaluationValue value(who, depth);
+
+            EXPECT_EQ(value.getPlayerToWin(), who);
+            EXPECT_EQ(value.getDepth(), depth);
+            EXPECT_EQ(evaluationValue::unpack(value.pack()), value);
+        }
+    }
+    EXPECT_EQ(evaluationValue().getPlayerToWin(), player::neither);
+    EXPECT_EQ(evaluationValue().getDepth(), 0);
+}
+
+TEST(EvaluationValueTests, Deeper_EveryOutcome_AddsOneToDepth)
+{
+    EXPECT_EQ(evaluationValue(player::x, 3).deeper(), evaluationValue(player::x, 4));
+    EXPECT_EQ(evaluationValue(player::o, 0).deeper(), evaluationValue(player::o, 1));
+    EXPECT_EQ(evaluationValue(player::draw, 80).deeper(), evaluationValue(player::draw, 81));
+    EXPECT_EQ(evaluationValue().deeper(), evaluationValue());
+}